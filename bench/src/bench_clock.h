@@ -0,0 +1,33 @@
+#ifndef BENCH_CLOCK_H
+#define BENCH_CLOCK_H
+
+#include <zephyr/kernel.h>
+#include <stdint.h>
+
+/*
+ * Time source for the benchmarks. Differences are taken modulo 2^32, so a
+ * single measurement must stay below one counter wrap.
+ *
+ * On native_sim the simulated clock only moves when the CPU idles, so the
+ * host monotonic clock is read instead and results are in nanoseconds.
+ * On real or emulated targets the hardware cycle counter is used.
+ */
+#ifdef CONFIG_ARCH_POSIX
+#define BENCH_UNIT "ns"
+
+uint32_t bench_host_ns(void);
+
+static inline uint32_t bench_now(void)
+{
+    return bench_host_ns();
+}
+#else
+#define BENCH_UNIT "cyc"
+
+static inline uint32_t bench_now(void)
+{
+    return k_cycle_get_32();
+}
+#endif
+
+#endif // BENCH_CLOCK_H
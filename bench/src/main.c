@@ -0,0 +1,337 @@
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include <math.h>
+#include <string.h>
+
+#include "bench_clock.h"
+#include "data_handler.h"
+#include "geo.h"
+#include "ht1621.h"
+#include "nmea_encode.h"
+#include "sensor_math.h"
+#include "ubx.h"
+#include "vib_spectrum.h"
+
+// Operations per timed loop
+#define BENCH_ITERATIONS        2000
+
+// Windows per timed loop, each is three 256 point FFTs
+#define VIB_ITERATIONS          20
+
+// Operations per thread in the contention benchmark
+#define CONTENTION_OPS          500
+#define CONTENTION_STACK_SIZE   1024
+
+extern uint32_t null_transport_nibbles;
+
+// Keep the compiler from dropping the loops under test
+static volatile float float_sink;
+static volatile uint32_t int_sink;
+
+struct vec3 {
+    float x, y, z;
+};
+
+// Field (Gauss) and acceleration (m/s^2) samples around a level, slowly
+// turning boat
+static const struct vec3 mag_samples[] = {
+    {  0.21f,  0.02f, -0.40f }, {  0.15f,  0.15f, -0.41f },
+    {  0.01f,  0.22f, -0.39f }, { -0.14f,  0.16f, -0.40f },
+    { -0.22f,  0.00f, -0.42f }, { -0.15f, -0.14f, -0.40f },
+    {  0.00f, -0.21f, -0.41f }, {  0.16f, -0.15f, -0.39f },
+};
+
+static const struct vec3 accel_samples[] = {
+    {  0.00f,  0.00f,  9.81f }, {  0.52f, -0.31f,  9.78f },
+    { -1.70f,  0.85f,  9.62f }, {  0.10f,  2.40f,  9.50f },
+    {  3.10f, -1.20f,  9.20f }, { -0.45f, -0.60f,  9.79f },
+    {  0.05f,  0.07f,  9.80f }, { -2.80f,  1.90f,  9.21f },
+};
+
+// Degrees * 1000, the range the display pages see
+static const int32_t display_samples[] = {
+    123456, -98765, 3141, 0, 359999, -5, 42000, 7,
+};
+
+static void report(const char *name, uint32_t elapsed, uint32_t ops)
+{
+    TC_PRINT("%-26s %8u %s/op\n", name, elapsed / ops, BENCH_UNIT);
+}
+
+ZTEST(bench, test_heading_math)
+{
+    uint32_t start;
+
+    zassert_within(sensor_math_heading(1.0f, 0.0f), 360.0f + MAG_DECLINATION_DEG, 0.01f);
+    zassert_within(sensor_math_heading(0.0f, 1.0f), 90.0f + MAG_DECLINATION_DEG, 0.01f);
+
+    start = bench_now();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        const struct vec3 *m = &mag_samples[i % ARRAY_SIZE(mag_samples)];
+        float_sink = sensor_math_heading(m->x, m->y);
+    }
+    report("heading", bench_now() - start, BENCH_ITERATIONS);
+}
+
+ZTEST(bench, test_orientation_math)
+{
+    float pitch, roll;
+    uint32_t start;
+
+    zassert_ok(sensor_math_orientation(0.0f, 0.0f, 9.81f, &pitch, &roll));
+    zassert_within(pitch, 0.0f, 0.01f);
+    zassert_within(roll, 0.0f, 0.01f);
+    zassert_equal(sensor_math_orientation(0.0f, 0.0f, 0.0f, &pitch, &roll), -EINVAL);
+
+    start = bench_now();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        const struct vec3 *a = &accel_samples[i % ARRAY_SIZE(accel_samples)];
+        sensor_math_orientation(a->x, a->y, a->z, &pitch, &roll);
+        float_sink = pitch + roll;
+    }
+    report("orientation", bench_now() - start, BENCH_ITERATIONS);
+}
+
+ZTEST(bench, test_display_format)
+{
+    uint8_t frame[HT1621_MAX_DIGITS];
+    uint32_t start;
+
+    null_transport_nibbles = 0;
+    start = bench_now();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        ht1621_display_number(display_samples[i % ARRAY_SIZE(display_samples)], false);
+    }
+    report("ht1621_display_number", bench_now() - start, BENCH_ITERATIONS);
+    zassert_true(null_transport_nibbles > 0);
+
+    start = bench_now();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        ht1621_display_float(display_samples[i % ARRAY_SIZE(display_samples)] / 1000.0f, 1);
+    }
+    report("ht1621_display_float", bench_now() - start, BENCH_ITERATIONS);
+
+    // The fixed-point path the display thread uses, for comparison
+    start = bench_now();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        ht1621_format_fixed(frame, display_samples[i % ARRAY_SIZE(display_samples)], 3, 1, 0);
+        ht1621_write_frame(frame);
+    }
+    report("format_fixed+write_frame", bench_now() - start, BENCH_ITERATIONS);
+}
+
+ZTEST(bench, test_ubx_frame)
+{
+    // UBX-CFG-MSG enabling NMEA RMC on UART1
+    static const uint8_t rmc_on[UBX_CFG_MSG_LEN] = {
+        0xB5, 0x62, 0x06, 0x01, 0x08, 0x00, 0xF0, 0x04,
+        0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x04, 0x44,
+    };
+    uint8_t frame[UBX_CFG_MSG_LEN];
+    uint32_t start;
+
+    zassert_equal(ubx_build_cfg_msg(frame, 0xF0, 0x04, 1), UBX_CFG_MSG_LEN);
+    zassert_mem_equal(frame, rmc_on, sizeof(rmc_on));
+
+    start = bench_now();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        ubx_build_cfg_msg(frame, 0xF0, i & 0x0F, i & 1);
+        int_sink = frame[UBX_CFG_MSG_LEN - 1];
+    }
+    report("ubx_build_cfg_msg", bench_now() - start, BENCH_ITERATIONS);
+}
+
+// Positions around a mark, 1e-7 degrees
+static const int32_t geo_samples[][2] = {
+    { 594371234, 247531234 }, { 594412345, 247498765 }, { 594298765, 247612345 },
+    { 594380000, 247400000 }, { 594455555, 247555555 }, { 594333333, 247444444 },
+    { 594366666, 247599999 }, { 594400001, 247536000 },
+};
+
+ZTEST(bench, test_nmea_encode)
+{
+    static const char expected[] =
+        "$HCHDT,123.5,T*2C\r\n"
+        "$HCXDR,A,-1.3,D,PTCH,A,0.0,D,ROLL*78\r\n";
+    char buf[2 * NMEA_SENTENCE_MAX];
+    struct nmea_writer w;
+    uint32_t start;
+
+    nmea_writer_init(&w, buf, sizeof(buf));
+    nmea_begin(&w, "HC", "HDT");
+    nmea_field_fixed(&w, 123456, 3, 1);
+    nmea_field_char(&w, 'T');
+    zassert_equal(nmea_end(&w), 19);
+    nmea_begin(&w, "HC", "XDR");
+    nmea_field_char(&w, 'A');
+    nmea_field_fixed(&w, -1250, 3, 1);
+    nmea_field_char(&w, 'D');
+    nmea_field_str(&w, "PTCH");
+    nmea_field_char(&w, 'A');
+    nmea_field_fixed(&w, -40, 3, 1);
+    nmea_field_char(&w, 'D');
+    nmea_field_str(&w, "ROLL");
+    nmea_end(&w);
+    zassert_equal(w.len, sizeof(expected) - 1);
+    zassert_mem_equal(buf, expected, w.len);
+
+    // HDT and XDR from the display samples, what the talker sends per tick
+    start = bench_now();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        int32_t value = display_samples[i % ARRAY_SIZE(display_samples)];
+
+        nmea_writer_init(&w, buf, sizeof(buf));
+        nmea_begin(&w, "HC", "HDT");
+        nmea_field_fixed(&w, value, 3, 1);
+        nmea_field_char(&w, 'T');
+        nmea_end(&w);
+        nmea_begin(&w, "HC", "XDR");
+        nmea_field_char(&w, 'A');
+        nmea_field_fixed(&w, value, 3, 1);
+        nmea_field_char(&w, 'D');
+        nmea_field_str(&w, "PTCH");
+        nmea_field_char(&w, 'A');
+        nmea_field_fixed(&w, -value, 3, 1);
+        nmea_field_char(&w, 'D');
+        nmea_field_str(&w, "ROLL");
+        nmea_end(&w);
+        int_sink = w.len;
+    }
+    report("nmea HDT+XDR", bench_now() - start, BENCH_ITERATIONS);
+}
+
+ZTEST(bench, test_geo_kernels)
+{
+    const int32_t mark_lat = 594370000, mark_lon = 247536000;
+    int32_t cos_lat = geo_cos_lat_q15(mark_lat);
+    uint32_t distance, bearing;
+    uint32_t start;
+
+    // 0.01 degrees of latitude due north is 1112 m
+    struct geo_vec v = geo_offset_cm(mark_lat, mark_lon, cos_lat, mark_lat + 100000, mark_lon);
+    zassert_within(geo_length_cm(v), 111195, 2);
+    zassert_equal(geo_bearing_mdeg(v), 0);
+    zassert_within(geo_cos_q15(60000), 16384, 4);
+
+    // Flat offset, length and bearing: the per-fix route kernel
+    start = bench_now();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        const int32_t *p = geo_samples[i % ARRAY_SIZE(geo_samples)];
+
+        v = geo_offset_cm(mark_lat, mark_lon, cos_lat, p[0], p[1]);
+        int_sink = geo_length_cm(v) + geo_bearing_mdeg(v);
+    }
+    report("geo flat dist+bearing", bench_now() - start, BENCH_ITERATIONS);
+
+    // Haversine, for comparison
+    start = bench_now();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        const int32_t *p = geo_samples[i % ARRAY_SIZE(geo_samples)];
+
+        geo_great_circle(mark_lat, mark_lon, p[0], p[1], &distance, &bearing);
+        int_sink = distance + bearing;
+    }
+    report("geo great circle", bench_now() - start, BENCH_ITERATIONS);
+}
+
+ZTEST(bench, test_vib_spectrum)
+{
+    static int16_t raw[VIB_AXES][VIB_WINDOW];
+    struct vib_result result;
+    uint32_t start;
+
+    // 0.1 g at 40 Hz across, 0.05 g at 130 Hz fore and aft, 1 g down,
+    // sampled at 500 Hz and 16384 LSB/g
+    for (int i = 0; i < VIB_WINDOW; i++) {
+        raw[0][i] = 1638.4f * sinf(2.0f * 3.14159265f * 40.0f * i / 500.0f);
+        raw[1][i] = 819.2f * sinf(2.0f * 3.14159265f * 130.0f * i / 500.0f);
+        raw[2][i] = 16384;
+    }
+
+    zassert_ok(vib_spectrum_init());
+    vib_spectrum_analyse(raw, 16384, 500000, &result);
+    zassert_within(result.peak_chz, 4000, 100);
+    zassert_within(result.rms_mg, 79, 2);
+    zassert_within(result.band_mg[1], 71, 2);
+    zassert_within(result.band_mg[3], 35, 2);
+
+    start = bench_now();
+    for (int i = 0; i < VIB_ITERATIONS; i++) {
+        raw[0][i] ^= 1;
+        vib_spectrum_analyse(raw, 16384, 500000, &result);
+        int_sink = result.peak_chz;
+    }
+    report("vib_spectrum_analyse", bench_now() - start, VIB_ITERATIONS);
+}
+
+// data_handler under contention: two writers and a reader on the same
+// channels. Nothing observes them here, so this is the publish and read
+// cost alone.
+static K_THREAD_STACK_DEFINE(gps_writer_stack, CONTENTION_STACK_SIZE);
+static K_THREAD_STACK_DEFINE(acc_writer_stack, CONTENTION_STACK_SIZE);
+static struct k_thread gps_writer_thread;
+static struct k_thread acc_writer_thread;
+
+static void gps_writer(void *p1, void *p2, void *p3)
+{
+    struct gps_data gps = { .valid = true };
+
+    for (int i = 0; i < CONTENTION_OPS; i++) {
+        gps.sog = i;
+        set_gps_data(gps);
+    }
+}
+
+static void acc_writer(void *p1, void *p2, void *p3)
+{
+    struct acc_data acc = { .valid = true };
+    struct compass_data compass = { .valid = true };
+
+    for (int i = 0; i < CONTENTION_OPS; i++) {
+        acc.pitch = i;
+        set_acc_data(acc);
+        compass.heading = i;
+        set_compass_data(compass);
+    }
+}
+
+static void reader(void)
+{
+    struct sensor_data snap;
+
+    for (int i = 0; i < CONTENTION_OPS; i++) {
+        get_sensors_data(&snap);
+        int_sink = snap.acc_data.pitch;
+    }
+}
+
+ZTEST(bench, test_data_handler)
+{
+    int prio = k_thread_priority_get(k_current_get());
+    struct gps_data gps = { .valid = true };
+    struct gps_data out;
+    uint32_t start;
+
+    // Uncontended baseline
+    start = bench_now();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        gps.sog = i;
+        set_gps_data(gps);
+        get_gps_data(&out);
+    }
+    report("data set+get", bench_now() - start, BENCH_ITERATIONS);
+    zassert_equal(out.sog, BENCH_ITERATIONS - 1);
+
+    // Three sets and one snapshot per round, spread over three threads
+    start = bench_now();
+    k_thread_create(&gps_writer_thread, gps_writer_stack, CONTENTION_STACK_SIZE,
+                    gps_writer, NULL, NULL, NULL, prio, 0, K_NO_WAIT);
+    k_thread_create(&acc_writer_thread, acc_writer_stack, CONTENTION_STACK_SIZE,
+                    acc_writer, NULL, NULL, NULL, prio, 0, K_NO_WAIT);
+    reader();
+    k_thread_join(&gps_writer_thread, K_FOREVER);
+    k_thread_join(&acc_writer_thread, K_FOREVER);
+    report("data contended", bench_now() - start, CONTENTION_OPS * 4);
+}
+
+ZTEST_SUITE(bench, NULL, NULL, NULL, NULL, NULL);
@@ -0,0 +1,30 @@
+// HT1621 transport that only counts what would go on the bus, so the
+// display benchmarks time formatting and driver bookkeeping alone.
+#include "ht1621_transport.h"
+#include <zephyr/sys/util.h>
+
+uint32_t null_transport_nibbles;
+
+static int null_init(void)
+{
+    return 0;
+}
+
+static void null_send_command(uint8_t cmd)
+{
+    ARG_UNUSED(cmd);
+}
+
+static void null_write(uint8_t addr, const uint8_t *nibbles, uint8_t count)
+{
+    ARG_UNUSED(addr);
+    ARG_UNUSED(nibbles);
+    null_transport_nibbles += count;
+}
+
+const struct ht1621_transport ht1621_transport = {
+    .name = "null",
+    .init = null_init,
+    .send_command = null_send_command,
+    .write = null_write,
+};
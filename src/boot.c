@@ -0,0 +1,199 @@
+#include "boot.h"
+#include "command_parser.h"
+#include "geofence.h"
+#include "gps_config.h"
+#include "supervisor.h"
+#include "time_service.h"
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+
+LOG_MODULE_REGISTER(boot, LOG_LEVEL_INF);
+
+#define BOOT_WQ_STACK_SIZE      1024
+// Below the sensor loop, display and track, nothing here is urgent
+#define BOOT_WQ_PRIORITY        12
+
+struct stage {
+    uint32_t begin;         // us since reset
+    uint32_t ready;
+    int result;
+    bool done;
+};
+
+static const char *const stage_names[BOOT_STAGE_COUNT] = {
+    [BOOT_STAGE_KERNEL]      = "kernel",
+    [BOOT_STAGE_IMU]         = "imu",
+    [BOOT_STAGE_COMPASS]     = "compass",
+    [BOOT_STAGE_FENCES]      = "fences",
+    [BOOT_STAGE_GNSS_CONFIG] = "gnss_config",
+    [BOOT_STAGE_HEADING]     = "heading",
+    [BOOT_STAGE_FIX]         = "fix",
+};
+
+// What each stage waits for, to trace the critical path
+static const uint8_t stage_deps[BOOT_STAGE_COUNT] = {
+    [BOOT_STAGE_IMU]         = BIT(BOOT_STAGE_KERNEL),
+    [BOOT_STAGE_COMPASS]     = BIT(BOOT_STAGE_KERNEL),
+    [BOOT_STAGE_FENCES]      = BIT(BOOT_STAGE_KERNEL),
+    [BOOT_STAGE_GNSS_CONFIG] = BIT(BOOT_STAGE_KERNEL),
+    [BOOT_STAGE_HEADING]     = BIT(BOOT_STAGE_IMU) | BIT(BOOT_STAGE_COMPASS),
+    [BOOT_STAGE_FIX]         = BIT(BOOT_STAGE_GNSS_CONFIG),
+};
+
+static struct stage stages[BOOT_STAGE_COUNT];
+static struct k_spinlock boot_lock;
+
+static K_EVENT_DEFINE(boot_events);
+
+static K_THREAD_STACK_DEFINE(boot_wq_stack, BOOT_WQ_STACK_SIZE);
+static struct k_work_q boot_wq;
+
+// The extended cycle counter, so a slow first fix does not wrap
+static uint32_t now_us(void)
+{
+    return (uint32_t)k_cyc_to_us_floor64(time_local_now());
+}
+
+void boot_stage_begin(enum boot_stage stage)
+{
+    k_spinlock_key_t key = k_spin_lock(&boot_lock);
+
+    stages[stage].begin = now_us();
+    k_spin_unlock(&boot_lock, key);
+}
+
+void boot_stage_done(enum boot_stage stage, int result)
+{
+    k_spinlock_key_t key = k_spin_lock(&boot_lock);
+    struct stage *s = &stages[stage];
+
+    if (s->done) {
+        k_spin_unlock(&boot_lock, key);
+        return;
+    }
+    s->ready = now_us();
+    s->result = result;
+    s->done = true;
+    k_spin_unlock(&boot_lock, key);
+
+    k_event_post(&boot_events, BIT(stage));
+    LOG_INF("%s ready at %u ms (%d)", stage_names[stage], s->ready / 1000, result);
+}
+
+int boot_wait(enum boot_stage stage, k_timeout_t timeout)
+{
+    if (k_event_wait(&boot_events, BIT(stage), false, timeout) == 0) {
+        return -EAGAIN;
+    }
+    return stages[stage].result;
+}
+
+static void fences_work_fn(struct k_work *work)
+{
+    int ret;
+
+    boot_stage_begin(BOOT_STAGE_FENCES);
+    ret = geofence_init();
+    if (ret != 0) {
+        printk("Failed to load geofences: %d\n", ret);
+    }
+    boot_stage_done(BOOT_STAGE_FENCES, ret);
+}
+
+static K_WORK_DEFINE(fences_work, fences_work_fn);
+
+static void gnss_work_fn(struct k_work *work)
+{
+    boot_stage_begin(BOOT_STAGE_GNSS_CONFIG);
+    gps_enable_standard_messages();
+    boot_stage_done(BOOT_STAGE_GNSS_CONFIG, 0);
+    // Receiver output is only expected from here
+    supervisor_enable(SUP_GNSS);
+}
+
+static K_WORK_DELAYABLE_DEFINE(gnss_work, gnss_work_fn);
+
+void boot_start(void)
+{
+    // Everything before main() is the kernel and driver init
+    boot_stage_done(BOOT_STAGE_KERNEL, 0);
+
+    k_work_queue_start(&boot_wq, boot_wq_stack, K_THREAD_STACK_SIZEOF(boot_wq_stack),
+                       BOOT_WQ_PRIORITY, NULL);
+    k_thread_name_set(&boot_wq.thread, "boot_wq");
+
+    k_work_submit_to_queue(&boot_wq, &fences_work);
+    // Counted from reset, the receiver powered up with us
+    k_work_schedule_for_queue(&boot_wq, &gnss_work, K_TIMEOUT_ABS_MS(BOOT_GNSS_DELAY_MS));
+}
+
+// Console commands
+static void print_ms(uint32_t us)
+{
+    printk("%7u.%u", us / 1000, us % 1000 / 100);
+}
+
+// Walk back from 'target' through the dependency that was ready last
+static void print_critical_path(const struct stage *snap, enum boot_stage target)
+{
+    uint8_t path[BOOT_STAGE_COUNT];
+    int len = 0;
+    int at = target;
+
+    if (!snap[target].done) {
+        printk("%s: not reached\n", stage_names[target]);
+        return;
+    }
+
+    while (1) {
+        int last = -1;
+
+        path[len++] = at;
+        for (int i = 0; i < BOOT_STAGE_COUNT; i++) {
+            if ((stage_deps[at] & BIT(i)) &&
+                (last < 0 || snap[i].ready > snap[last].ready)) {
+                last = i;
+            }
+        }
+        if (last < 0) {
+            break;
+        }
+        at = last;
+    }
+
+    printk("%s:", stage_names[target]);
+    while (len-- > 0) {
+        printk(" %s %u ms%s", stage_names[path[len]], snap[path[len]].ready / 1000,
+               len > 0 ? " >" : "\n");
+    }
+}
+
+static int cmd_boot(int argc, char **argv)
+{
+    struct stage snap[BOOT_STAGE_COUNT];
+    k_spinlock_key_t key = k_spin_lock(&boot_lock);
+
+    memcpy(snap, stages, sizeof(snap));
+    k_spin_unlock(&boot_lock, key);
+
+    printk("%-12s%9s%9s%9s  %s\n", "stage", "begin ms", "ready ms", "took ms", "result");
+    for (int i = 0; i < BOOT_STAGE_COUNT; i++) {
+        printk("%-12s", stage_names[i]);
+        print_ms(snap[i].begin);
+        if (!snap[i].done) {
+            printk("%9s\n", "-");
+            continue;
+        }
+        print_ms(snap[i].ready);
+        print_ms(snap[i].ready - snap[i].begin);
+        printk("  %d\n", snap[i].result);
+    }
+
+    printk("Critical path\n");
+    print_critical_path(snap, BOOT_STAGE_HEADING);
+    print_critical_path(snap, BOOT_STAGE_FIX);
+    return 0;
+}
+
+CMD_DEFINE(boot, "boot", "", "Show boot stage timings and the critical path", cmd_boot, 0, 0);
@@ -0,0 +1,48 @@
+#ifndef BOOT_H
+#define BOOT_H
+
+#include <zephyr/kernel.h>
+#include <stdint.h>
+
+/*
+ * Startup orchestration.
+ *
+ * main() brings up the IMU and compass itself and starts sampling as soon
+ * as they are ready. The slow stages run concurrently on the boot work
+ * queue: the GNSS receiver is given time to start and then configured
+ * over UBX (most of a second of waits), and the geofences are loaded from
+ * flash.
+ *
+ * Every stage records when it started and when it became ready, and posts
+ * a readiness event that other threads can wait on with boot_wait(). The
+ * "boot" command prints the stages and the critical path to the first
+ * heading and the first fix.
+ */
+
+enum boot_stage {
+    BOOT_STAGE_KERNEL,      // Drivers initialised, main() entered
+    BOOT_STAGE_IMU,
+    BOOT_STAGE_COMPASS,
+    BOOT_STAGE_FENCES,      // Geofences loaded from flash
+    BOOT_STAGE_GNSS_CONFIG, // NMEA sentences set up on the receiver
+    BOOT_STAGE_HEADING,     // First heading with attitude published
+    BOOT_STAGE_FIX,         // First GNSS fix through the quality gate
+    BOOT_STAGE_COUNT
+};
+
+// Wait for the GNSS receiver's own start-up before sending it UBX
+#define BOOT_GNSS_DELAY_MS      1000
+
+// Mark main() entered and queue the background stages
+void boot_start(void);
+
+void boot_stage_begin(enum boot_stage stage);
+
+// Record a stage as ready with its result. Only the first call counts, so
+// per-sample paths can call it every time.
+void boot_stage_done(enum boot_stage stage, int result);
+
+// Wait for a stage, returns its result or -EAGAIN on timeout
+int boot_wait(enum boot_stage stage, k_timeout_t timeout);
+
+#endif // BOOT_H
@@ -0,0 +1,54 @@
+#include "cobs.h"
+#include <errno.h>
+
+size_t cobs_encode(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    size_t code_pos = 0;    // Where the current block's length code goes
+    size_t out = 1;
+    uint8_t code = 1;
+
+    for (size_t i = 0; i < len; i++) {
+        if (src[i] != 0) {
+            dst[out++] = src[i];
+            code++;
+        }
+
+        if (src[i] == 0 || code == 0xFF) {
+            dst[code_pos] = code;
+            code_pos = out++;
+            code = 1;
+        }
+    }
+
+    dst[code_pos] = code;
+    return out;
+}
+
+int cobs_decode(uint8_t *dst, size_t size, const uint8_t *src, size_t len)
+{
+    size_t in = 0;
+    size_t out = 0;
+
+    while (in < len) {
+        uint8_t code = src[in++];
+
+        if (code == 0 || in + code - 1 > len) {
+            return -EINVAL;
+        }
+        if (out + code - 1 > size) {
+            return -ENOMEM;
+        }
+        for (uint8_t i = 1; i < code; i++) {
+            dst[out++] = src[in++];
+        }
+
+        // A full block carries no implied zero, nor does the last one
+        if (code != 0xFF && in < len) {
+            if (out == size) {
+                return -ENOMEM;
+            }
+            dst[out++] = 0;
+        }
+    }
+    return out;
+}
@@ -0,0 +1,19 @@
+#ifndef COBS_H
+#define COBS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Worst-case encoded size of len bytes, excluding the 0x00 frame delimiter
+#define COBS_MAX_ENCODED_LEN(len) ((len) + ((len) / 254) + 1)
+
+// Consistent Overhead Byte Stuffing: encode src so the output contains no
+// zero bytes, letting 0x00 delimit frames on a byte stream.
+// dst must hold COBS_MAX_ENCODED_LEN(len) bytes. Returns the encoded length.
+size_t cobs_encode(uint8_t *dst, const uint8_t *src, size_t len);
+
+// Decode one frame, src without the 0x00 delimiters. Returns the decoded
+// length, -EINVAL if src is not valid COBS or -ENOMEM if dst is too small.
+int cobs_decode(uint8_t *dst, size_t size, const uint8_t *src, size_t len);
+
+#endif // COBS_H
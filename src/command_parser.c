@@ -1,18 +1,28 @@
 #include "command_parser.h"
-#include "gps_config.h"
-#include "data_handler.h"
-#include "mpu6050_wrapper.h"
 #include <zephyr/kernel.h>
 #include <zephyr/device.h>
 #include <zephyr/drivers/uart.h>
 #include <zephyr/devicetree.h>
+#include <zephyr/sys/ring_buffer.h>
+#include <zephyr/sys/atomic.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <errno.h>
+
+#define CMD_LINE_MAX 128
 
 static bool stream_enabled = false;
 static K_MUTEX_DEFINE(stream_mutex);
 
+static const struct device *const console = DEVICE_DT_GET(DT_CHOSEN(zephyr_console));
+
+// Console RX: filled by the UART ISR, drained by the command thread
+RING_BUF_DECLARE(rx_ring, CMD_LINE_MAX);
+static K_SEM_DEFINE(rx_sem, 0, 1);
+static atomic_t rx_dropped;
+static volatile bool rx_raw;
+
 void command_parser_set_streaming(bool enable)
 {
     k_mutex_lock(&stream_mutex, K_FOREVER);
@@ -29,94 +39,362 @@ bool command_parser_is_streaming(void)
     return enabled;
 }
 
-static void process_command(char *cmd)
+void command_parser_set_raw(bool raw)
+{
+    unsigned int key = irq_lock();
+    
+    rx_raw = raw;
+    ring_buf_reset(&rx_ring);
+    atomic_clear(&rx_dropped);
+    irq_unlock(key);
+    k_sem_reset(&rx_sem);
+}
+
+int command_parser_read_raw(uint8_t *buf, size_t len, k_timeout_t timeout)
 {
-    // Trim trailing whitespace/newline
-    int len = strlen(cmd);
-    while (len > 0 && (cmd[len-1] == '\n' || cmd[len-1] == '\r' || cmd[len-1] == ' ')) {
-        cmd[len-1] = '\0';
-        len--;
+    k_timepoint_t end = sys_timepoint_calc(timeout);
+    uint32_t got;
+    
+    // The semaphore may still be given for bytes already read
+    while ((got = ring_buf_get(&rx_ring, buf, len)) == 0) {
+        if (k_sem_take(&rx_sem, sys_timepoint_timeout(end)) != 0) {
+            break;
+        }
     }
+    return got;
+}
+
+int cmd_parse_int(const char *token, int32_t *value)
+{
+    char *end;
+    long v;
     
-    if (len == 0) {
-        return;
+    // strtol() clamps out of range input and only says so in errno
+    errno = 0;
+    v = strtol(token, &end, 0);
+    if (end == token || *end != '\0' || errno == ERANGE || v < INT32_MIN || v > INT32_MAX) {
+        return -EINVAL;
+    }
+    *value = v;
+    return 0;
+}
+
+int cmd_parse_on_off(const char *token, bool *value)
+{
+    if (strcmp(token, "on") == 0) {
+        *value = true;
+    } else if (strcmp(token, "off") == 0) {
+        *value = false;
+    } else {
+        return -EINVAL;
+    }
+    return 0;
+}
+
+int cmd_parse_fixed(const char *token, int decimals, int32_t *value)
+{
+    const char *p = token;
+    bool negative = false;
+    bool digits = false;
+    int64_t v = 0;
+    int places = -1;
+    
+    if (*p == '-' || *p == '+') {
+        negative = *p++ == '-';
+    }
+    
+    for (; *p != '\0'; p++) {
+        if (*p == '.' && places < 0) {
+            places = 0;
+            continue;
+        }
+        if (*p < '0' || *p > '9' || places == decimals) {
+            return -EINVAL;
+        }
+        v = v * 10 + (*p - '0');
+        digits = true;
+        if (places >= 0) {
+            places++;
+        }
+        if (v > INT32_MAX) {
+            return -EINVAL;
+        }
     }
     
-    // Parse "gps refresh <rate>"
-    if (strncmp(cmd, "gps refresh ", 12) == 0) {
-        int rate = atoi(cmd + 12);
-        if (rate == 1 || rate == 5 || rate == 10) {
-            gps_set_refresh_rate(rate);
+    if (!digits) {
+        return -EINVAL;
+    }
+    for (places = MAX(places, 0); places < decimals; places++) {
+        v *= 10;
+        if (v > INT32_MAX) {
+            return -EINVAL;
+        }
+    }
+    *value = negative ? -v : v;
+    return 0;
+}
+
+// Command table sorted by name, built once from the linker section
+#define CMD_MAX_COMMANDS 64
+#define CMD_MAX_ARGS     8
+
+static const struct cmd_entry *cmd_index[CMD_MAX_COMMANDS];
+static int cmd_count;
+
+static void build_index(void)
+{
+    STRUCT_SECTION_FOREACH(cmd_entry, entry) {
+        if (cmd_count == CMD_MAX_COMMANDS) {
+            printk("Warning: more than %d commands, '%s' dropped\n",
+                   CMD_MAX_COMMANDS, entry->name);
+            continue;
+        }
+        
+        // Insertion sort, runs once at startup
+        int i = cmd_count++;
+        while (i > 0 && strcmp(cmd_index[i - 1]->name, entry->name) > 0) {
+            cmd_index[i] = cmd_index[i - 1];
+            i--;
+        }
+        cmd_index[i] = entry;
+    }
+}
+
+static const struct cmd_entry *find_command(const char *name)
+{
+    int lo = 0;
+    int hi = cmd_count - 1;
+    
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        int cmp = strcmp(cmd_index[mid]->name, name);
+        
+        if (cmp == 0) {
+            return cmd_index[mid];
+        } else if (cmp < 0) {
+            lo = mid + 1;
         } else {
-            printk("Error: Invalid rate '%d'. Use: gps refresh <1|5|10>\n", rate);
+            hi = mid - 1;
         }
     }
-    // Parse "gps save"
-    else if (strcmp(cmd, "gps save") == 0) {
-        gps_save_config();
+    return NULL;
+}
+
+static void print_command(const struct cmd_entry *entry)
+{
+    char synopsis[64];
+    
+    snprintk(synopsis, sizeof(synopsis), "%s%s%s", entry->name,
+             entry->args[0] ? " " : "", entry->args);
+    printk("  %-28s - %s\n", synopsis, entry->help);
+}
+
+// List all commands, or those whose name starts with 'prefix'
+static int print_help(const char *prefix)
+{
+    size_t len = prefix ? strlen(prefix) : 0;
+    int shown = 0;
+    
+    for (int i = 0; i < cmd_count; i++) {
+        const char *name = cmd_index[i]->name;
+        
+        if (len == 0 || (strncmp(name, prefix, len) == 0 &&
+                         (name[len] == '\0' || name[len] == ' '))) {
+            if (shown++ == 0) {
+                printk("\nAvailable commands:\n");
+            }
+            print_command(cmd_index[i]);
+        }
     }
-    else if (strcmp(cmd, "accel cal start") == 0) {
-        mpu6050_wrapper_calibrate_start();
-        printk("Keep device still on level surface for 5 seconds...\n");
+    
+    if (shown > 0) {
+        printk("\n");
     }
-    else if (strcmp(cmd, "accel cal stop") == 0) {
-        mpu6050_wrapper_calibrate_finish();
+    return shown;
+}
+
+static int cmd_help(int argc, char **argv)
+{
+    if (print_help(argc > 0 ? argv[0] : NULL) == 0) {
+        printk("No commands matching '%s'\n", argv[0]);
+    }
+    return 0;
+}
+
+CMD_DEFINE(help, "help", "[group]", "Show this help", cmd_help, 0, 1);
+
+static int cmd_stream(int argc, char **argv)
+{
+    bool enable;
+    
+    if (cmd_parse_on_off(argv[0], &enable) != 0) {
+        return -EINVAL;
     }
-    else if (strcmp(cmd, "accel") == 0) {
-        mpu6050_data_t data;
-        if (mpu6050_wrapper_read(&data) == 0) {
-            printk("Pitch: %.1f°, Roll: %.1f°\n", data.pitch, data.roll);
-            printk("Accel: X=%.2f Y=%.2f Z=%.2f m/s²\n",
-                   data.accel_x, data.accel_y, data.accel_z);
+    command_parser_set_streaming(enable);
+    printk("GPS streaming %s\n", enable ? "enabled" : "disabled");
+    return 0;
+}
+
+CMD_DEFINE(stream, "stream", "<on|off>", "Enable/disable GPS data streaming", cmd_stream, 1, 1);
+
+static void process_command(char *cmd)
+{
+    char *argv[CMD_MAX_ARGS];
+    int argc = 0;
+    
+    // Split into whitespace separated tokens
+    for (char *p = cmd; *p != '\0'; ) {
+        while (*p == ' ' || *p == '\t') {
+            *p++ = '\0';
+        }
+        if (*p == '\0') {
+            break;
+        }
+        if (argc == CMD_MAX_ARGS) {
+            printk("Error: Too many arguments (max %d)\n", CMD_MAX_ARGS);
+            return;
         }
-        else{
-            printk("Error reading accel values\n");
+        argv[argc++] = p;
+        while (*p != '\0' && *p != ' ' && *p != '\t') {
+            p++;
         }
     }
-    // Parse "stream on"
-    else if (strcmp(cmd, "stream on") == 0) {
-        command_parser_set_streaming(true);
-        printk("GPS streaming enabled\n");
+    
+    if (argc == 0) {
+        return;
     }
-    // Parse "stream off"
-    else if (strcmp(cmd, "stream off") == 0) {
-        command_parser_set_streaming(false);
-        printk("GPS streaming disabled\n");
+    
+    // Longest match on the leading words, e.g. "gps msg" before "gps"
+    char name[CMD_LINE_MAX];
+    const struct cmd_entry *entry = NULL;
+    int words;
+    
+    for (words = MIN(argc, CMD_MAX_WORDS); words > 0; words--) {
+        int len = 0;
+        for (int i = 0; i < words; i++) {
+            len += snprintk(name + len, sizeof(name) - len, "%s%s",
+                            i > 0 ? " " : "", argv[i]);
+        }
+        entry = find_command(name);
+        if (entry) {
+            break;
+        }
     }
-    // Parse "help"
-    else if (strcmp(cmd, "help") == 0) {
-        printk("\nAvailable commands:\n");
-        printk("  gps refresh <1|5|10>  - Set GPS update rate (Hz)\n");
-        printk("  gps save              - Save GPS config to flash\n");
-        printk("  stream on             - Enable GPS data streaming\n");
-        printk("  stream off            - Disable GPS data streaming\n");
-        printk("  help                  - Show this help\n\n");
+    
+    if (entry == NULL) {
+        if (print_help(argv[0]) == 0) {
+            printk("Unknown command: '%s'\n", argv[0]);
+            printk("Type 'help' for available commands\n");
+        }
+        return;
     }
-    // Unknown command
-    else {
-        printk("Unknown command: '%s'\n", cmd);
-        printk("Type 'help' for available commands\n");
+    
+    argc -= words;
+    if (argc < entry->min_args || argc > entry->max_args) {
+        printk("Usage: %s %s\n", entry->name, entry->args);
+        return;
+    }
+    
+    int ret = entry->handler(argc, argv + words);
+    if (ret == -EINVAL) {
+        printk("Usage: %s %s\n", entry->name, entry->args);
+    } else if (ret < 0) {
+        printk("Error: %s failed (%d)\n", entry->name, ret);
+    }
+}
+
+/*
+ * Console RX interrupt. Queues bytes and echoes typed characters right away,
+ * but only wakes the command thread when it has something to act on: a line
+ * end, any other control character, or a ring buffer close to full. In raw
+ * mode nothing is echoed and every byte wakes the reader.
+ */
+static void console_rx_isr(const struct device *dev, void *user_data)
+{
+    static int echo_len;
+    uint8_t buf[16];
+    bool wake = false;
+    
+    ARG_UNUSED(user_data);
+    
+    while (uart_irq_update(dev) && uart_irq_rx_ready(dev)) {
+        int len = uart_fifo_read(dev, buf, sizeof(buf));
+        if (len <= 0) {
+            break;
+        }
+        
+        for (int i = 0; i < len; i++) {
+            uint8_t c = buf[i];
+            
+            if (ring_buf_put(&rx_ring, &c, 1) != 1) {
+                atomic_inc(&rx_dropped);
+                wake = true;
+                continue;
+            }
+            
+            // Binary protocol running, the reader wants every byte
+            if (rx_raw) {
+                wake = true;
+                continue;
+            }
+            
+            if (c >= 32 && c <= 126) {
+                if (echo_len < CMD_LINE_MAX - 1) {
+                    echo_len++;
+                    uart_poll_out(dev, c);
+                }
+            } else {
+                // Line end, backspace or other control character
+                if (c == '\b' || c == 127) {
+                    if (echo_len > 0) {
+                        echo_len--;
+                        uart_poll_out(dev, '\b');
+                        uart_poll_out(dev, ' ');
+                        uart_poll_out(dev, '\b');
+                    }
+                } else {
+                    echo_len = 0;
+                }
+                wake = true;
+            }
+        }
+    }
+    
+    if (wake || ring_buf_space_get(&rx_ring) < CMD_LINE_MAX / 4) {
+        k_sem_give(&rx_sem);
     }
 }
 
 static void command_thread(void)
 {
-    char line[128];
+    char line[CMD_LINE_MAX];
     int idx = 0;
     uint8_t c;
     
-    const struct device *console = DEVICE_DT_GET(DT_CHOSEN(zephyr_console));
-    
     if (!device_is_ready(console)) {
         printk("ERROR: Console device not ready!\n");
         return;
     }
     
+    build_index();
     k_sleep(K_MSEC(500));
+    
+    int ret = uart_irq_callback_user_data_set(console, console_rx_isr, NULL);
+    if (ret < 0) {
+        printk("ERROR: Console RX interrupt not available (%d)\n", ret);
+        return;
+    }
+    uart_irq_rx_enable(console);
+    
     printk("> ");
     
     while (1) {
-        if (uart_poll_in(console, &c) == 0) {
+        atomic_val_t dropped;
+        
+        k_sem_take(&rx_sem, K_FOREVER);
+        
+        // Characters were already echoed by the ISR
+        while (ring_buf_get(&rx_ring, &c, 1) == 1) {
             if (c == '\n' || c == '\r') {
                 printk("\n");
                 line[idx] = '\0';
@@ -131,15 +409,17 @@ static void command_thread(void)
             else if (c == '\b' || c == 127) {
                 if (idx > 0) {
                     idx--;
-                    printk("\b \b");
                 }
             }
             else if (idx < sizeof(line) - 1 && c >= 32 && c <= 126) {
                 line[idx++] = c;
-                printk("%c", c);
             }
-        } else {
-            k_msleep(10);
+        }
+        
+        // Read and clear in one step, the ISR may count more meanwhile
+        dropped = atomic_set(&rx_dropped, 0);
+        if (dropped > 0) {
+            printk("\nWarning: %u console bytes dropped\n> ", (uint32_t)dropped);
         }
     }
 }
@@ -1,7 +1,48 @@
 #ifndef COMMAND_PARSER_H
 #define COMMAND_PARSER_H
 
+#include <zephyr/kernel.h>
+#include <zephyr/sys/iterable_sections.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Command handler. argv holds the arguments after the command words.
+// Return -EINVAL to have the usage line printed.
+typedef int (*cmd_handler_t)(int argc, char **argv);
+
+struct cmd_entry {
+    const char *name;       // Command words, e.g. "gps refresh"
+    const char *args;       // Argument synopsis for help, e.g. "<1|5|10>"
+    const char *help;       // One-line description
+    cmd_handler_t handler;
+    uint8_t min_args;
+    uint8_t max_args;
+};
+
+// Maximum number of words in a command name
+#define CMD_MAX_WORDS 3
+
+// Register a console command at link time. _id must be unique.
+// Example:
+//   CMD_DEFINE(gps_save, "gps save", "", "Save GPS config to flash", cmd_gps_save, 0, 0);
+#define CMD_DEFINE(_id, _name, _args, _help, _handler, _min_args, _max_args) \
+    static const STRUCT_SECTION_ITERABLE(cmd_entry, cmd_entry_##_id) = {     \
+        .name = _name,                                                       \
+        .args = _args,                                                       \
+        .help = _help,                                                       \
+        .handler = _handler,                                                 \
+        .min_args = _min_args,                                               \
+        .max_args = _max_args,                                               \
+    }
+
+// Argument helpers. Return 0 on success, -EINVAL if the token is malformed.
+int cmd_parse_int(const char *token, int32_t *value);
+int cmd_parse_on_off(const char *token, bool *value);
+
+// Decimal number to fixed point with 'decimals' places, e.g. "-12.5" with
+// 3 decimals gives -12500. More decimals than that are rejected.
+int cmd_parse_fixed(const char *token, int decimals, int32_t *value);
 
 // Initialize command parser (starts thread)
 void command_parser_init(void);
@@ -12,4 +53,13 @@ void command_parser_set_streaming(bool enable);
 // Check if streaming is enabled
 bool command_parser_is_streaming(void);
 
-#endif // COMMAND_PARSER_H
\ No newline at end of file
+// Raw console input for binary protocols run from a command handler. While
+// raw, received bytes are queued without echo and not parsed as commands.
+// Leaving raw mode discards anything still queued.
+void command_parser_set_raw(bool raw);
+
+// Read up to len raw bytes, waiting up to timeout for the first one.
+// Returns the number of bytes read, 0 on timeout.
+int command_parser_read_raw(uint8_t *buf, size_t len, k_timeout_t timeout);
+
+#endif // COMMAND_PARSER_H
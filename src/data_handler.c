@@ -1,115 +1,121 @@
 #include "data_handler.h"
+#include "stats.h"
+#include <stddef.h>
 #include <string.h>
 #include <zephyr/logging/log.h>
 
 LOG_MODULE_REGISTER(gps_data, LOG_LEVEL_DBG);
 
-// Message queue for SD card logging
-K_MSGQ_DEFINE(sensor_data_msgq, sizeof(struct sensor_data), 10, 4);
+// How long a publish may wait for a reader holding the channel or for a
+// subscriber's queue. Zero-initialised messages read as not valid.
+#define PUB_TIMEOUT             K_MSEC(1)
 
-// Current GPS state
-// static struct gps_data gps_data = {0};
-// static struct acc_data acc_data = {0};
-// static struct compass_data compass_data = {0};
-static struct sensor_data sensor_data = {0};
+ZBUS_CHAN_DEFINE(gps_chan, struct gps_data, NULL, NULL, ZBUS_OBSERVERS_EMPTY, ZBUS_MSG_INIT(0));
+ZBUS_CHAN_DEFINE(compass_chan, struct compass_data, NULL, NULL, ZBUS_OBSERVERS_EMPTY,
+                 ZBUS_MSG_INIT(0));
+ZBUS_CHAN_DEFINE(acc_chan, struct acc_data, NULL, NULL, ZBUS_OBSERVERS_EMPTY, ZBUS_MSG_INIT(0));
 
 
-static K_MUTEX_DEFINE(gps_data_mutex);
-static K_MUTEX_DEFINE(acc_data_mutex);
-static K_MUTEX_DEFINE(compass_data_mutex);
-
+static void publish(const struct zbus_channel *chan, const void *msg)
+{
+    uint32_t start = stats_timer_start();
+
+    // Claim, copy and notify separately from zbus_chan_pub() so that a
+    // lost sample and a missed notification are told apart
+    if (zbus_chan_claim(chan, PUB_TIMEOUT) != 0) {
+        // A reader held the channel, the sample is lost
+        stats_inc(STATS_C_PUB_LOST);
+        stats_timer_stop(STATS_T_DATA_SET, start);
+        return;
+    }
+    memcpy(zbus_chan_msg(chan), msg, zbus_chan_msg_size(chan));
+    zbus_chan_finish(chan);
 
-void add_to_msgq(){
-    if (sensor_data.gps_data.new && sensor_data.compass_data.new && sensor_data.acc_data.new){
-        if (k_msgq_put(&sensor_data_msgq, &sensor_data, K_NO_WAIT) != 0) {
-            LOG_WRN("SD card queue full");
-        }
-        else{
-            sensor_data.gps_data.new = false;
-            sensor_data.compass_data.new = false;
-            sensor_data.acc_data.new = false;
-        }
+    if (zbus_chan_notify(chan, PUB_TIMEOUT) != 0) {
+        // A subscriber's queue was full, the sample is still on the channel
+        stats_inc(STATS_C_PUB_DROP);
     }
+    stats_timer_stop(STATS_T_DATA_SET, start);
 }
 
 
-void set_gps_data(struct gps_data source)
+static bool read_chan(const struct zbus_channel *chan, void *msg, bool *valid)
 {
-    // Update displayed data
-    k_mutex_lock(&gps_data_mutex, K_FOREVER);
-    sensor_data.gps_data = source;
-    k_mutex_unlock(&gps_data_mutex);
-    add_to_msgq();
+    uint32_t start = stats_timer_start();
 
+    zbus_chan_read(chan, msg, K_FOREVER);
+    stats_timer_stop(STATS_T_DATA_GET, start);
+    return *valid;
+}
+
+
+void set_gps_data(struct gps_data source)
+{
+    publish(&gps_chan, &source);
 }
 
 
 bool get_gps_data(struct gps_data *dest){
-    k_mutex_lock(&gps_data_mutex, K_FOREVER);
-    if (sensor_data.gps_data.valid) {
-        memcpy(dest, &sensor_data.gps_data, sizeof(struct gps_data));
-        k_mutex_unlock(&gps_data_mutex);
-        return true;
-    }
-    k_mutex_unlock(&gps_data_mutex);
-    return false;
+    return read_chan(&gps_chan, dest, &dest->valid);
 }
 
 
 void set_acc_data(struct acc_data source)
 {
-    // Update displayed data
-    k_mutex_lock(&acc_data_mutex, K_FOREVER);
-    sensor_data.acc_data = source;
-    k_mutex_unlock(&acc_data_mutex);
-    add_to_msgq();
-
+    publish(&acc_chan, &source);
 }
 
 
 bool get_acc_data(struct acc_data *dest){
-    k_mutex_lock(&acc_data_mutex, K_FOREVER);
-    if (sensor_data.acc_data.valid) {
-        memcpy(dest, &sensor_data.acc_data, sizeof(struct acc_data));
-        k_mutex_unlock(&acc_data_mutex);
-        return true;
-    }
-    k_mutex_unlock(&acc_data_mutex);
-    return false;
+    return read_chan(&acc_chan, dest, &dest->valid);
 }
 
 
 void set_compass_data(struct compass_data source)
 {
-    // Update displayed data
-    k_mutex_lock(&compass_data_mutex, K_FOREVER);
-    sensor_data.compass_data = source;
-    k_mutex_unlock(&compass_data_mutex);
-    add_to_msgq();
+    publish(&compass_chan, &source);
 }
 
 
 bool get_compass_data(struct compass_data *dest){
-    k_mutex_lock(&compass_data_mutex, K_FOREVER);
-    if (sensor_data.compass_data.valid) {
-        memcpy(dest, &sensor_data.compass_data, sizeof(struct compass_data));
-        k_mutex_unlock(&compass_data_mutex);
-        return true;
+    return read_chan(&compass_chan, dest, &dest->valid);
+}
+
+
+void get_sensors_data(struct sensor_data *dest){
+    get_gps_data(&dest->gps_data);
+    get_compass_data(&dest->compass_data);
+    get_acc_data(&dest->acc_data);
+    dest->new = false;
+}
+
+
+// Clear the sample's valid flag in place, then notify as for a publish
+static void invalidate(const struct zbus_channel *chan, size_t valid_offset)
+{
+    if (zbus_chan_claim(chan, PUB_TIMEOUT) != 0) {
+        stats_inc(STATS_C_PUB_LOST);
+        return;
+    }
+    *((bool *)((uint8_t *)zbus_chan_msg(chan) + valid_offset)) = false;
+    zbus_chan_finish(chan);
+
+    if (zbus_chan_notify(chan, PUB_TIMEOUT) != 0) {
+        stats_inc(STATS_C_PUB_DROP);
     }
-    k_mutex_unlock(&compass_data_mutex);
-    return false;
 }
 
 
-void invalidate_sensor_data(){
-    sensor_data.acc_data.valid = false;
-    sensor_data.acc_data.new = false;
+void invalidate_gps_data(void){
+    invalidate(&gps_chan, offsetof(struct gps_data, valid));
+}
+
 
-    sensor_data.compass_data.valid = false;
-    sensor_data.compass_data.new = false;
+void invalidate_acc_data(void){
+    invalidate(&acc_chan, offsetof(struct acc_data, valid));
+}
 
-    sensor_data.gps_data.valid = false;
-    sensor_data.gps_data.new = false;
 
-    sensor_data.new = false;
-}
\ No newline at end of file
+void invalidate_compass_data(void){
+    invalidate(&compass_chan, offsetof(struct compass_data, valid));
+}
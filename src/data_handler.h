@@ -2,30 +2,56 @@
 #define DATA_HANDLER_H
 
 #include <zephyr/kernel.h>
+#include <zephyr/zbus/zbus.h>
 #include <stdbool.h>
 #include <stdint.h>
 
+/*
+ * Latest sensor samples, one zbus channel per sensor with the struct below
+ * as its message. A set_*_data() call publishes the sample once; consumers
+ * either add a listener, called in the publisher's thread with the message
+ * in place, or a subscriber with its own queue depth that reads the
+ * channel when it gets to it:
+ *
+ *   ZBUS_CHAN_ADD_OBS(gps_chan, nav_gps_lis, 1);
+ *
+ * A full subscriber queue loses that subscriber's notification and counts
+ * as pub_drop in "stats", the other observers are not held up. A channel
+ * still locked by a reader after PUB_TIMEOUT loses the sample itself,
+ * counted as pub_lost. The getters
+ * read a channel for consumers that poll (display, console commands).
+ *
+ * The invalidate_*() calls clear 'valid' on a channel's current sample and
+ * notify the observers, for the supervisor when a source stops delivering.
+ *
+ * Listeners run with the channel locked, so they use zbus_chan_const_msg()
+ * and must not call the getter for the same channel.
+ */
+
 struct gps_data{
-    uint32_t sog;
-    uint32_t cog;
+    uint32_t sog;           // mm/s
+    uint32_t cog;           // millidegrees
     uint8_t hour;
     uint8_t minute;
     uint16_t millisecond;
-    uint32_t latitude;
-    uint32_t longitude;
+    uint8_t day;            // UTC date, 0 if unknown
+    uint8_t month;
+    uint8_t year;           // Year within the century
+    int32_t latitude;       // 1e-7 degrees
+    int32_t longitude;      // 1e-7 degrees
     bool new;
     bool valid;
 };
 
 struct compass_data{
-    uint32_t heading;
+    uint32_t heading;       // millidegrees, 0-359999
     bool new;
     bool valid;
 };
 
 struct acc_data{
-    uint32_t roll;
-    uint32_t pitch;
+    int32_t roll;           // millidegrees
+    int32_t pitch;          // millidegrees
     bool new;
     bool valid;
 };
@@ -37,7 +63,7 @@ struct sensor_data{
     bool new;
 };
 
-extern struct k_msgq sensor_data_msgq;
+ZBUS_CHAN_DECLARE(gps_chan, compass_chan, acc_chan);
 
 bool get_gps_data(struct gps_data *dest);
 void set_gps_data(struct gps_data source);
@@ -49,6 +75,9 @@ bool get_compass_data(struct compass_data *dest);
 void set_compass_data(struct compass_data source);
 
 void get_sensors_data(struct sensor_data *dest);
-void invalidate_sensor_data();
+
+void invalidate_gps_data(void);
+void invalidate_acc_data(void);
+void invalidate_compass_data(void);
 
 #endif // DATA_HANDLER_H
\ No newline at end of file
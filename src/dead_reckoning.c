@@ -0,0 +1,347 @@
+#include "dead_reckoning.h"
+#include "command_parser.h"
+#include "geo.h"
+#include "stats.h"
+#include "telemetry.h"
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <math.h>
+
+LOG_MODULE_REGISTER(dead_reckoning, LOG_LEVEL_INF);
+
+#define DR_STACK_SIZE           1536
+#define DR_PRIORITY             6
+
+#define IMU_QUEUE_LEN           8
+
+#define DEG_TO_RAD              (3.14159265359f / 180.0f)
+#define RAD_TO_DEG              (180.0f / 3.14159265359f)
+
+// m per 1e-7 degree of latitude
+#define M_PER_E7                (GEO_CM_PER_E7_DEG_X1E5 / 1e7f)
+
+// Gyro weight of the pitch/roll filter, ~1 s time constant at 50 Hz
+#define ATTITUDE_GYRO_WEIGHT    0.98f
+// IMU gaps longer than this restart the filter instead of integrating
+#define MAX_IMU_GAP_S           0.2f
+
+// Share of the velocity error per second taken into the bias at each fix
+#define BIAS_GAIN               0.3f
+#define MAX_BIAS                0.5f    // m/s^2
+// Anything larger is a bad sample, not a boat
+#define MAX_ACCEL               5.0f    // m/s^2
+
+// Uncertainty model: fix error, then velocity and acceleration errors
+// carried forward from it
+#define SIGMA_FIX_M             2.5f
+#define SIGMA_VEL               0.1f    // m/s
+#define SIGMA_ACC               0.2f    // m/s^2
+
+struct imu_sample {
+    uint32_t time;          // ms
+    float accel[3];         // m/s^2, body axes
+    float gyro_x;           // rad/s
+    float gyro_y;
+    float pitch;            // degrees, from the accelerometer alone
+    float roll;
+    float heading;          // degrees true
+    bool heading_valid;
+};
+
+K_MSGQ_DEFINE(dr_imu_msgq, sizeof(struct imu_sample), IMU_QUEUE_LEN, 4);
+
+// Filter state, DR thread only
+static struct {
+    bool has_fix;
+    bool has_attitude;
+    int32_t ref_lat;        // Last fix, origin of the east/north offsets
+    int32_t ref_lon;
+    int32_t cos_lat_q15;
+    float cos_lat;
+    float pe;               // m east of the last fix
+    float pn;               // m north
+    float ve;               // m/s
+    float vn;
+    float bias_e;           // m/s^2, subtracted from the levelled acceleration
+    float bias_n;
+    uint32_t time;          // ms, time the position refers to
+    uint32_t fix_time;
+    uint32_t imu_time;
+    float pitch;            // degrees
+    float roll;
+    float last_correction;  // m, position error found at the last fix
+} filter;
+
+// Handed over from the GNSS callback
+static struct gps_data pending_fix;
+static uint32_t pending_time;
+static bool fix_pending;
+
+static struct dr_state state;
+static uint32_t imu_dropped;
+static uint32_t fixes;
+
+static K_MUTEX_DEFINE(dr_mutex);
+
+void dr_push_imu(const mpu6050_data_t *imu, float heading_deg, bool heading_valid)
+{
+    struct imu_sample s = {
+        .time = k_uptime_get_32(),
+        .accel = { imu->accel_x, imu->accel_y, imu->accel_z },
+        .gyro_x = imu->gyro_x,
+        .gyro_y = imu->gyro_y,
+        .pitch = imu->pitch,
+        .roll = imu->roll,
+        .heading = heading_deg,
+        .heading_valid = heading_valid,
+    };
+
+    if (k_msgq_put(&dr_imu_msgq, &s, K_NO_WAIT) != 0) {
+        imu_dropped++;
+    }
+}
+
+void dr_gnss_fix(const struct gps_data *gps)
+{
+    if (!gps->valid) {
+        return;
+    }
+
+    k_mutex_lock(&dr_mutex, K_FOREVER);
+    pending_fix = *gps;
+    pending_time = k_uptime_get_32();
+    fix_pending = true;
+    k_mutex_unlock(&dr_mutex);
+}
+
+static void dr_gps_cb(const struct zbus_channel *chan)
+{
+    dr_gnss_fix(zbus_chan_const_msg(chan));
+}
+
+ZBUS_LISTENER_DEFINE(dr_gps_lis, dr_gps_cb);
+ZBUS_CHAN_ADD_OBS(gps_chan, dr_gps_lis, 3);
+
+void dr_get_state(struct dr_state *dest)
+{
+    k_mutex_lock(&dr_mutex, K_FOREVER);
+    *dest = state;
+    k_mutex_unlock(&dr_mutex);
+}
+
+// Advance position and velocity to 'time' at constant velocity
+static void coast(uint32_t time)
+{
+    float dt = (int32_t)(time - filter.time) / 1000.0f;
+
+    if (dt > 0) {
+        filter.pe += filter.ve * dt;
+        filter.pn += filter.vn * dt;
+        filter.time = time;
+    }
+}
+
+// Called with dr_mutex held
+static void integrate(const struct imu_sample *s)
+{
+    float dt = (int32_t)(s->time - filter.imu_time) / 1000.0f;
+    float sp, cp, sr, cr, sh, ch;
+    float fx, fy, ae, an;
+
+    filter.imu_time = s->time;
+    if (!filter.has_attitude || dt <= 0 || dt > MAX_IMU_GAP_S) {
+        filter.pitch = s->pitch;
+        filter.roll = s->roll;
+        filter.has_attitude = true;
+        return;
+    }
+
+    // Gyro for the short term, the accelerometer's gravity vector for the
+    // long term
+    filter.pitch = ATTITUDE_GYRO_WEIGHT * (filter.pitch + s->gyro_y * RAD_TO_DEG * dt) +
+                   (1.0f - ATTITUDE_GYRO_WEIGHT) * s->pitch;
+    filter.roll = ATTITUDE_GYRO_WEIGHT * (filter.roll + s->gyro_x * RAD_TO_DEG * dt) +
+                  (1.0f - ATTITUDE_GYRO_WEIGHT) * s->roll;
+
+    if (!filter.has_fix || !s->heading_valid ||
+        (int32_t)(s->time - filter.time) <= 0) {
+        return;
+    }
+
+    // Level the specific force, whatever is left horizontally is the
+    // boat's acceleration
+    sp = sinf(filter.pitch * DEG_TO_RAD);
+    cp = cosf(filter.pitch * DEG_TO_RAD);
+    sr = sinf(filter.roll * DEG_TO_RAD);
+    cr = cosf(filter.roll * DEG_TO_RAD);
+    fx = s->accel[0] * cp + (s->accel[1] * sr + s->accel[2] * cr) * sp;
+    fy = s->accel[1] * cr - s->accel[2] * sr;
+
+    // Forward and left to east and north
+    sh = sinf(s->heading * DEG_TO_RAD);
+    ch = cosf(s->heading * DEG_TO_RAD);
+    ae = fx * sh - fy * ch - filter.bias_e;
+    an = fx * ch + fy * sh - filter.bias_n;
+    if (fabsf(ae) > MAX_ACCEL || fabsf(an) > MAX_ACCEL) {
+        ae = 0;
+        an = 0;
+    }
+
+    dt = (int32_t)(s->time - filter.time) / 1000.0f;
+    filter.pe += filter.ve * dt + 0.5f * ae * dt * dt;
+    filter.pn += filter.vn * dt + 0.5f * an * dt * dt;
+    filter.ve += ae * dt;
+    filter.vn += an * dt;
+    filter.time = s->time;
+}
+
+static float clampf(float value, float limit)
+{
+    return value > limit ? limit : value < -limit ? -limit : value;
+}
+
+static void correct(const struct gps_data *gps, uint32_t time)
+{
+    float cog = gps->cog / 1000.0f * DEG_TO_RAD;
+    float ve = gps->sog / 1000.0f * sinf(cog);
+    float vn = gps->sog / 1000.0f * cosf(cog);
+
+    if (filter.has_fix) {
+        struct geo_vec fix = geo_offset_cm(filter.ref_lat, filter.ref_lon, filter.cos_lat_q15,
+                                           gps->latitude, gps->longitude);
+        float since = (int32_t)(time - filter.fix_time) / 1000.0f;
+
+        coast(time);
+        filter.last_correction = hypotf(fix.x / 100.0f - filter.pe, fix.y / 100.0f - filter.pn);
+
+        // A velocity that ran ahead of the GNSS one means the acceleration
+        // read high
+        if (since > 0) {
+            filter.bias_e = clampf(filter.bias_e + BIAS_GAIN * (filter.ve - ve) / since,
+                                   MAX_BIAS);
+            filter.bias_n = clampf(filter.bias_n + BIAS_GAIN * (filter.vn - vn) / since,
+                                   MAX_BIAS);
+        }
+    }
+
+    filter.has_fix = true;
+    filter.ref_lat = gps->latitude;
+    filter.ref_lon = gps->longitude;
+    filter.cos_lat_q15 = geo_cos_lat_q15(gps->latitude);
+    filter.cos_lat = filter.cos_lat_q15 / 32768.0f;
+    filter.pe = 0;
+    filter.pn = 0;
+    filter.ve = ve;
+    filter.vn = vn;
+    filter.time = time;
+    filter.fix_time = time;
+    fixes++;
+}
+
+// Called with dr_mutex held
+static void publish(uint32_t now)
+{
+    float dt = (int32_t)(now - filter.time) / 1000.0f;
+    float pe = filter.pe + filter.ve * MAX(dt, 0.0f);
+    float pn = filter.pn + filter.vn * MAX(dt, 0.0f);
+    float age, drift;
+    int64_t lon;
+
+    state.age = now - filter.fix_time;
+    state.valid = filter.has_fix && state.age < DR_MAX_COAST_MS;
+    if (!state.valid) {
+        return;
+    }
+
+    state.latitude = filter.ref_lat + (int32_t)lroundf(pn / M_PER_E7);
+    lon = filter.ref_lon;
+    if (filter.cos_lat > 0.001f) {
+        lon += lroundf(pe / (M_PER_E7 * filter.cos_lat));
+    }
+    if (lon > 1800000000LL) {
+        lon -= 3600000000LL;
+    } else if (lon < -1800000000LL) {
+        lon += 3600000000LL;
+    }
+    state.longitude = lon;
+    state.ve = lroundf(filter.ve * 1000.0f);
+    state.vn = lroundf(filter.vn * 1000.0f);
+
+    age = state.age / 1000.0f;
+    drift = 0.5f * SIGMA_ACC * age * age;
+    state.sigma = lroundf(sqrtf(SIGMA_FIX_M * SIGMA_FIX_M + (SIGMA_VEL * age) * (SIGMA_VEL * age) +
+                                drift * drift) * 100.0f);
+}
+
+static void dr_thread(void)
+{
+    int64_t next = k_uptime_get();
+    struct imu_sample s;
+
+    while (1) {
+        uint32_t start;
+
+        next += DR_PERIOD_MS;
+        k_sleep(K_TIMEOUT_ABS_MS(next));
+        start = stats_timer_start();
+
+        // The filter state, attitude included, only changes under the
+        // lock so that "dr" reads it consistently
+        k_mutex_lock(&dr_mutex, K_FOREVER);
+        while (k_msgq_get(&dr_imu_msgq, &s, K_NO_WAIT) == 0) {
+            integrate(&s);
+        }
+
+        if (fix_pending) {
+            fix_pending = false;
+            correct(&pending_fix, pending_time);
+        }
+        publish(k_uptime_get_32());
+        k_mutex_unlock(&dr_mutex);
+
+        stats_timer_stop(STATS_T_DR_STEP, start);
+        telemetry_tick(TELEMETRY_SRC_DR);
+    }
+}
+
+// Console commands
+static void print_coord(int32_t e7)
+{
+    uint32_t abs = e7 < 0 ? -(int64_t)e7 : e7;
+
+    printk("%s%u.%07u", e7 < 0 ? "-" : "", abs / 10000000, abs % 10000000);
+}
+
+static int cmd_dr(int argc, char **argv)
+{
+    struct dr_state st;
+    float correction, bias_e, bias_n, pitch, roll;
+
+    k_mutex_lock(&dr_mutex, K_FOREVER);
+    st = state;
+    correction = filter.last_correction;
+    bias_e = filter.bias_e;
+    bias_n = filter.bias_n;
+    pitch = filter.pitch;
+    roll = filter.roll;
+    k_mutex_unlock(&dr_mutex);
+
+    if (!st.valid) {
+        printk("No fix in the last %u s\n", DR_MAX_COAST_MS / 1000);
+    } else {
+        print_coord(st.latitude);
+        printk(" ");
+        print_coord(st.longitude);
+        printk(" +/- %u.%02u m, %u ms since fix\n", st.sigma / 100, st.sigma % 100, st.age);
+        printk("Velocity E %.2f N %.2f m/s\n", st.ve / 1000.0, st.vn / 1000.0);
+    }
+    printk("Last correction %.2f m, bias E %.3f N %.3f m/s2, pitch %.1f roll %.1f deg\n",
+           (double)correction, (double)bias_e, (double)bias_n, (double)pitch, (double)roll);
+    printk("%u fixes, %u IMU samples dropped\n", fixes, imu_dropped);
+    return 0;
+}
+
+CMD_DEFINE(dr, "dr", "", "Show the dead-reckoned position", cmd_dr, 0, 0);
+
+K_THREAD_DEFINE(dr_thread_id, DR_STACK_SIZE, dr_thread, NULL, NULL, NULL,
+                DR_PRIORITY, 0, 0);
@@ -0,0 +1,48 @@
+#ifndef DEAD_RECKONING_H
+#define DEAD_RECKONING_H
+
+#include "data_handler.h"
+#include "mpu6050_wrapper.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Dead reckoning between GNSS fixes.
+ *
+ * A thread running every DR_PERIOD_MS propagates position and velocity
+ * from the IMU samples queued by the sensor loop: the accelerometer is
+ * levelled with a gyro/accelerometer complementary filter for pitch and
+ * roll, turned to east/north with the compass heading, and integrated.
+ * Each fix resets the position to the fix, the velocity to the GNSS
+ * velocity, and nudges an east/north acceleration bias by the velocity
+ * error, which soaks up levelling and calibration errors.
+ *
+ * The result is published every period with a 1-sigma uncertainty that
+ * grows with the time since the fix, so consumers can run at the IMU rate
+ * instead of the receiver's. The board is assumed mounted x forward, z up.
+ */
+
+#define DR_PERIOD_MS            20
+// Stop publishing a valid position this long after the last fix
+#define DR_MAX_COAST_MS         10000
+
+struct dr_state {
+    bool valid;
+    int32_t latitude;       // 1e-7 degrees
+    int32_t longitude;
+    int32_t ve;             // mm/s east
+    int32_t vn;             // mm/s north
+    uint32_t sigma;         // cm, 1-sigma horizontal position uncertainty
+    uint32_t age;           // ms since the last fix
+};
+
+// Queue an IMU sample with the compass heading. Called from the sensor loop.
+void dr_push_imu(const mpu6050_data_t *imu, float heading_deg, bool heading_valid);
+
+// Correct on a fix. Called by a listener on gps_chan for each published fix.
+void dr_gnss_fix(const struct gps_data *gps);
+
+// Latest published state
+void dr_get_state(struct dr_state *state);
+
+#endif // DEAD_RECKONING_H
@@ -0,0 +1,342 @@
+#include "display.h"
+#include "data_handler.h"
+#include "ht1621.h"
+#include "command_parser.h"
+#include "nav.h"
+#include "stats.h"
+#include "supervisor.h"
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+
+LOG_MODULE_REGISTER(display, LOG_LEVEL_DBG);
+
+// Minimum time between two LCD frames
+#define DISPLAY_FRAME_MS        200
+
+// Default page rotation period, and the longest "display rotate" takes
+#define DISPLAY_ROTATE_MS       5000
+#define DISPLAY_ROTATE_MAX_S    3600
+
+// mm/s to thousandths of a knot: x * 3600 / 1852
+#define MM_S_TO_MILLIKNOTS(x)   ((uint32_t)(((uint64_t)(x) * 1800 + 463) / 926))
+
+// cm to thousandths of a nautical mile: x / 185.2
+#define CM_TO_MILLI_NM(x)       ((uint32_t)(((uint64_t)(x) * 5 + 463) / 926))
+
+struct page_desc {
+    const char *name;
+    // Read the page value from data_handler, false if the source is not valid
+    bool (*read)(int32_t *value);
+    uint8_t scale;          // value is in units of 10^-scale
+    uint8_t decimals;       // decimals to show
+    uint8_t min_digits;     // zero-pad to this many digits
+};
+
+static atomic_t current_page = ATOMIC_INIT(DISPLAY_PAGE_HEADING);
+static atomic_t enabled_pages = ATOMIC_INIT(BIT(DISPLAY_PAGE_COUNT) - 1);
+static atomic_t rotate_ms = ATOMIC_INIT(DISPLAY_ROTATE_MS);
+static atomic_t bench_requested;
+static uint32_t last_render_cycles;
+
+// Given by the setters so page changes show without waiting a full frame
+static K_SEM_DEFINE(display_wake, 0, 1);
+
+static bool read_heading(int32_t *value)
+{
+    struct compass_data data;
+
+    if (!get_compass_data(&data)) {
+        return false;
+    }
+    // Show 359.95 and up as 0.0 rather than rounding to 360.0
+    *value = data.heading >= 359950 ? 0 : data.heading;
+    return true;
+}
+
+static bool read_sog(int32_t *value)
+{
+    struct gps_data data;
+
+    if (!get_gps_data(&data)) {
+        return false;
+    }
+    *value = MM_S_TO_MILLIKNOTS(data.sog);
+    return true;
+}
+
+static bool read_pitch(int32_t *value)
+{
+    struct acc_data data;
+
+    if (!get_acc_data(&data)) {
+        return false;
+    }
+    *value = data.pitch;
+    return true;
+}
+
+static bool read_roll(int32_t *value)
+{
+    struct acc_data data;
+
+    if (!get_acc_data(&data)) {
+        return false;
+    }
+    *value = data.roll;
+    return true;
+}
+
+static bool read_fix(int32_t *value)
+{
+    struct gps_data data;
+
+    if (!get_gps_data(&data)) {
+        return false;
+    }
+    *value = data.hour * 10000 + data.minute * 100 + data.millisecond / 1000;
+    return true;
+}
+
+static bool read_dtw(int32_t *value)
+{
+    struct nav_status nav;
+
+    nav_get_status(&nav);
+    if (!nav.valid) {
+        return false;
+    }
+    *value = CM_TO_MILLI_NM(nav.distance);
+    return true;
+}
+
+static bool read_btw(int32_t *value)
+{
+    struct nav_status nav;
+
+    nav_get_status(&nav);
+    if (!nav.valid) {
+        return false;
+    }
+    *value = nav.bearing >= 359950 ? 0 : nav.bearing;
+    return true;
+}
+
+static const struct page_desc pages[DISPLAY_PAGE_COUNT] = {
+    [DISPLAY_PAGE_HEADING] = { "hdg",   read_heading, 3, 1, 0 },
+    [DISPLAY_PAGE_SOG]     = { "sog",   read_sog,     3, 1, 0 },
+    [DISPLAY_PAGE_PITCH]   = { "pitch", read_pitch,   3, 1, 0 },
+    [DISPLAY_PAGE_ROLL]    = { "roll",  read_roll,    3, 1, 0 },
+    [DISPLAY_PAGE_FIX]     = { "fix",   read_fix,     0, 0, 6 },
+    [DISPLAY_PAGE_DTW]     = { "dtw",   read_dtw,     3, 2, 0 },
+    [DISPLAY_PAGE_BTW]     = { "btw",   read_btw,     3, 1, 0 },
+};
+
+int display_page_from_name(const char *name)
+{
+    for (int i = 0; i < DISPLAY_PAGE_COUNT; i++) {
+        if (strcmp(name, pages[i].name) == 0) {
+            return i;
+        }
+    }
+    return -EINVAL;
+}
+
+int display_set_page(enum display_page page)
+{
+    if (page >= DISPLAY_PAGE_COUNT) {
+        return -EINVAL;
+    }
+    atomic_set(&current_page, page);
+    k_sem_give(&display_wake);
+    return 0;
+}
+
+// Next enabled page after 'page', or 'page' itself if no other is enabled
+static int next_enabled_page(int page)
+{
+    atomic_val_t mask = atomic_get(&enabled_pages);
+
+    for (int i = 1; i <= DISPLAY_PAGE_COUNT; i++) {
+        int candidate = (page + i) % DISPLAY_PAGE_COUNT;
+        if (mask & BIT(candidate)) {
+            return candidate;
+        }
+    }
+    return page;
+}
+
+void display_next_page(void)
+{
+    atomic_set(&current_page, next_enabled_page(atomic_get(&current_page)));
+    k_sem_give(&display_wake);
+}
+
+int display_set_page_enabled(enum display_page page, bool enable)
+{
+    if (page >= DISPLAY_PAGE_COUNT) {
+        return -EINVAL;
+    }
+
+    if (enable) {
+        atomic_or(&enabled_pages, BIT(page));
+    } else {
+        atomic_and(&enabled_pages, ~BIT(page));
+    }
+    return 0;
+}
+
+void display_set_rotation(uint32_t period_ms)
+{
+    atomic_set(&rotate_ms, period_ms);
+    k_sem_give(&display_wake);
+}
+
+void display_print_status(void)
+{
+    atomic_val_t mask = atomic_get(&enabled_pages);
+    int page = atomic_get(&current_page);
+
+    printk("Pages:");
+    for (int i = 0; i < DISPLAY_PAGE_COUNT; i++) {
+        printk(" %s%s%s", i == page ? "[" : "", pages[i].name,
+               i == page ? "]" : (mask & BIT(i)) ? "" : "(off)");
+    }
+    printk("\nRotation: %u ms, frame limit: %u ms\n",
+           (uint32_t)atomic_get(&rotate_ms), DISPLAY_FRAME_MS);
+    printk("Last frame: %u us render, %u us full clear\n",
+           (uint32_t)k_cyc_to_us_floor64(last_render_cycles),
+           ht1621_get_frame_time_us());
+}
+
+void display_run_benchmark(void)
+{
+    // Runs in the display thread so it does not race frame writes
+    atomic_set(&bench_requested, 1);
+    k_sem_give(&display_wake);
+}
+
+static void display_thread(void)
+{
+    uint8_t shown[HT1621_MAX_DIGITS];
+    uint8_t frame[HT1621_MAX_DIGITS];
+    int64_t last_rotate;
+    int64_t last_frame = 0;
+
+    if (ht1621_init() != 0) {
+        LOG_ERR("HT1621 init failed, display disabled");
+        return;
+    }
+    last_rotate = k_uptime_get();
+    ht1621_format_fill(shown, HT1621_BLANK);
+    supervisor_enable(SUP_DISPLAY);
+
+    while (1) {
+        k_sem_take(&display_wake, K_MSEC(DISPLAY_FRAME_MS));
+        supervisor_kick(SUP_DISPLAY);
+
+        // Cap the frame rate even when woken early
+        int64_t since_frame = k_uptime_get() - last_frame;
+        if (since_frame < DISPLAY_FRAME_MS) {
+            k_msleep(DISPLAY_FRAME_MS - since_frame);
+        }
+        last_frame = k_uptime_get();
+
+        uint32_t period = atomic_get(&rotate_ms);
+        if (period > 0 && last_frame - last_rotate >= period) {
+            atomic_set(&current_page, next_enabled_page(atomic_get(&current_page)));
+            last_rotate = last_frame;
+        }
+
+        if (atomic_cas(&bench_requested, 1, 0)) {
+            ht1621_benchmark();
+            // Glass contents are unknown now, force the next frame out
+            memset(shown, 0xFF, sizeof(shown));
+        }
+
+        const struct page_desc *desc = &pages[atomic_get(&current_page)];
+        int32_t value;
+
+        uint32_t start = k_cycle_get_32();
+        if (desc->read(&value)) {
+            ht1621_format_fixed(frame, value, desc->scale, desc->decimals,
+                                desc->min_digits);
+        } else {
+            ht1621_format_fill(frame, HT1621_MINUS);
+        }
+
+        // Only touch the bus when something visible changed
+        if (memcmp(frame, shown, sizeof(frame)) == 0) {
+            stats_inc(STATS_C_DISPLAY_SKIP);
+            continue;
+        }
+
+        uint32_t flush_start = stats_timer_start();
+        ht1621_write_frame(frame);
+        stats_timer_stop(STATS_T_DISPLAY_FLUSH, flush_start);
+        last_render_cycles = k_cycle_get_32() - start;
+        memcpy(shown, frame, sizeof(shown));
+    }
+}
+
+// Console commands
+static int cmd_display(int argc, char **argv)
+{
+    display_print_status();
+    return 0;
+}
+
+static int cmd_display_next(int argc, char **argv)
+{
+    display_next_page();
+    return 0;
+}
+
+static int cmd_display_bench(int argc, char **argv)
+{
+    display_run_benchmark();
+    return 0;
+}
+
+static int cmd_display_page(int argc, char **argv)
+{
+    int page = display_page_from_name(argv[0]);
+    bool enable;
+
+    if (page < 0) {
+        printk("Error: Unknown page '%s'\n", argv[0]);
+        return -EINVAL;
+    }
+
+    if (argc == 1) {
+        return display_set_page(page);
+    }
+
+    if (cmd_parse_on_off(argv[1], &enable) != 0) {
+        return -EINVAL;
+    }
+    return display_set_page_enabled(page, enable);
+}
+
+static int cmd_display_rotate(int argc, char **argv)
+{
+    int32_t seconds;
+
+    if (cmd_parse_int(argv[0], &seconds) != 0 || seconds < 0 ||
+        seconds > DISPLAY_ROTATE_MAX_S) {
+        return -EINVAL;
+    }
+    display_set_rotation(seconds * 1000);
+    return 0;
+}
+
+CMD_DEFINE(display, "display", "", "Show display pages and frame time", cmd_display, 0, 0);
+CMD_DEFINE(display_next, "display next", "", "Show the next display page", cmd_display_next, 0, 0);
+CMD_DEFINE(display_bench, "display bench", "", "Time display update paths (cycles)",
+           cmd_display_bench, 0, 0);
+CMD_DEFINE(display_page, "display page", "<hdg|sog|pitch|roll|fix|dtw|btw> [on|off]",
+           "Show page, or add/remove it from rotation", cmd_display_page, 1, 2);
+CMD_DEFINE(display_rotate, "display rotate", "<seconds>",
+           "Page rotation period, up to 3600 (0 = off)", cmd_display_rotate, 1, 1);
+
+K_THREAD_DEFINE(display_thread_id, 1024, display_thread, NULL, NULL, NULL, 10, 0, 0);
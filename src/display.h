@@ -0,0 +1,41 @@
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Display pages, in rotation order
+enum display_page {
+    DISPLAY_PAGE_HEADING,   // Compass heading (deg)
+    DISPLAY_PAGE_SOG,       // Speed over ground (kn)
+    DISPLAY_PAGE_PITCH,     // Pitch (deg)
+    DISPLAY_PAGE_ROLL,      // Roll (deg)
+    DISPLAY_PAGE_FIX,       // UTC hhmmss while fixed, dashes without a fix
+    DISPLAY_PAGE_DTW,       // Distance to the active waypoint (nm)
+    DISPLAY_PAGE_BTW,       // Bearing to the active waypoint (deg)
+    DISPLAY_PAGE_COUNT
+};
+
+// Show a page now. Returns -EINVAL for an unknown page.
+int display_set_page(enum display_page page);
+
+// Advance to the next enabled page
+void display_next_page(void);
+
+// Include or skip a page in the rotation
+int display_set_page_enabled(enum display_page page, bool enable);
+
+// Page rotation period, 0 = no automatic rotation
+void display_set_rotation(uint32_t period_ms);
+
+// Look up a page by name ("hdg", "sog", "pitch", "roll", "fix", "dtw", "btw").
+// Returns -EINVAL if unknown.
+int display_page_from_name(const char *name);
+
+// Time the float and fixed-point render paths on the display thread
+void display_run_benchmark(void);
+
+// Print page names, rotation state and last frame time
+void display_print_status(void);
+
+#endif // DISPLAY_H
@@ -0,0 +1,134 @@
+/*
+ * I2C emulator for the HMC5883L (native_sim). Implements the registers the
+ * Zephyr hmc5883l driver uses and fills the data registers from the current
+ * motion profile on every read starting at DATA_OUT_X_MSB.
+ */
+#define DT_DRV_COMPAT honeywell_hmc5883l
+
+#include "motion_profile.h"
+#include <zephyr/device.h>
+#include <zephyr/drivers/emul.h>
+#include <zephyr/drivers/i2c.h>
+#include <zephyr/drivers/i2c_emul.h>
+#include <zephyr/sys/byteorder.h>
+#include <math.h>
+#include <string.h>
+
+#define HMC5883L_REG_CONFIG_A   0x00
+#define HMC5883L_REG_CONFIG_B   0x01
+#define HMC5883L_REG_MODE       0x02
+#define HMC5883L_REG_DATA_START 0x03
+#define HMC5883L_REG_STATUS     0x09
+#define HMC5883L_REG_CHIP_ID    0x0A
+#define HMC5883L_REG_COUNT      0x0D
+
+#define HMC5883L_GAIN_SHIFT     5
+#define HMC5883L_STATUS_RDY     BIT(0)
+
+// Data registers saturate to -4096 outside -2048..2047
+#define HMC5883L_OVERFLOW       (-4096)
+
+// LSB per Gauss for each gain setting
+static const uint16_t hmc5883l_gain[] = { 1370, 1090, 820, 660, 440, 390, 330, 230 };
+
+struct hmc5883l_emul_data {
+    uint8_t regs[HMC5883L_REG_COUNT];
+    uint32_t sample;        // Samples played since the last profile change
+    uint32_t epoch;
+};
+
+static int16_t to_raw(float gauss, uint16_t lsb_per_gauss)
+{
+    long value = lroundf(gauss * lsb_per_gauss);
+
+    if (value < -2048 || value > 2047) {
+        return HMC5883L_OVERFLOW;
+    }
+    return (int16_t)value;
+}
+
+static void hmc5883l_emul_update(struct hmc5883l_emul_data *data)
+{
+    uint16_t lsb = hmc5883l_gain[data->regs[HMC5883L_REG_CONFIG_B] >> HMC5883L_GAIN_SHIFT];
+    uint8_t *out = &data->regs[HMC5883L_REG_DATA_START];
+    struct motion_state state;
+
+    if (data->epoch != motion_profile_epoch()) {
+        data->epoch = motion_profile_epoch();
+        data->sample = 0;
+    }
+    motion_profile_eval(data->sample++, &state);
+
+    // Register order is X, Z, Y, big endian
+    sys_put_be16(to_raw(state.mag[0], lsb), &out[0]);
+    sys_put_be16(to_raw(state.mag[2], lsb), &out[2]);
+    sys_put_be16(to_raw(state.mag[1], lsb), &out[4]);
+}
+
+// The first byte written sets the register pointer, further bytes are
+// written to successive registers and reads continue from the pointer.
+static int hmc5883l_emul_transfer(const struct emul *target, struct i2c_msg *msgs,
+                                  int num_msgs, int addr)
+{
+    struct hmc5883l_emul_data *data = target->data;
+    bool have_reg = false;
+    uint8_t reg = 0;
+
+    for (int m = 0; m < num_msgs; m++) {
+        struct i2c_msg *msg = &msgs[m];
+
+        if (msg->flags & I2C_MSG_READ) {
+            if (!have_reg) {
+                return -EIO;
+            }
+            if (reg == HMC5883L_REG_DATA_START) {
+                hmc5883l_emul_update(data);
+            }
+            for (uint32_t i = 0; i < msg->len; i++) {
+                msg->buf[i] = data->regs[reg++ % HMC5883L_REG_COUNT];
+            }
+            continue;
+        }
+
+        for (uint32_t i = 0; i < msg->len; i++) {
+            if (!have_reg) {
+                reg = msg->buf[i];
+                have_reg = true;
+            } else if (reg % HMC5883L_REG_COUNT <= HMC5883L_REG_MODE) {
+                // Only the configuration and mode registers are writable
+                data->regs[reg++ % HMC5883L_REG_COUNT] = msg->buf[i];
+            } else {
+                reg++;
+            }
+        }
+    }
+    return 0;
+}
+
+static const struct i2c_emul_api hmc5883l_emul_api = {
+    .transfer = hmc5883l_emul_transfer,
+};
+
+static int hmc5883l_emul_init(const struct emul *target, const struct device *parent)
+{
+    struct hmc5883l_emul_data *data = target->data;
+
+    ARG_UNUSED(parent);
+
+    memset(data->regs, 0, sizeof(data->regs));
+    data->regs[HMC5883L_REG_CONFIG_A] = 0x10;
+    data->regs[HMC5883L_REG_CONFIG_B] = 0x20;
+    data->regs[HMC5883L_REG_MODE] = 0x01;
+    data->regs[HMC5883L_REG_STATUS] = HMC5883L_STATUS_RDY;
+    memcpy(&data->regs[HMC5883L_REG_CHIP_ID], "H43", 3);
+    data->epoch = motion_profile_epoch();
+    data->sample = 0;
+    return 0;
+}
+
+#define HMC5883L_EMUL(n)                                                        \
+    static struct hmc5883l_emul_data hmc5883l_emul_data_##n;                   \
+    EMUL_DT_INST_DEFINE(n, hmc5883l_emul_init, &hmc5883l_emul_data_##n, NULL,  \
+                        &hmc5883l_emul_api, NULL)
+
+DT_INST_FOREACH_STATUS_OKAY(HMC5883L_EMUL)
@@ -0,0 +1,154 @@
+#include "motion_profile.h"
+#include "command_parser.h"
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#define DEG_TO_RAD  (3.14159265359f / 180.0f)
+#define TWO_PI      6.28318530718f
+
+// Earth field: horizontal and vertical components (Gauss)
+#define FIELD_H     0.20f
+#define FIELD_V     0.40f
+
+// MOTION_DISTURB: hard-iron offset switched on for 2 s every 10 s
+#define DISTURB_PERIOD_S    10.0f
+#define DISTURB_ON_S        2.0f
+
+static const char *const profile_names[MOTION_COUNT] = {
+    [MOTION_STATIC]  = "static",
+    [MOTION_TURN]    = "turn",
+    [MOTION_SEA]     = "sea",
+    [MOTION_DISTURB] = "disturb",
+};
+
+static atomic_t profile = ATOMIC_INIT(MOTION_STATIC);
+static atomic_t rate_hz = ATOMIC_INIT(MOTION_DEFAULT_RATE_HZ);
+static atomic_t epoch;
+
+int motion_profile_set(enum motion_profile new_profile, uint32_t new_rate_hz)
+{
+    if (new_profile >= MOTION_COUNT || new_rate_hz == 0 || new_rate_hz > 10000) {
+        return -EINVAL;
+    }
+
+    atomic_set(&profile, new_profile);
+    atomic_set(&rate_hz, new_rate_hz);
+    atomic_inc(&epoch);
+    return 0;
+}
+
+uint32_t motion_profile_epoch(void)
+{
+    return atomic_get(&epoch);
+}
+
+// Attitude (degrees) of the current profile at time t
+static void attitude_at(enum motion_profile p, float t, float *heading, float *pitch,
+                        float *roll)
+{
+    switch (p) {
+    case MOTION_TURN:
+        // Rate one turn (3 deg/s), heeled 10 degrees into the turn
+        *heading = fmodf(45.0f + 3.0f * t, 360.0f);
+        *pitch = 0.0f;
+        *roll = 10.0f;
+        break;
+    case MOTION_SEA:
+        *heading = 45.0f + 5.0f * sinf(TWO_PI * t / 8.0f);
+        *pitch = 8.0f * sinf(TWO_PI * t / 6.0f);
+        *roll = 12.0f * sinf(TWO_PI * t / 4.5f);
+        break;
+    case MOTION_STATIC:
+    case MOTION_DISTURB:
+    default:
+        *heading = 45.0f;
+        *pitch = 0.0f;
+        *roll = 0.0f;
+        break;
+    }
+}
+
+// Rotate a level-frame vector into the tilted sensor frame: pitch about Y,
+// then roll about X. Gravity (0, 0, g) comes out as the accelerometer sees it.
+static void tilt(const float level[3], float pitch, float roll, float out[3])
+{
+    float sp = sinf(pitch * DEG_TO_RAD), cp = cosf(pitch * DEG_TO_RAD);
+    float sr = sinf(roll * DEG_TO_RAD), cr = cosf(roll * DEG_TO_RAD);
+    float x1 = level[0] * cp - level[2] * sp;
+    float z1 = level[0] * sp + level[2] * cp;
+
+    out[0] = x1;
+    out[1] = level[1] * cr + z1 * sr;
+    out[2] = -level[1] * sr + z1 * cr;
+}
+
+void motion_profile_eval(uint32_t sample, struct motion_state *state)
+{
+    enum motion_profile p = atomic_get(&profile);
+    float dt = 1.0f / (uint32_t)atomic_get(&rate_hz);
+    float t = sample * dt;
+    float next_heading, next_pitch, next_roll;
+    float delta;
+
+    attitude_at(p, t, &state->heading, &state->pitch, &state->roll);
+
+    const float gravity[3] = { 0.0f, 0.0f, MOTION_GRAVITY };
+    tilt(gravity, state->pitch, state->roll, state->accel);
+
+    // Level field in the frame the heading code expects: atan2(y, x) = heading
+    const float field[3] = {
+        FIELD_H * cosf(state->heading * DEG_TO_RAD),
+        FIELD_H * sinf(state->heading * DEG_TO_RAD),
+        FIELD_V,
+    };
+    tilt(field, state->pitch, state->roll, state->mag);
+
+    if (p == MOTION_DISTURB && fmodf(t, DISTURB_PERIOD_S) < DISTURB_ON_S) {
+        state->mag[0] += 0.30f;
+        state->mag[1] -= 0.20f;
+        state->mag[2] += 0.10f;
+    }
+
+    // Body rates approximated by the attitude rates over one sample
+    attitude_at(p, t + dt, &next_heading, &next_pitch, &next_roll);
+    delta = next_heading - state->heading;
+    if (delta > 180.0f) {
+        delta -= 360.0f;
+    } else if (delta < -180.0f) {
+        delta += 360.0f;
+    }
+    state->gyro[0] = (next_roll - state->roll) / dt;
+    state->gyro[1] = (next_pitch - state->pitch) / dt;
+    state->gyro[2] = delta / dt;
+}
+
+// Console commands
+static int cmd_emul(int argc, char **argv)
+{
+    printk("Motion profile: %s at %u Hz, epoch %u\n", profile_names[atomic_get(&profile)],
+           (uint32_t)atomic_get(&rate_hz), motion_profile_epoch());
+    return 0;
+}
+
+static int cmd_emul_profile(int argc, char **argv)
+{
+    int32_t rate = atomic_get(&rate_hz);
+
+    if (argc == 2 && (cmd_parse_int(argv[1], &rate) != 0 || rate <= 0)) {
+        return -EINVAL;
+    }
+
+    for (int i = 0; i < MOTION_COUNT; i++) {
+        if (strcmp(argv[0], profile_names[i]) == 0) {
+            return motion_profile_set(i, rate);
+        }
+    }
+    return -EINVAL;
+}
+
+CMD_DEFINE(emul, "emul", "", "Show the emulated motion profile", cmd_emul, 0, 0);
+CMD_DEFINE(emul_profile, "emul profile", "<static|turn|sea|disturb> [rate_hz]",
+           "Replay a motion profile on the sensor emulators", cmd_emul_profile, 1, 2);
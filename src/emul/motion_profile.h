@@ -0,0 +1,47 @@
+#ifndef MOTION_PROFILE_H
+#define MOTION_PROFILE_H
+
+#include <stdint.h>
+
+/*
+ * Scripted boat motion for the sensor emulators (native_sim).
+ *
+ * Each emulator keeps its own sample counter and advances it by one sample
+ * period on every data register read, so the profile plays back at the
+ * configured rate no matter how fast the application polls. Changing the
+ * profile or rate restarts playback at t = 0 for all emulators.
+ */
+
+enum motion_profile {
+    MOTION_STATIC,          // Level, fixed heading
+    MOTION_TURN,            // Constant rate turn with a little heel
+    MOTION_SEA,             // Pitching and rolling in a seaway, yawing a few degrees
+    MOTION_DISTURB,         // Static, with a periodic hard-iron disturbance
+    MOTION_COUNT
+};
+
+// Default playback rate (samples per second per sensor)
+#define MOTION_DEFAULT_RATE_HZ 50
+
+// Standard gravity, m/s^2 per g
+#define MOTION_GRAVITY 9.80665f
+
+struct motion_state {
+    float heading;          // Magnetic heading, degrees
+    float pitch;            // Degrees, bow up positive
+    float roll;             // Degrees, starboard down positive
+    float accel[3];         // m/s^2, sensor frame
+    float gyro[3];          // deg/s, sensor frame
+    float mag[3];           // Gauss, sensor frame
+};
+
+// Select the profile and playback rate. Returns -EINVAL on bad arguments.
+int motion_profile_set(enum motion_profile profile, uint32_t rate_hz);
+
+// Playback generation, bumped by motion_profile_set()
+uint32_t motion_profile_epoch(void);
+
+// State of the current profile at sample number 'sample'
+void motion_profile_eval(uint32_t sample, struct motion_state *state);
+
+#endif // MOTION_PROFILE_H
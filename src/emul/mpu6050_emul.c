@@ -0,0 +1,137 @@
+/*
+ * I2C emulator for the MPU6050 (native_sim). Implements the registers the
+ * Zephyr mpu6050 driver uses and fills the sample registers from the
+ * current motion profile on every burst read of ACCEL_XOUT_H.
+ */
+#define DT_DRV_COMPAT invensense_mpu6050
+
+#include "motion_profile.h"
+#include <zephyr/device.h>
+#include <zephyr/drivers/emul.h>
+#include <zephyr/drivers/i2c.h>
+#include <zephyr/drivers/i2c_emul.h>
+#include <zephyr/sys/byteorder.h>
+#include <math.h>
+#include <string.h>
+
+#define MPU6050_REG_GYRO_CFG    0x1B
+#define MPU6050_REG_ACCEL_CFG   0x1C
+#define MPU6050_REG_DATA_START  0x3B
+#define MPU6050_REG_PWR_MGMT1   0x6B
+#define MPU6050_REG_WHO_AM_I    0x75
+#define MPU6050_REG_COUNT       0x80
+
+#define MPU6050_CHIP_ID         0x68
+#define MPU6050_SLEEP_EN        BIT(6)
+#define MPU6050_FS_SHIFT        3
+
+// Full scale +-2 g and +-250 deg/s, halved per full-scale step
+#define MPU6050_ACCEL_LSB_2G    16384.0f
+#define MPU6050_GYRO_LSB_250    131.0f
+
+// Temperature register for 25 C: (25 - 36.53) * 340
+#define MPU6050_TEMP_25C        (-3920)
+
+struct mpu6050_emul_data {
+    uint8_t regs[MPU6050_REG_COUNT];
+    uint32_t sample;        // Samples played since the last profile change
+    uint32_t epoch;
+};
+
+static int16_t to_i16(float value)
+{
+    if (value > INT16_MAX) {
+        return INT16_MAX;
+    }
+    if (value < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return (int16_t)lroundf(value);
+}
+
+static void mpu6050_emul_update(struct mpu6050_emul_data *data)
+{
+    uint8_t afs = (data->regs[MPU6050_REG_ACCEL_CFG] >> MPU6050_FS_SHIFT) & 0x3;
+    uint8_t gfs = (data->regs[MPU6050_REG_GYRO_CFG] >> MPU6050_FS_SHIFT) & 0x3;
+    float accel_lsb = MPU6050_ACCEL_LSB_2G / (1 << afs) / MOTION_GRAVITY;
+    float gyro_lsb = MPU6050_GYRO_LSB_250 / (1 << gfs);
+    uint8_t *out = &data->regs[MPU6050_REG_DATA_START];
+    struct motion_state state;
+
+    if (data->epoch != motion_profile_epoch()) {
+        data->epoch = motion_profile_epoch();
+        data->sample = 0;
+    }
+    motion_profile_eval(data->sample++, &state);
+
+    // ACCEL_XOUT..ZOUT, TEMP_OUT, GYRO_XOUT..ZOUT, big endian
+    for (int i = 0; i < 3; i++) {
+        sys_put_be16(to_i16(state.accel[i] * accel_lsb), &out[2 * i]);
+        sys_put_be16(to_i16(state.gyro[i] * gyro_lsb), &out[8 + 2 * i]);
+    }
+    sys_put_be16((uint16_t)MPU6050_TEMP_25C, &out[6]);
+}
+
+// The first byte written sets the register pointer, further bytes are
+// written to successive registers and reads continue from the pointer.
+static int mpu6050_emul_transfer(const struct emul *target, struct i2c_msg *msgs,
+                                 int num_msgs, int addr)
+{
+    struct mpu6050_emul_data *data = target->data;
+    bool have_reg = false;
+    uint8_t reg = 0;
+
+    for (int m = 0; m < num_msgs; m++) {
+        struct i2c_msg *msg = &msgs[m];
+
+        if (msg->flags & I2C_MSG_READ) {
+            if (!have_reg) {
+                return -EIO;
+            }
+            if (reg == MPU6050_REG_DATA_START) {
+                mpu6050_emul_update(data);
+            }
+            for (uint32_t i = 0; i < msg->len; i++) {
+                msg->buf[i] = data->regs[reg++ % MPU6050_REG_COUNT];
+            }
+            continue;
+        }
+
+        for (uint32_t i = 0; i < msg->len; i++) {
+            if (!have_reg) {
+                reg = msg->buf[i];
+                have_reg = true;
+            } else if (reg % MPU6050_REG_COUNT != MPU6050_REG_WHO_AM_I) {
+                data->regs[reg++ % MPU6050_REG_COUNT] = msg->buf[i];
+            } else {
+                reg++;
+            }
+        }
+    }
+    return 0;
+}
+
+static const struct i2c_emul_api mpu6050_emul_api = {
+    .transfer = mpu6050_emul_transfer,
+};
+
+static int mpu6050_emul_init(const struct emul *target, const struct device *parent)
+{
+    struct mpu6050_emul_data *data = target->data;
+
+    ARG_UNUSED(parent);
+
+    memset(data->regs, 0, sizeof(data->regs));
+    data->regs[MPU6050_REG_WHO_AM_I] = MPU6050_CHIP_ID;
+    data->regs[MPU6050_REG_PWR_MGMT1] = MPU6050_SLEEP_EN;
+    data->epoch = motion_profile_epoch();
+    data->sample = 0;
+    return 0;
+}
+
+#define MPU6050_EMUL(n)                                                         \
+    static struct mpu6050_emul_data mpu6050_emul_data_##n;                     \
+    EMUL_DT_INST_DEFINE(n, mpu6050_emul_init, &mpu6050_emul_data_##n, NULL,    \
+                        &mpu6050_emul_api, NULL)
+
+DT_INST_FOREACH_STATUS_OKAY(MPU6050_EMUL)
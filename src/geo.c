@@ -0,0 +1,188 @@
+#include "geo.h"
+#include <math.h>
+
+#define PI_F            3.14159265f
+#define DEG_TO_RAD      (PI_F / 180.0f)
+#define EARTH_RADIUS_CM 637100880.0f
+
+// sin(n degrees) in Q15, n = 0..90
+static const int32_t sin_table[91] = {
+        0,   572,  1144,  1715,  2286,  2856,  3425,  3993,
+     4560,  5126,  5690,  6252,  6813,  7371,  7927,  8481,
+     9032,  9580, 10126, 10668, 11207, 11743, 12275, 12803,
+    13328, 13848, 14365, 14876, 15384, 15886, 16384, 16877,
+    17364, 17847, 18324, 18795, 19261, 19720, 20174, 20622,
+    21063, 21498, 21926, 22348, 22763, 23170, 23571, 23965,
+    24351, 24730, 25102, 25466, 25822, 26170, 26510, 26842,
+    27166, 27482, 27789, 28088, 28378, 28660, 28932, 29197,
+    29452, 29698, 29935, 30163, 30382, 30592, 30792, 30983,
+    31164, 31336, 31499, 31651, 31795, 31928, 32052, 32166,
+    32270, 32365, 32449, 32524, 32588, 32643, 32688, 32723,
+    32748, 32763, 32768
+};
+
+uint64_t geo_isqrt64(uint64_t value)
+{
+    uint64_t root = 0;
+    uint64_t bit = 1ULL << 62;
+
+    while (bit > value) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+int32_t geo_cos_lat_q15(int32_t latitude)
+{
+    return (int32_t)(cosf(latitude * 1e-7f * DEG_TO_RAD) * 32768.0f);
+}
+
+struct geo_vec geo_offset_cm(int32_t ref_lat, int32_t ref_lon, int32_t cos_lat_q15,
+                             int32_t lat, int32_t lon)
+{
+    int64_t dlat = (int64_t)lat - ref_lat;
+    int64_t dlon = (int64_t)lon - ref_lon;
+    struct geo_vec v;
+
+    // Across the antimeridian
+    if (dlon > 1800000000LL) {
+        dlon -= 3600000000LL;
+    } else if (dlon < -1800000000LL) {
+        dlon += 3600000000LL;
+    }
+
+    v.x = (dlon * GEO_CM_PER_E7_DEG_X1E5 / 100000 * cos_lat_q15) >> 15;
+    v.y = dlat * GEO_CM_PER_E7_DEG_X1E5 / 100000;
+    return v;
+}
+
+uint32_t geo_length_cm(struct geo_vec v)
+{
+    uint64_t ax = v.x < 0 ? -v.x : v.x;
+    uint64_t ay = v.y < 0 ? -v.y : v.y;
+    int shift = 0;
+
+    // Keep the sum of squares within 64 bits for offsets across the globe
+    while ((ax | ay) >= (1ULL << 31)) {
+        ax >>= 1;
+        ay >>= 1;
+        shift++;
+    }
+    return geo_isqrt64(ax * ax + ay * ay) << shift;
+}
+
+// atan(num / den) in millidegrees for 0 <= num <= den, den > 0. Odd
+// polynomial in z = num / den, error below 0.01 degrees.
+static int32_t atan_mdeg(int64_t num, int64_t den)
+{
+    int64_t z = num * 32768 / den;
+    int64_t z2 = z * z >> 15;
+    int64_t p = 1194;
+
+    p = (p * z2 >> 15) - 4878;
+    p = (p * z2 >> 15) + 10321;
+    p = (p * z2 >> 15) - 18925;
+    p = (p * z2 >> 15) + 57288;
+    return p * z >> 15;
+}
+
+uint32_t geo_bearing_mdeg(struct geo_vec v)
+{
+    int64_t ax = v.x < 0 ? -v.x : v.x;
+    int64_t ay = v.y < 0 ? -v.y : v.y;
+    int32_t angle;
+
+    if (ax == 0 && ay == 0) {
+        return 0;
+    }
+
+    // Angle from the north/south axis, folded into the first quadrant
+    if (ax <= ay) {
+        angle = atan_mdeg(ax, ay);
+    } else {
+        angle = 90000 - atan_mdeg(ay, ax);
+    }
+
+    if (v.y < 0) {
+        angle = 180000 - angle;
+    }
+    if (v.x < 0) {
+        angle = 360000 - angle;
+    }
+    return angle % 360000;
+}
+
+int32_t geo_sin_q15(int32_t mdeg)
+{
+    int32_t a = mdeg % 360000;
+    int32_t sign = 1;
+    int32_t deg, frac, s;
+
+    if (a < 0) {
+        a += 360000;
+    }
+    if (a >= 180000) {
+        a -= 180000;
+        sign = -1;
+    }
+    if (a > 90000) {
+        a = 180000 - a;
+    }
+
+    // Linear interpolation between whole degrees
+    deg = a / 1000;
+    frac = a % 1000;
+    s = sin_table[deg];
+    if (frac != 0) {
+        s += (sin_table[deg + 1] - s) * frac / 1000;
+    }
+    return sign * s;
+}
+
+int32_t geo_cos_q15(int32_t mdeg)
+{
+    return geo_sin_q15(mdeg + 90000);
+}
+
+void geo_great_circle(int32_t lat0, int32_t lon0, int32_t lat1, int32_t lon1,
+                      uint32_t *distance_cm, uint32_t *bearing_mdeg)
+{
+    float phi0 = lat0 * 1e-7f * DEG_TO_RAD;
+    float phi1 = lat1 * 1e-7f * DEG_TO_RAD;
+    float dphi = ((int64_t)lat1 - lat0) * 1e-7f * DEG_TO_RAD;
+    float dlambda = ((int64_t)lon1 - lon0) * 1e-7f * DEG_TO_RAD;
+    float s_dphi = sinf(dphi / 2.0f);
+    float s_dlambda = sinf(dlambda / 2.0f);
+    float h = s_dphi * s_dphi + cosf(phi0) * cosf(phi1) * s_dlambda * s_dlambda;
+    float bearing;
+
+    *distance_cm = (uint32_t)(2.0f * EARTH_RADIUS_CM * asinf(sqrtf(fminf(h, 1.0f))));
+
+    bearing = atan2f(sinf(dlambda) * cosf(phi1),
+                     cosf(phi0) * sinf(phi1) - sinf(phi0) * cosf(phi1) * cosf(dlambda));
+    bearing = bearing / DEG_TO_RAD * 1000.0f;
+    if (bearing < 0.0f) {
+        bearing += 360000.0f;
+    }
+    *bearing_mdeg = (uint32_t)bearing % 360000;
+}
+
+int32_t geo_cross_track_cm(int32_t lat1, int32_t lon1, uint32_t bearing12_mdeg,
+                           int32_t lat3, int32_t lon3)
+{
+    uint32_t d13, bearing13;
+    float angle;
+
+    geo_great_circle(lat1, lon1, lat3, lon3, &d13, &bearing13);
+    angle = ((int32_t)bearing13 - (int32_t)bearing12_mdeg) * 1e-3f * DEG_TO_RAD;
+    return (int32_t)(asinf(sinf(d13 / EARTH_RADIUS_CM) * sinf(angle)) * EARTH_RADIUS_CM);
+}
@@ -0,0 +1,80 @@
+#ifndef GEO_H
+#define GEO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Fixed-point geodesy on 1e-7 degree coordinates.
+ *
+ * Positions near a reference point are handled as flat east/north offsets
+ * in cm (equirectangular projection). The only trig is cos(latitude) of
+ * the reference, which callers compute once and cache. Past
+ * GEO_NEAR_E7 the projection error grows and geo_great_circle() should be
+ * used instead.
+ */
+
+// cm per 1e-7 degree of latitude, times 1e5
+#define GEO_CM_PER_E7_DEG_X1E5  111195
+
+// Offsets up to this many 1e-7 degrees (~20 km) stay within ~0.3%
+#define GEO_NEAR_E7             2000000
+
+// Unit vectors are scaled to this length
+#define GEO_DIR_ONE             16384
+
+struct geo_vec {
+    int64_t x;              // East, cm
+    int64_t y;              // North, cm
+};
+
+static inline int64_t geo_cross(struct geo_vec a, struct geo_vec b)
+{
+    return a.x * b.y - a.y * b.x;
+}
+
+static inline int64_t geo_dot(struct geo_vec a, struct geo_vec b)
+{
+    return a.x * b.x + a.y * b.y;
+}
+
+uint64_t geo_isqrt64(uint64_t value);
+
+// cos(latitude) in Q15, for the reference point of geo_offset_cm()
+int32_t geo_cos_lat_q15(int32_t latitude);
+
+// Offset of (lat, lon) from (ref_lat, ref_lon) in cm
+struct geo_vec geo_offset_cm(int32_t ref_lat, int32_t ref_lon, int32_t cos_lat_q15,
+                             int32_t lat, int32_t lon);
+
+// Length of v in cm
+uint32_t geo_length_cm(struct geo_vec v);
+
+// Direction of v in millidegrees, 0 = north, clockwise
+uint32_t geo_bearing_mdeg(struct geo_vec v);
+
+// sin and cos of an angle in millidegrees, Q15. Table based, no libm.
+int32_t geo_sin_q15(int32_t mdeg);
+int32_t geo_cos_q15(int32_t mdeg);
+
+// Distance and initial bearing along the great circle (haversine), for
+// points too far apart for the flat approximation. Uses float trig.
+void geo_great_circle(int32_t lat0, int32_t lon0, int32_t lat1, int32_t lon1,
+                      uint32_t *distance_cm, uint32_t *bearing_mdeg);
+
+// Distance in cm of point 3 from the great circle leaving point 1 on
+// bearing12, positive to the right of it. Uses float trig.
+int32_t geo_cross_track_cm(int32_t lat1, int32_t lon1, uint32_t bearing12_mdeg,
+                           int32_t lat3, int32_t lon3);
+
+// True if two points are close enough for the flat approximation
+static inline bool geo_is_near(int32_t lat0, int32_t lon0, int32_t lat1, int32_t lon1)
+{
+    int64_t dlat = (int64_t)lat1 - lat0;
+    int64_t dlon = (int64_t)lon1 - lon0;
+
+    return dlat < GEO_NEAR_E7 && dlat > -GEO_NEAR_E7 &&
+           dlon < GEO_NEAR_E7 && dlon > -GEO_NEAR_E7;
+}
+
+#endif // GEO_H
@@ -0,0 +1,966 @@
+#include "geofence.h"
+#include "command_parser.h"
+#include "geo.h"
+#include <zephyr/kernel.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+
+LOG_MODULE_REGISTER(geofence, LOG_LEVEL_INF);
+
+#define FENCE_MAGIC             0x45434E46  // "FNCE"
+
+#define MAX_RADIUS_M            50000
+#define MAX_DWELL_S             UINT16_MAX
+
+// Grid index pools, shared by all polygons. One polygon may not take more
+// than GRID_MAX_DIM^2 of the cells.
+#define GRID_MAX_DIM            12
+#define GRID_MAX_CELLS          256
+#define GRID_MAX_EDGE_REFS      1024
+
+#define CELL_INSIDE             BIT(0)  // Cell centre is inside the polygon
+#define CELL_BRUTE              BIT(1)  // Centre on an edge line, test every edge
+
+// On flash: header, a record per fence, then the vertices of all polygons
+// in fence order
+struct store_header {
+    uint32_t magic;
+    uint16_t count;         // Fences
+    uint16_t vertices;
+    uint32_t crc;           // crc32_ieee over the records and vertices
+    uint32_t reserved;
+};
+
+struct fence_record {
+    uint8_t type;           // enum geofence_type
+    uint8_t count;          // Polygon vertices
+    uint16_t dwell_s;       // 0 = no dwell event
+    int32_t latitude;       // Circle centre or first polygon vertex, 1e-7 degrees
+    int32_t longitude;
+    uint32_t radius_m;      // Circles only
+};
+
+struct vertex {
+    int16_t x;              // m east of the fence origin
+    int16_t y;              // m north
+};
+
+// Records and vertices are written as they are, in 8-byte flash blocks
+BUILD_ASSERT(sizeof(struct store_header) == 16, "store_header layout changed");
+BUILD_ASSERT(sizeof(struct fence_record) == 16, "fence_record layout changed");
+BUILD_ASSERT(GEOFENCE_MAX_VERTICES * sizeof(struct vertex) % 8 == 0,
+             "vertex array must be a whole number of flash blocks");
+
+#if FIXED_PARTITION_EXISTS(fence_partition)
+#define FENCE_PARTITION_ID      FIXED_PARTITION_ID(fence_partition)
+BUILD_ASSERT(sizeof(struct store_header) +
+             GEOFENCE_MAX_FENCES * sizeof(struct fence_record) +
+             GEOFENCE_MAX_VERTICES * sizeof(struct vertex) <=
+             FIXED_PARTITION_SIZE(fence_partition), "fence_partition too small");
+#endif
+
+struct grid_cell {
+    uint16_t first;         // Into edge_refs
+    uint8_t count;          // Edges touching the cell
+    uint8_t flags;
+};
+
+struct fence {
+    struct fence_record rec;
+    int32_t cos_lat_q15;
+    uint16_t first_vertex;
+
+    // Polygon grid, in cm from the origin
+    uint8_t dim;            // dim x dim cells
+    uint16_t first_cell;
+    int32_t grid_x;
+    int32_t grid_y;
+    int32_t cell_w;
+    int32_t cell_h;
+
+    // Evaluation
+    bool known;             // Set from a fix since the last reindex
+    bool raw;               // Result for the last fix
+    bool inside;            // Debounced
+    bool dwelt;             // Dwell event sent for this visit
+    uint8_t pending;        // Fixes in a row that disagree with 'inside'
+    int16_t cell;           // Cell of the last fix, -1 = outside the grid
+    uint32_t entered_ms;
+};
+
+static struct fence fences[GEOFENCE_MAX_FENCES];
+static uint8_t fence_count;
+static struct vertex vertices[GEOFENCE_MAX_VERTICES];
+static uint16_t vertex_count;
+
+static struct grid_cell cells[GRID_MAX_CELLS];
+static uint16_t cell_count;
+static uint8_t edge_refs[GRID_MAX_EDGE_REFS];
+static uint16_t edge_ref_count;
+
+// Polygon being entered. Its vertices follow the committed ones.
+static bool building;
+static struct fence_record pending;
+static int32_t pending_cos_lat_q15;
+
+static struct geofence_status status;
+
+// Work done per fix, for the console
+static struct {
+    uint32_t fixes;
+    uint32_t skipped;       // Polygon tests answered without looking at an edge
+    uint32_t edges;         // Edge tests
+} work;
+
+static K_MUTEX_DEFINE(geofence_mutex);
+
+static const char *const event_names[] = {
+    [GEOFENCE_EVENT_ENTER] = "entered",
+    [GEOFENCE_EVENT_EXIT]  = "left",
+    [GEOFENCE_EVENT_DWELL] = "dwell time reached",
+};
+
+static struct geo_vec vertex_cm(const struct fence *f, uint8_t i)
+{
+    const struct vertex *v = &vertices[f->first_vertex + i];
+    struct geo_vec p = { v->x * 100, v->y * 100 };
+
+    return p;
+}
+
+static struct geo_vec sub(struct geo_vec a, struct geo_vec b)
+{
+    struct geo_vec d = { a.x - b.x, a.y - b.y };
+
+    return d;
+}
+
+// Even-odd test against every edge, casting a ray towards east
+static bool polygon_contains(const struct fence *f, struct geo_vec p)
+{
+    uint8_t n = f->rec.count;
+    struct geo_vec a = vertex_cm(f, n - 1);
+    bool inside = false;
+
+    for (uint8_t i = 0; i < n; i++) {
+        struct geo_vec b = vertex_cm(f, i);
+
+        if ((a.y > p.y) != (b.y > p.y) &&
+            (geo_cross(sub(b, a), sub(p, a)) > 0) == (b.y > a.y)) {
+            inside = !inside;
+        }
+        a = b;
+    }
+    return inside;
+}
+
+// True if segment cp crosses edge ab. A point on a line counts as being on
+// its negative side, so a vertex lying on cp is counted for exactly one of
+// its two edges.
+static bool crosses(struct geo_vec c, struct geo_vec p, struct geo_vec a, struct geo_vec b)
+{
+    struct geo_vec cp = sub(p, c);
+    struct geo_vec ab = sub(b, a);
+
+    if ((geo_cross(cp, sub(a, c)) > 0) == (geo_cross(cp, sub(b, c)) > 0)) {
+        return false;
+    }
+    return (geo_cross(ab, sub(c, a)) > 0) != (geo_cross(ab, sub(p, a)) > 0);
+}
+
+// Conservative: true if edge ab may touch the closed rectangle
+static bool edge_touches(struct geo_vec a, struct geo_vec b,
+                         int64_t x0, int64_t y0, int64_t x1, int64_t y1)
+{
+    struct geo_vec ab = sub(b, a);
+    const struct geo_vec corners[4] = { { x0, y0 }, { x1, y0 }, { x0, y1 }, { x1, y1 } };
+    int above = 0, below = 0;
+
+    if (MAX(a.x, b.x) < x0 || MIN(a.x, b.x) > x1 ||
+        MAX(a.y, b.y) < y0 || MIN(a.y, b.y) > y1) {
+        return false;
+    }
+
+    // Otherwise it misses only if all four corners are on one side of it
+    for (int i = 0; i < 4; i++) {
+        int64_t side = geo_cross(ab, sub(corners[i], a));
+
+        above += side > 0;
+        below += side < 0;
+    }
+    return above != 4 && below != 4;
+}
+
+// List the edges touching each cell of f's grid into the edge pool, as far
+// as it goes. Returns the number of references needed.
+static uint32_t index_cells(struct fence *f)
+{
+    uint8_t n = f->rec.count;
+    uint32_t refs = 0;
+
+    for (int cy = 0; cy < f->dim; cy++) {
+        for (int cx = 0; cx < f->dim; cx++) {
+            struct grid_cell *cell = &cells[f->first_cell + cy * f->dim + cx];
+            int64_t x0 = (int64_t)f->grid_x + cx * f->cell_w;
+            int64_t y0 = (int64_t)f->grid_y + cy * f->cell_h;
+            struct geo_vec centre = { x0 + f->cell_w / 2, y0 + f->cell_h / 2 };
+
+            cell->first = MIN(edge_ref_count + refs, GRID_MAX_EDGE_REFS);
+            cell->count = 0;
+            cell->flags = polygon_contains(f, centre) ? CELL_INSIDE : 0;
+
+            for (uint8_t e = 0; e < n; e++) {
+                struct geo_vec a = vertex_cm(f, e);
+                struct geo_vec b = vertex_cm(f, (e + 1) % n);
+
+                if (!edge_touches(a, b, x0, y0, x0 + f->cell_w, y0 + f->cell_h)) {
+                    continue;
+                }
+                // The crossing test needs the centre off every edge line
+                if (geo_cross(sub(b, a), sub(centre, a)) == 0) {
+                    cell->flags |= CELL_BRUTE;
+                }
+                if (edge_ref_count + refs < GRID_MAX_EDGE_REFS) {
+                    edge_refs[edge_ref_count + refs] = e;
+                }
+                refs++;
+                cell->count++;
+            }
+        }
+    }
+    return refs;
+}
+
+// Grid for polygon f, about sqrt(vertices) cells a side, coarser if the
+// pools are short. Called with geofence_mutex held.
+static int build_grid(struct fence *f)
+{
+    int32_t min_x = INT16_MAX, min_y = INT16_MAX;
+    int32_t max_x = INT16_MIN, max_y = INT16_MIN;
+    int dim = 1;
+
+    for (uint8_t i = 0; i < f->rec.count; i++) {
+        const struct vertex *v = &vertices[f->first_vertex + i];
+
+        min_x = MIN(min_x, v->x);
+        max_x = MAX(max_x, v->x);
+        min_y = MIN(min_y, v->y);
+        max_y = MAX(max_y, v->y);
+    }
+
+    while (dim * dim < f->rec.count && dim < GRID_MAX_DIM) {
+        dim++;
+    }
+
+    f->grid_x = min_x * 100;
+    f->grid_y = min_y * 100;
+    f->first_cell = cell_count;
+    for (; dim > 0; dim--) {
+        uint32_t refs;
+
+        if (cell_count + dim * dim > GRID_MAX_CELLS) {
+            continue;
+        }
+        // +1 so that the far edge of the bounding box is in the grid
+        f->dim = dim;
+        f->cell_w = DIV_ROUND_UP((max_x - min_x) * 100 + 1, dim);
+        f->cell_h = DIV_ROUND_UP((max_y - min_y) * 100 + 1, dim);
+        refs = index_cells(f);
+        if (edge_ref_count + refs <= GRID_MAX_EDGE_REFS) {
+            cell_count += dim * dim;
+            edge_ref_count += refs;
+            return 0;
+        }
+    }
+    f->dim = 0;
+    return -ENOMEM;
+}
+
+// Derived data and evaluation state for a fence whose record is set.
+// Called with geofence_mutex held.
+static int prepare(struct fence *f, uint16_t first_vertex)
+{
+    struct fence_record rec = f->rec;
+
+    memset(f, 0, sizeof(*f));
+    f->rec = rec;
+    f->cos_lat_q15 = geo_cos_lat_q15(rec.latitude);
+    f->first_vertex = first_vertex;
+    f->cell = -1;
+    if (rec.type == GEOFENCE_POLYGON) {
+        return build_grid(f);
+    }
+    return 0;
+}
+
+// Rebuild every index from the records, e.g. after a delete. Called with
+// geofence_mutex held.
+static int reindex(void)
+{
+    uint16_t first = 0;
+    int ret = 0;
+
+    cell_count = 0;
+    edge_ref_count = 0;
+    for (int i = 0; i < fence_count && ret == 0; i++) {
+        ret = prepare(&fences[i], first);
+        first += fences[i].rec.count;
+    }
+
+    status.count = fence_count;
+    status.inside = 0;
+    status.dwelling = 0;
+    return ret;
+}
+
+// Rewrite the store. Records and vertices go first and the header last, so
+// a save cut short by a reset reads back as no fences rather than bad ones.
+// Called with geofence_mutex held.
+static int save(void)
+{
+#if FIXED_PARTITION_EXISTS(fence_partition)
+    const struct flash_area *fa;
+    struct store_header header = {
+        .magic = FENCE_MAGIC,
+        .count = fence_count,
+        .vertices = vertex_count,
+        .reserved = UINT32_MAX,
+    };
+    off_t off = sizeof(header);
+    size_t len = vertex_count * sizeof(struct vertex);
+    int ret;
+
+    ret = flash_area_open(FENCE_PARTITION_ID, &fa);
+    if (ret != 0) {
+        return ret;
+    }
+
+    ret = flash_area_erase(fa, 0, fa->fa_size);
+    for (int i = 0; i < fence_count && ret == 0; i++) {
+        ret = flash_area_write(fa, off, &fences[i].rec, sizeof(fences[i].rec));
+        header.crc = crc32_ieee_update(header.crc, (uint8_t *)&fences[i].rec,
+                                       sizeof(fences[i].rec));
+        off += sizeof(fences[i].rec);
+    }
+    if (ret == 0 && len > 0) {
+        // Whole flash blocks, the tail past the last vertex is not read back
+        ret = flash_area_write(fa, off, vertices, ROUND_UP(len, 8));
+        header.crc = crc32_ieee_update(header.crc, (uint8_t *)vertices, len);
+    }
+    if (ret == 0) {
+        ret = flash_area_write(fa, 0, &header, sizeof(header));
+    }
+
+    flash_area_close(fa);
+    return ret;
+#else
+    // No partition (native_sim): fences last until reset
+    return 0;
+#endif
+}
+
+#if FIXED_PARTITION_EXISTS(fence_partition)
+// Called with geofence_mutex held
+static int load(void)
+{
+    const struct flash_area *fa;
+    struct store_header header;
+    uint16_t vertices_used = 0;
+    uint32_t crc = 0;
+    off_t off = sizeof(header);
+    int ret;
+
+    ret = flash_area_open(FENCE_PARTITION_ID, &fa);
+    if (ret != 0) {
+        return ret;
+    }
+
+    ret = flash_area_read(fa, 0, &header, sizeof(header));
+    if (ret != 0 || header.magic != FENCE_MAGIC) {
+        goto out;
+    }
+    if (header.count > GEOFENCE_MAX_FENCES || header.vertices > GEOFENCE_MAX_VERTICES) {
+        ret = -EBADMSG;
+        goto out;
+    }
+
+    for (int i = 0; i < header.count && ret == 0; i++) {
+        struct fence_record *rec = &fences[i].rec;
+
+        ret = flash_area_read(fa, off, rec, sizeof(*rec));
+        crc = crc32_ieee_update(crc, (uint8_t *)rec, sizeof(*rec));
+        off += sizeof(*rec);
+        if (rec->type == GEOFENCE_POLYGON && rec->count >= 3) {
+            vertices_used += rec->count;
+        } else if (rec->type != GEOFENCE_CIRCLE || rec->count != 0) {
+            ret = -EBADMSG;
+        }
+    }
+    if (ret == 0 && header.vertices > 0) {
+        ret = flash_area_read(fa, off, vertices, header.vertices * sizeof(struct vertex));
+        crc = crc32_ieee_update(crc, (uint8_t *)vertices,
+                                header.vertices * sizeof(struct vertex));
+    }
+    if (ret == 0 && (crc != header.crc || vertices_used != header.vertices)) {
+        ret = -EBADMSG;
+    }
+    if (ret == 0) {
+        fence_count = header.count;
+        vertex_count = header.vertices;
+    }
+
+out:
+    flash_area_close(fa);
+    return ret;
+}
+#endif
+
+int geofence_init(void)
+{
+    int ret = 0;
+
+    k_mutex_lock(&geofence_mutex, K_FOREVER);
+#if FIXED_PARTITION_EXISTS(fence_partition)
+    ret = load();
+#endif
+    if (ret == 0) {
+        ret = reindex();
+    }
+    if (ret != 0) {
+        fence_count = 0;
+        vertex_count = 0;
+        reindex();
+    }
+    k_mutex_unlock(&geofence_mutex);
+
+    if (ret == 0) {
+        LOG_INF("%u geofences, %u vertices, %u grid cells", fence_count, vertex_count,
+                cell_count);
+    } else {
+        LOG_WRN("Fence store unreadable (%d), starting with no fences", ret);
+    }
+    return ret;
+}
+
+// Whether p (cm from the fence origin) is inside f. Called with
+// geofence_mutex held.
+static bool evaluate(struct fence *f, struct geo_vec p)
+{
+    const struct grid_cell *cell;
+    struct geo_vec c;
+    int64_t dx, dy;
+    int16_t index;
+    bool inside;
+
+    if (f->rec.type == GEOFENCE_CIRCLE) {
+        int64_t r = (int64_t)f->rec.radius_m * 100;
+
+        return geo_dot(p, p) <= r * r;
+    }
+
+    dx = p.x - f->grid_x;
+    dy = p.y - f->grid_y;
+    if (dx < 0 || dy < 0 || dx >= (int64_t)f->cell_w * f->dim ||
+        dy >= (int64_t)f->cell_h * f->dim) {
+        f->cell = -1;
+        work.skipped++;
+        return false;
+    }
+
+    index = dy / f->cell_h * f->dim + dx / f->cell_w;
+    cell = &cells[f->first_cell + index];
+
+    // Still in a cell the boundary does not pass through
+    if (index == f->cell && cell->count == 0) {
+        work.skipped++;
+        return f->raw;
+    }
+    f->cell = index;
+
+    if (cell->flags & CELL_BRUTE) {
+        work.edges += f->rec.count;
+        return polygon_contains(f, p);
+    }
+
+    // Start from the centre and flip for each edge on the way to p
+    c.x = f->grid_x + (int64_t)(index % f->dim) * f->cell_w + f->cell_w / 2;
+    c.y = f->grid_y + (int64_t)(index / f->dim) * f->cell_h + f->cell_h / 2;
+    inside = cell->flags & CELL_INSIDE;
+    for (int i = 0; i < cell->count; i++) {
+        uint8_t e = edge_refs[cell->first + i];
+
+        if (crosses(c, p, vertex_cm(f, e), vertex_cm(f, (e + 1) % f->rec.count))) {
+            inside = !inside;
+        }
+    }
+    work.edges += cell->count;
+    if (cell->count == 0) {
+        work.skipped++;
+    }
+    return inside;
+}
+
+// Called with geofence_mutex held
+static void raise_event(uint8_t index, enum geofence_event event)
+{
+    status.events++;
+    status.last_event = event;
+    status.last_fence = index;
+    LOG_WRN("Fence %u (%s) %s", index + 1,
+            fences[index].rec.type == GEOFENCE_CIRCLE ? "circle" : "polygon",
+            event_names[event]);
+}
+
+void geofence_update(const struct gps_data *gps)
+{
+    uint32_t now = k_uptime_get_32();
+
+    k_mutex_lock(&geofence_mutex, K_FOREVER);
+    if (!gps->valid || fence_count == 0) {
+        goto out;
+    }
+    work.fixes++;
+
+    for (int i = 0; i < fence_count; i++) {
+        struct fence *f = &fences[i];
+        struct geo_vec p = geo_offset_cm(f->rec.latitude, f->rec.longitude, f->cos_lat_q15,
+                                         gps->latitude, gps->longitude);
+
+        f->raw = evaluate(f, p);
+
+        // The first fix only sets the state, so that adding a fence around
+        // the boat does not raise an event
+        if (!f->known) {
+            f->known = true;
+            f->inside = f->raw;
+            f->entered_ms = now;
+        } else if (f->raw == f->inside) {
+            f->pending = 0;
+        } else if (++f->pending >= GEOFENCE_DEBOUNCE_FIXES) {
+            f->pending = 0;
+            f->inside = f->raw;
+            f->dwelt = false;
+            f->entered_ms = now;
+            raise_event(i, f->inside ? GEOFENCE_EVENT_ENTER : GEOFENCE_EVENT_EXIT);
+        }
+
+        if (f->inside && !f->dwelt && f->rec.dwell_s != 0 &&
+            now - f->entered_ms >= f->rec.dwell_s * 1000U) {
+            f->dwelt = true;
+            raise_event(i, GEOFENCE_EVENT_DWELL);
+        }
+
+        WRITE_BIT(status.inside, i, f->inside);
+        WRITE_BIT(status.dwelling, i, f->inside && f->dwelt);
+    }
+
+out:
+    k_mutex_unlock(&geofence_mutex);
+}
+
+static void geofence_gps_cb(const struct zbus_channel *chan)
+{
+    geofence_update(zbus_chan_const_msg(chan));
+}
+
+ZBUS_LISTENER_DEFINE(geofence_gps_lis, geofence_gps_cb);
+ZBUS_CHAN_ADD_OBS(gps_chan, geofence_gps_lis, 2);
+
+void geofence_get_status(struct geofence_status *dest)
+{
+    k_mutex_lock(&geofence_mutex, K_FOREVER);
+    *dest = status;
+    k_mutex_unlock(&geofence_mutex);
+}
+
+int geofence_add_circle(int32_t latitude, int32_t longitude, uint32_t radius_m,
+                        uint16_t dwell_s)
+{
+    struct fence *f;
+    int ret;
+
+    if (latitude < -900000000 || latitude > 900000000 ||
+        longitude < -1800000000 || longitude > 1800000000 ||
+        radius_m == 0 || radius_m > MAX_RADIUS_M) {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&geofence_mutex, K_FOREVER);
+    if (fence_count == GEOFENCE_MAX_FENCES) {
+        ret = -ENOSPC;
+        goto out;
+    }
+
+    f = &fences[fence_count];
+    memset(&f->rec, 0, sizeof(f->rec));
+    f->rec.type = GEOFENCE_CIRCLE;
+    f->rec.dwell_s = dwell_s;
+    f->rec.latitude = latitude;
+    f->rec.longitude = longitude;
+    f->rec.radius_m = radius_m;
+    prepare(f, vertex_count);
+    ret = fence_count++;
+    status.count = fence_count;
+
+    if (save() != 0) {
+        LOG_ERR("Fence store write failed");
+    }
+
+out:
+    k_mutex_unlock(&geofence_mutex);
+    return ret;
+}
+
+int geofence_poly_begin(uint16_t dwell_s)
+{
+    k_mutex_lock(&geofence_mutex, K_FOREVER);
+    building = true;
+    memset(&pending, 0, sizeof(pending));
+    pending.type = GEOFENCE_POLYGON;
+    pending.dwell_s = dwell_s;
+    k_mutex_unlock(&geofence_mutex);
+    return 0;
+}
+
+int geofence_poly_add(int32_t latitude, int32_t longitude)
+{
+    struct geo_vec p;
+    int ret = 0;
+
+    if (latitude < -900000000 || latitude > 900000000 ||
+        longitude < -1800000000 || longitude > 1800000000) {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&geofence_mutex, K_FOREVER);
+    if (!building) {
+        ret = -EALREADY;
+        goto out;
+    }
+    if (pending.count == GEOFENCE_MAX_POLY_VERTICES ||
+        vertex_count + pending.count == GEOFENCE_MAX_VERTICES) {
+        ret = -ENOSPC;
+        goto out;
+    }
+
+    if (pending.count == 0) {
+        pending.latitude = latitude;
+        pending.longitude = longitude;
+        pending_cos_lat_q15 = geo_cos_lat_q15(latitude);
+    }
+
+    p = geo_offset_cm(pending.latitude, pending.longitude, pending_cos_lat_q15,
+                      latitude, longitude);
+    p.x = (p.x + (p.x < 0 ? -50 : 50)) / 100;
+    p.y = (p.y + (p.y < 0 ? -50 : 50)) / 100;
+    if (p.x < INT16_MIN || p.x > INT16_MAX || p.y < INT16_MIN || p.y > INT16_MAX) {
+        ret = -ERANGE;
+        goto out;
+    }
+
+    vertices[vertex_count + pending.count].x = p.x;
+    vertices[vertex_count + pending.count].y = p.y;
+    pending.count++;
+
+out:
+    k_mutex_unlock(&geofence_mutex);
+    return ret;
+}
+
+int geofence_poly_end(void)
+{
+    struct fence *f;
+    int ret;
+
+    k_mutex_lock(&geofence_mutex, K_FOREVER);
+    if (!building) {
+        ret = -EALREADY;
+        goto out;
+    }
+    if (pending.count < 3) {
+        ret = -EINVAL;
+        goto out;
+    }
+    if (fence_count == GEOFENCE_MAX_FENCES) {
+        ret = -ENOSPC;
+        goto out;
+    }
+
+    f = &fences[fence_count];
+    f->rec = pending;
+    ret = prepare(f, vertex_count);
+    if (ret != 0) {
+        goto out;
+    }
+    building = false;
+    vertex_count += pending.count;
+    ret = fence_count++;
+    status.count = fence_count;
+
+    if (save() != 0) {
+        LOG_ERR("Fence store write failed");
+    }
+
+out:
+    k_mutex_unlock(&geofence_mutex);
+    return ret;
+}
+
+int geofence_delete(uint8_t index)
+{
+    struct fence *f;
+    int ret;
+
+    k_mutex_lock(&geofence_mutex, K_FOREVER);
+    if (index >= fence_count) {
+        ret = -EINVAL;
+        goto out;
+    }
+
+    // Drops a polygon being entered, its vertices are about to move
+    building = false;
+    f = &fences[index];
+    memmove(&vertices[f->first_vertex], &vertices[f->first_vertex + f->rec.count],
+            (vertex_count - f->first_vertex - f->rec.count) * sizeof(struct vertex));
+    vertex_count -= f->rec.count;
+    memmove(f, f + 1, (fence_count - index - 1) * sizeof(*f));
+    fence_count--;
+
+    ret = reindex();
+    if (ret == 0) {
+        ret = save();
+    }
+
+out:
+    k_mutex_unlock(&geofence_mutex);
+    return ret;
+}
+
+int geofence_clear(void)
+{
+    int ret;
+
+    k_mutex_lock(&geofence_mutex, K_FOREVER);
+    building = false;
+    fence_count = 0;
+    vertex_count = 0;
+    reindex();
+    ret = save();
+    k_mutex_unlock(&geofence_mutex);
+    return ret;
+}
+
+// Console commands
+static void print_coord(int32_t e7)
+{
+    uint32_t abs = e7 < 0 ? -(int64_t)e7 : e7;
+
+    printk("%s%u.%07u", e7 < 0 ? "-" : "", abs / 10000000, abs % 10000000);
+}
+
+static int cmd_geofence(int argc, char **argv)
+{
+    struct geofence_status st;
+    uint32_t fixes, skipped, edges;
+    uint16_t vertex_used, cells_used, refs_used, pending_count;
+    bool entering;
+    int count;
+
+    k_mutex_lock(&geofence_mutex, K_FOREVER);
+    st = status;
+    count = fence_count;
+    vertex_used = vertex_count;
+    cells_used = cell_count;
+    refs_used = edge_ref_count;
+    entering = building;
+    pending_count = pending.count;
+    fixes = work.fixes;
+    skipped = work.skipped;
+    edges = work.edges;
+    k_mutex_unlock(&geofence_mutex);
+
+    printk("%d fences, %u/%u vertices, index %u/%u cells, %u/%u edge refs\n",
+           count, vertex_used, GEOFENCE_MAX_VERTICES, cells_used, GRID_MAX_CELLS,
+           refs_used, GRID_MAX_EDGE_REFS);
+
+    // One at a time, so the GNSS callback never waits for the console
+    for (int i = 0; i < count; i++) {
+        struct fence f;
+
+        k_mutex_lock(&geofence_mutex, K_FOREVER);
+        if (i >= fence_count) {
+            k_mutex_unlock(&geofence_mutex);
+            break;
+        }
+        f = fences[i];
+        k_mutex_unlock(&geofence_mutex);
+
+        printk(" %2d ", i + 1);
+        print_coord(f.rec.latitude);
+        printk(" ");
+        print_coord(f.rec.longitude);
+        if (f.rec.type == GEOFENCE_CIRCLE) {
+            printk(" circle %u m", f.rec.radius_m);
+        } else {
+            printk(" polygon %u vertices, %ux%u grid", f.rec.count, f.dim, f.dim);
+        }
+        if (f.rec.dwell_s != 0) {
+            printk(", dwell %u s", f.rec.dwell_s);
+        }
+        printk(": %s\n", !f.known ? "-" : f.inside ? "inside" : "outside");
+    }
+    if (entering) {
+        printk("Polygon being entered: %u vertices\n", pending_count);
+    }
+
+    if (fixes > 0) {
+        uint32_t per_fix = edges * 10 / fixes;
+
+        printk("%u fixes, %u polygon tests without edges, %u.%u edge tests per fix\n",
+               fixes, skipped, per_fix / 10, per_fix % 10);
+    }
+    printk("%u events\n", st.events);
+    return 0;
+}
+
+static int parse_dwell(int argc, char **argv, int index, uint16_t *dwell_s)
+{
+    int32_t value = 0;
+
+    if (argc > index && (cmd_parse_int(argv[index], &value) != 0 ||
+                         value < 0 || value > MAX_DWELL_S)) {
+        return -EINVAL;
+    }
+    *dwell_s = value;
+    return 0;
+}
+
+static int report_added(int ret)
+{
+    if (ret == -ENOSPC) {
+        printk("Error: no room for another fence\n");
+        return 0;
+    }
+    if (ret == -ENOMEM) {
+        printk("Error: no room for the grid index\n");
+        return 0;
+    }
+    if (ret >= 0) {
+        printk("Fence %d added\n", ret + 1);
+        return 0;
+    }
+    return ret;
+}
+
+static int cmd_geofence_circle(int argc, char **argv)
+{
+    int32_t latitude, longitude, radius;
+    uint16_t dwell_s;
+
+    if (cmd_parse_fixed(argv[0], 7, &latitude) != 0 ||
+        cmd_parse_fixed(argv[1], 7, &longitude) != 0 ||
+        cmd_parse_int(argv[2], &radius) != 0 || radius < 1 || radius > MAX_RADIUS_M ||
+        parse_dwell(argc, argv, 3, &dwell_s) != 0) {
+        return -EINVAL;
+    }
+    return report_added(geofence_add_circle(latitude, longitude, radius, dwell_s));
+}
+
+static int cmd_geofence_anchor(int argc, char **argv)
+{
+    struct gps_data gps;
+    int32_t radius;
+
+    if (cmd_parse_int(argv[0], &radius) != 0 || radius < 1 || radius > MAX_RADIUS_M) {
+        return -EINVAL;
+    }
+
+    if (!get_gps_data(&gps)) {
+        printk("Error: no fix\n");
+        return 0;
+    }
+    return report_added(geofence_add_circle(gps.latitude, gps.longitude, radius, 0));
+}
+
+static int cmd_geofence_poly(int argc, char **argv)
+{
+    uint16_t dwell_s;
+
+    if (parse_dwell(argc, argv, 0, &dwell_s) != 0) {
+        return -EINVAL;
+    }
+    return geofence_poly_begin(dwell_s);
+}
+
+static int cmd_geofence_point(int argc, char **argv)
+{
+    int32_t latitude, longitude;
+    int ret;
+
+    if (cmd_parse_fixed(argv[0], 7, &latitude) != 0 ||
+        cmd_parse_fixed(argv[1], 7, &longitude) != 0) {
+        return -EINVAL;
+    }
+
+    ret = geofence_poly_add(latitude, longitude);
+    if (ret == -EALREADY) {
+        printk("Error: start a polygon with 'geofence poly' first\n");
+        return 0;
+    }
+    if (ret == -ENOSPC) {
+        printk("Error: vertex store is full\n");
+        return 0;
+    }
+    if (ret == -ERANGE) {
+        printk("Error: more than 32 km from the first vertex\n");
+        return 0;
+    }
+    return ret;
+}
+
+static int cmd_geofence_end(int argc, char **argv)
+{
+    int ret = geofence_poly_end();
+
+    if (ret == -EALREADY) {
+        printk("Error: no polygon being entered\n");
+        return 0;
+    }
+    if (ret == -EINVAL) {
+        printk("Error: a polygon needs at least 3 vertices\n");
+        return 0;
+    }
+    return report_added(ret);
+}
+
+static int cmd_geofence_delete(int argc, char **argv)
+{
+    int32_t index;
+
+    if (cmd_parse_int(argv[0], &index) != 0 || index < 1 || index > GEOFENCE_MAX_FENCES) {
+        return -EINVAL;
+    }
+    return geofence_delete(index - 1);
+}
+
+static int cmd_geofence_clear(int argc, char **argv)
+{
+    return geofence_clear();
+}
+
+CMD_DEFINE(geofence, "geofence", "", "List fences and their state", cmd_geofence, 0, 0);
+CMD_DEFINE(geofence_circle, "geofence circle", "<lat> <lon> <radius m> [dwell s]",
+           "Add a circular fence", cmd_geofence_circle, 3, 4);
+CMD_DEFINE(geofence_anchor, "geofence anchor", "<radius m>",
+           "Add a circle around the current position", cmd_geofence_anchor, 1, 1);
+CMD_DEFINE(geofence_poly, "geofence poly", "[dwell s]",
+           "Start a polygon, add vertices with 'geofence point'", cmd_geofence_poly, 0, 1);
+CMD_DEFINE(geofence_point, "geofence point", "<lat> <lon>",
+           "Add a vertex to the polygon being entered", cmd_geofence_point, 2, 2);
+CMD_DEFINE(geofence_end, "geofence end", "", "Close the polygon and store it",
+           cmd_geofence_end, 0, 0);
+CMD_DEFINE(geofence_delete, "geofence delete", "<n>", "Delete fence n", cmd_geofence_delete,
+           1, 1);
+CMD_DEFINE(geofence_clear, "geofence clear", "", "Delete all fences", cmd_geofence_clear, 0, 0);
@@ -0,0 +1,75 @@
+#ifndef GEOFENCE_H
+#define GEOFENCE_H
+
+#include "data_handler.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Geofences: polygons (harbours, exclusion areas) and circles (anchor
+ * watch), with enter, exit and dwell events.
+ *
+ * Fences live on fence_partition in a compact format: a 16 byte record per
+ * fence and polygon vertices as int16 metres east/north of the fence
+ * origin, so a polygon spans at most ~32 km.
+ *
+ * Each polygon gets a uniform grid over its bounding box. A cell lists the
+ * edges that touch it and whether its centre is inside, so a fix only
+ * tests the segment from the cell centre against the edges of its own
+ * cell. Cells without edges are wholly inside or outside, and a fix that
+ * stays in such a cell costs nothing beyond finding the cell. Fixes
+ * outside the bounding box are rejected before any edge is looked at.
+ *
+ * A state change is only reported once it has held for
+ * GEOFENCE_DEBOUNCE_FIXES fixes, so GNSS noise on a boundary does not
+ * raise a stream of alarms.
+ */
+
+#define GEOFENCE_MAX_FENCES     16
+#define GEOFENCE_MAX_VERTICES   256
+#define GEOFENCE_MAX_POLY_VERTICES 255
+#define GEOFENCE_DEBOUNCE_FIXES 2
+
+enum geofence_type {
+    GEOFENCE_POLYGON = 1,
+    GEOFENCE_CIRCLE,
+};
+
+enum geofence_event {
+    GEOFENCE_EVENT_NONE,
+    GEOFENCE_EVENT_ENTER,
+    GEOFENCE_EVENT_EXIT,
+    GEOFENCE_EVENT_DWELL,   // Inside for the fence's dwell time
+};
+
+struct geofence_status {
+    uint8_t count;          // Fences defined
+    uint16_t inside;        // Bit n: inside fence n
+    uint16_t dwelling;      // Bit n: inside fence n for its dwell time
+    uint16_t events;        // Events since boot, wraps
+    uint8_t last_event;     // enum geofence_event
+    uint8_t last_fence;
+};
+
+// Load the fences from flash
+int geofence_init(void);
+
+// Feed a fix. Called by a listener on gps_chan for each published fix.
+void geofence_update(const struct gps_data *gps);
+
+void geofence_get_status(struct geofence_status *status);
+
+// Add a circle. dwell_s = 0: no dwell event. Returns the fence index.
+int geofence_add_circle(int32_t latitude, int32_t longitude, uint32_t radius_m,
+                        uint16_t dwell_s);
+
+// Build a polygon one vertex at a time, the first vertex is its origin.
+// geofence_poly_end() indexes and stores it and returns the fence index.
+int geofence_poly_begin(uint16_t dwell_s);
+int geofence_poly_add(int32_t latitude, int32_t longitude);
+int geofence_poly_end(void);
+
+int geofence_delete(uint8_t index);
+int geofence_clear(void);
+
+#endif // GEOFENCE_H
@@ -0,0 +1,198 @@
+#include "gnss_planner.h"
+#include "command_parser.h"
+#include "gps_config.h"
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/gnss.h>
+#include <zephyr/drivers/uart.h>
+#include <string.h>
+
+// Satellites per GSV sentence
+#define GSV_SATS_PER_SENTENCE   4
+
+// Epoch rate measured over this long
+#define RATE_WINDOW_MS          5000
+
+struct msg_cost {
+    uint32_t msg;
+    const char *name;
+    uint16_t bytes;         // Longest usual u-blox sentence with a fix
+};
+
+static const struct msg_cost msg_costs[] = {
+    { GPS_MSG_GGA, "gga", 74 },
+    { GPS_MSG_RMC, "rmc", 70 },
+    { GPS_MSG_VTG, "vtg", 38 },
+    { GPS_MSG_GSA, "gsa", 64 },
+    { GPS_MSG_GLL, "gll", 51 },
+    { GPS_MSG_GSV, "gsv", 70 },     // Per sentence
+};
+
+// Richest first. The NMEA driver only reports a fix once it has GGA and
+// RMC of the same epoch, so every plan has both.
+static const uint32_t plans[] = {
+    GPS_MSG_GGA | GPS_MSG_RMC | GPS_MSG_VTG | GPS_MSG_GSA | GPS_MSG_GSV | GPS_MSG_GLL,
+    GPS_MSG_GGA | GPS_MSG_RMC | GPS_MSG_VTG | GPS_MSG_GSA | GPS_MSG_GSV,
+    GPS_MSG_GGA | GPS_MSG_RMC | GPS_MSG_VTG,
+    GPS_MSG_GGA | GPS_MSG_RMC,
+};
+
+static const struct device *const gps_uart = DEVICE_DT_GET(DT_ALIAS(gps_usart));
+
+static uint8_t budget_pct = GNSS_DEFAULT_BUDGET_PCT;
+static uint16_t sats_in_view;       // Last satellites callback
+
+// Measured from the data callbacks, GNSS driver thread only
+static uint32_t window_start;
+static uint32_t window_epochs;
+static uint32_t last_epoch;         // ms
+static uint32_t epoch_mhz;          // Epochs per 1000 s over the last window
+static uint32_t overruns;
+static uint32_t rx_errors;          // Framing, parity and noise
+
+static uint32_t baud_rate(void)
+{
+    struct uart_config cfg;
+
+    if (uart_config_get(gps_uart, &cfg) == 0) {
+        return cfg.baudrate;
+    }
+    return DT_PROP(DT_ALIAS(gps_usart), current_speed);
+}
+
+// 8N1, ten bits per byte
+static uint32_t capacity(void)
+{
+    return baud_rate() / 10;
+}
+
+uint32_t gnss_plan_epoch_bytes(uint32_t msgs)
+{
+    uint32_t sats = MAX(sats_in_view, GNSS_PLAN_SATS);
+    uint32_t bytes = 0;
+
+    for (int i = 0; i < ARRAY_SIZE(msg_costs); i++) {
+        if (!(msgs & msg_costs[i].msg)) {
+            continue;
+        }
+        if (msg_costs[i].msg == GPS_MSG_GSV) {
+            bytes += DIV_ROUND_UP(sats, GSV_SATS_PER_SENTENCE) * msg_costs[i].bytes;
+        } else {
+            bytes += msg_costs[i].bytes;
+        }
+    }
+    return bytes;
+}
+
+uint32_t gnss_plan_budget(void)
+{
+    return capacity() * budget_pct / 100;
+}
+
+int gnss_plan_check(uint32_t msgs, int rate_hz)
+{
+    if (gnss_plan_epoch_bytes(msgs) * rate_hz > gnss_plan_budget()) {
+        return -ENOSPC;
+    }
+    return 0;
+}
+
+int gnss_plan_choose(int rate_hz, uint32_t *msgs)
+{
+    for (int i = 0; i < ARRAY_SIZE(plans); i++) {
+        if (gnss_plan_check(plans[i], rate_hz) == 0) {
+            *msgs = plans[i];
+            return 0;
+        }
+    }
+    return -ENOSPC;
+}
+
+static void planner_data_cb(const struct device *dev, const struct gnss_data *data)
+{
+    uint32_t now = k_uptime_get_32();
+    int err = uart_err_check(gps_uart);
+
+    // Sticky in the UART until read, so once per epoch catches them all
+    if (err > 0) {
+        if (err & UART_ERROR_OVERRUN) {
+            overruns++;
+        }
+        if (err & ~UART_ERROR_OVERRUN) {
+            rx_errors++;
+        }
+    }
+
+    last_epoch = now;
+    window_epochs++;
+    if (now - window_start >= RATE_WINDOW_MS) {
+        epoch_mhz = window_epochs * 1000000 / (now - window_start);
+        window_epochs = 0;
+        window_start = now;
+    }
+}
+
+GNSS_DATA_CALLBACK_DEFINE(DEVICE_DT_GET(DT_ALIAS(gnss)), planner_data_cb);
+
+static void planner_satellites_cb(const struct device *dev,
+                                  const struct gnss_satellite *satellites, uint16_t size)
+{
+    sats_in_view = size;
+}
+
+GNSS_SATELLITES_CALLBACK_DEFINE(DEVICE_DT_GET(DT_ALIAS(gnss)), planner_satellites_cb);
+
+// Console commands
+static void print_msgs(uint32_t msgs)
+{
+    for (int i = 0; i < ARRAY_SIZE(msg_costs); i++) {
+        if (msgs & msg_costs[i].msg) {
+            printk(" %s", msg_costs[i].name);
+        }
+    }
+    printk("\n");
+}
+
+static int cmd_gps_link(int argc, char **argv)
+{
+    uint32_t msgs = gps_get_messages();
+    uint32_t bytes = gnss_plan_epoch_bytes(msgs);
+    uint32_t cap = capacity();
+    uint32_t mhz = epoch_mhz;
+    uint32_t load;
+    int rate = gps_get_refresh_rate();
+
+    printk("Link %u baud, %u B/s, budget %u%% (%u B/s)\n", baud_rate(), cap, budget_pct,
+           gnss_plan_budget());
+    printk("Sentences:");
+    print_msgs(msgs);
+    printk("Per epoch %u B (%u satellites in view), at %d Hz %u B/s (%u%%)\n", bytes,
+           sats_in_view, rate, bytes * rate, bytes * rate * 100 / cap);
+
+    if (k_uptime_get_32() - last_epoch > 2 * MSEC_PER_SEC || mhz == 0) {
+        printk("Measured: no epochs\n");
+    } else {
+        load = bytes * mhz / 1000;
+        printk("Measured %u.%02u epochs/s, about %u B/s (%u%%)\n", mhz / 1000, mhz % 1000 / 10,
+               load, load * 100 / cap);
+    }
+    printk("UART overruns %u, other errors %u\n", overruns, rx_errors);
+    return 0;
+}
+
+static int cmd_gps_budget(int argc, char **argv)
+{
+    int32_t pct;
+
+    if (cmd_parse_int(argv[0], &pct) != 0 || pct < 10 || pct > 100) {
+        return -EINVAL;
+    }
+    budget_pct = pct;
+    return 0;
+}
+
+CMD_DEFINE(gps_link, "gps link", "", "Show GNSS link load against capacity", cmd_gps_link,
+           0, 0);
+CMD_DEFINE(gps_budget, "gps budget", "<percent>", "Share of the GNSS link to plan for",
+           cmd_gps_budget, 1, 1);
@@ -0,0 +1,39 @@
+#ifndef GNSS_PLANNER_H
+#define GNSS_PLANNER_H
+
+#include <stdint.h>
+
+/*
+ * GNSS link bandwidth planner.
+ *
+ * The receiver sends every enabled NMEA sentence each epoch, so what the
+ * UART has to carry is bytes per epoch times the rate. At the default
+ * 9600 baud (960 B/s) GGA and RMC alone come to about 1440 B/s at 10 Hz.
+ * The planner knows the size of each sentence (GSV per satellite in view)
+ * and checks rate and sentence changes against a share of the link
+ * capacity, the budget, before they are sent. "gps plan <hz>" sets a rate
+ * with the richest sentence set that fits, "gps link" compares the
+ * measured epoch rate, overruns and load with the capacity.
+ */
+
+// Share of the link capacity the receiver output may use, the rest is
+// margin for longer sentences, TXT messages and UBX acknowledgements
+#define GNSS_DEFAULT_BUDGET_PCT 75
+
+// GSV is sized for at least this many satellites in view
+#define GNSS_PLAN_SATS          12
+
+// Bytes per epoch of a GPS_MSG_* set with the satellites now in view
+uint32_t gnss_plan_epoch_bytes(uint32_t msgs);
+
+// Bytes per second the budget allows at the current baud rate
+uint32_t gnss_plan_budget(void);
+
+// 0 if msgs at rate_hz fits the budget, -ENOSPC if not
+int gnss_plan_check(uint32_t msgs, int rate_hz);
+
+// The richest sentence set that gives fixes and fits at rate_hz.
+// Returns -ENOSPC if not even GGA and RMC fit.
+int gnss_plan_choose(int rate_hz, uint32_t *msgs);
+
+#endif // GNSS_PLANNER_H
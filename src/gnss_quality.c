@@ -0,0 +1,169 @@
+#include "gnss_quality.h"
+#include "command_parser.h"
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <string.h>
+
+#define MAX_HDOP_LIMIT          99900   // milli
+
+// Indexed by bit number of enum gnss_system
+static const char system_letters[] = "GREBJISM";
+
+enum reject_reason {
+    REJECT_FIX_TYPE,
+    REJECT_SATS,
+    REJECT_HDOP,
+    REJECT_COUNT
+};
+
+static const char *const reject_names[REJECT_COUNT] = {
+    [REJECT_FIX_TYPE] = "fix type",
+    [REJECT_SATS]     = "sats",
+    [REJECT_HDOP]     = "hdop",
+};
+
+static struct gnss_sat sats[GNSS_MAX_SATS];
+static uint8_t sat_count;
+static uint32_t sats_time;              // ms, last satellites callback
+
+static uint32_t max_hdop = GNSS_DEFAULT_MAX_HDOP;
+static uint16_t min_sats = GNSS_DEFAULT_MIN_SATS;
+static struct gnss_info last_info;      // Last fix offered, accepted or not
+static uint32_t accepted;
+static uint32_t rejected[REJECT_COUNT];
+
+static K_MUTEX_DEFINE(quality_mutex);
+
+bool gnss_quality_accept(const struct gnss_info *info)
+{
+    int reason = -1;
+
+    k_mutex_lock(&quality_mutex, K_FOREVER);
+    last_info = *info;
+
+    // The receiver's own dead reckoning is no better than ours
+    if (info->fix_status == GNSS_FIX_STATUS_NO_FIX ||
+        info->fix_status == GNSS_FIX_STATUS_ESTIMATED_FIX ||
+        info->fix_quality == GNSS_FIX_QUALITY_INVALID ||
+        info->fix_quality == GNSS_FIX_QUALITY_ESTIMATED) {
+        reason = REJECT_FIX_TYPE;
+    } else if (info->satellites_cnt < min_sats) {
+        reason = REJECT_SATS;
+    } else if (info->hdop > max_hdop) {
+        // An empty GGA HDOP field reads as 0 and passes
+        reason = REJECT_HDOP;
+    }
+
+    if (reason < 0) {
+        accepted++;
+    } else {
+        rejected[reason]++;
+    }
+    k_mutex_unlock(&quality_mutex);
+
+    return reason < 0;
+}
+
+int gnss_quality_get_sats(struct gnss_sat *dest, int max)
+{
+    int count;
+
+    k_mutex_lock(&quality_mutex, K_FOREVER);
+    count = MIN(max, sat_count);
+    memcpy(dest, sats, count * sizeof(*dest));
+    k_mutex_unlock(&quality_mutex);
+    return count;
+}
+
+// One call per epoch with every satellite in view
+static void gnss_satellites_cb(const struct device *dev, const struct gnss_satellite *satellites,
+                               uint16_t size)
+{
+    k_mutex_lock(&quality_mutex, K_FOREVER);
+    sat_count = MIN(size, GNSS_MAX_SATS);
+    for (int i = 0; i < sat_count; i++) {
+        const struct gnss_satellite *s = &satellites[i];
+
+        sats[i].system = find_lsb_set(s->system) - 1;
+        sats[i].prn = s->prn;
+        sats[i].cn0 = s->snr;
+        sats[i].elevation = s->elevation;
+        sats[i].flags = (s->is_tracked ? GNSS_SAT_TRACKED : 0) |
+                        (s->is_corrected ? GNSS_SAT_CORRECTED : 0);
+    }
+    sats_time = k_uptime_get_32();
+    k_mutex_unlock(&quality_mutex);
+}
+
+GNSS_SATELLITES_CALLBACK_DEFINE(DEVICE_DT_GET(DT_ALIAS(gnss)), gnss_satellites_cb);
+
+// Console commands
+static int cmd_sats(int argc, char **argv)
+{
+    struct gnss_sat list[GNSS_MAX_SATS];
+    uint32_t counts[REJECT_COUNT];
+    struct gnss_info info;
+    uint32_t ok, hdop_gate, age;
+    uint16_t sats_gate;
+    int count;
+
+    k_mutex_lock(&quality_mutex, K_FOREVER);
+    info = last_info;
+    ok = accepted;
+    memcpy(counts, rejected, sizeof(counts));
+    hdop_gate = max_hdop;
+    sats_gate = min_sats;
+    count = sat_count;
+    memcpy(list, sats, count * sizeof(list[0]));
+    age = k_uptime_get_32() - sats_time;
+    k_mutex_unlock(&quality_mutex);
+
+    printk("Last fix: status %d, quality %d, %u sats, HDOP %u.%02u\n", info.fix_status,
+           info.fix_quality, info.satellites_cnt, info.hdop / 1000, info.hdop % 1000 / 10);
+    printk("Gate: HDOP <= %u.%u, >= %u sats\n", hdop_gate / 1000, hdop_gate % 1000 / 100,
+           sats_gate);
+    printk("Accepted %u, rejected:", ok);
+    for (int i = 0; i < REJECT_COUNT; i++) {
+        printk(" %s %u", reject_names[i], counts[i]);
+    }
+    printk("\n");
+
+    if (count == 0) {
+        printk("No satellites in view reported (gps msg gsv on)\n");
+        return 0;
+    }
+
+    printk("%d in view, %u ms ago\n  sys prn elev cn0 trk\n", count, age);
+    for (int i = 0; i < count; i++) {
+        const struct gnss_sat *s = &list[i];
+
+        printk("   %c  %3u  %3u %3u  %c%c\n",
+               s->system < sizeof(system_letters) - 1 ? system_letters[s->system] : '?',
+               s->prn, s->elevation, s->cn0,
+               (s->flags & GNSS_SAT_TRACKED) ? '*' : ' ',
+               (s->flags & GNSS_SAT_CORRECTED) ? 'c' : ' ');
+    }
+    return 0;
+}
+
+static int cmd_sats_gate(int argc, char **argv)
+{
+    int32_t hdop, sats_needed;
+
+    if (cmd_parse_fixed(argv[0], 3, &hdop) != 0 || hdop <= 0 || hdop > MAX_HDOP_LIMIT ||
+        cmd_parse_int(argv[1], &sats_needed) != 0 || sats_needed < 0 ||
+        sats_needed > GNSS_MAX_SATS) {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&quality_mutex, K_FOREVER);
+    max_hdop = hdop;
+    min_sats = sats_needed;
+    k_mutex_unlock(&quality_mutex);
+    return 0;
+}
+
+CMD_DEFINE(sats, "sats", "", "Show satellites in view and the fix quality gate", cmd_sats, 0, 0);
+CMD_DEFINE(sats_gate, "sats gate", "<max hdop> <min sats>",
+           "Set the fix acceptance thresholds", cmd_sats_gate, 2, 2);
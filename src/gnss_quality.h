@@ -0,0 +1,42 @@
+#ifndef GNSS_QUALITY_H
+#define GNSS_QUALITY_H
+
+#include <zephyr/drivers/gnss.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * GNSS fix quality: the satellites in view and the gate every fix has to
+ * pass before it reaches data_handler and the consumers behind it (nav,
+ * geofence, dead reckoning, track, telemetry).
+ *
+ * The satellite table is filled from the driver's satellites callback,
+ * i.e. from GSV sentences ("gps msg gsv on"), and replaced each epoch.
+ * Fixes are gated on fix type, satellites used and HDOP, with the
+ * thresholds set from the console ("sats gate").
+ */
+
+#define GNSS_MAX_SATS           32
+
+#define GNSS_DEFAULT_MAX_HDOP   5000    // milli
+#define GNSS_DEFAULT_MIN_SATS   5
+
+#define GNSS_SAT_TRACKED        BIT(0)
+#define GNSS_SAT_CORRECTED      BIT(1)
+
+struct gnss_sat {
+    uint8_t system;         // Bit number of enum gnss_system
+    uint8_t prn;
+    uint8_t cn0;            // dB-Hz
+    uint8_t elevation;      // degrees
+    uint8_t flags;          // GNSS_SAT_*
+};
+
+// True if a fix with this info should be used. Counts the rejections by
+// reason for the "sats" command.
+bool gnss_quality_accept(const struct gnss_info *info);
+
+// Copy out up to 'max' satellites from the last epoch, returns the count
+int gnss_quality_get_sats(struct gnss_sat *sats, int max);
+
+#endif // GNSS_QUALITY_H
@@ -1,9 +1,16 @@
 #include "gps_config.h"
+#include "boot.h"
+#include "command_parser.h"
+#include "gnss_planner.h"
+#include "supervisor.h"
+#include "ubx.h"
 #include <zephyr/kernel.h>
 #include <zephyr/device.h>
 #include <zephyr/drivers/uart.h>
 #include <zephyr/devicetree.h>
+#include <zephyr/sys/atomic.h>
 #include <stdio.h>
+#include <string.h>
 
 // UBX command definitions
 static const uint8_t ubx_set_1hz[] = {
@@ -32,6 +39,48 @@ static const uint8_t ubx_save_config[] = {
     0x17, 0x31, 0xBF
 };
 
+// NMEA message classes and IDs
+#define NMEA_CLASS 0xF0
+
+#define NMEA_GGA 0x00  // GPS fix data
+#define NMEA_GLL 0x01  // Geographic position
+#define NMEA_GSA 0x02  // GPS DOP and active satellites
+#define NMEA_GSV 0x03  // GPS satellites in view
+#define NMEA_RMC 0x04  // Recommended minimum data
+#define NMEA_VTG 0x05  // Course over ground and ground speed
+#define NMEA_GRS 0x06  // GPS range residuals
+#define NMEA_GST 0x07  // GPS pseudorange error statistics
+#define NMEA_ZDA 0x08  // Time and date
+#define NMEA_GBS 0x09  // GPS satellite fault detection
+#define NMEA_DTM 0x0A  // Datum reference
+#define NMEA_GNS 0x0D  // GNSS fix data
+#define NMEA_THS 0x0E  // True heading and status
+#define NMEA_VLW 0x0F  // Dual ground/water distance
+
+// The NMEA sentences tracked in nmea_msgs
+#define NMEA_TRACKED (GPS_MSG_GGA | GPS_MSG_GLL | GPS_MSG_GSA | GPS_MSG_GSV | \
+                      GPS_MSG_RMC | GPS_MSG_VTG)
+
+// Receiver state as last configured, u-blox defaults at power up
+static atomic_t nmea_msgs = ATOMIC_INIT(NMEA_TRACKED);
+static int refresh_hz = 1;
+
+// One UBX sequence at a time on the GNSS UART: boot configuration, console
+// commands and the supervisor's recovery. Recursive, so a sequence holds it
+// across the single messages it sends.
+static K_MUTEX_DEFINE(ubx_mutex);
+
+// Every UBX frame goes out through here, whole and under ubx_mutex, so the
+// supervisor's recovery and the console can never interleave their bytes
+static void ubx_send(const struct device *uart, const uint8_t *frame, size_t len)
+{
+    k_mutex_lock(&ubx_mutex, K_FOREVER);
+    for (size_t i = 0; i < len; i++) {
+        uart_poll_out(uart, frame[i]);
+    }
+    k_mutex_unlock(&ubx_mutex);
+}
+
 void gps_set_refresh_rate(int hz)
 {
     const struct device *uart = DEVICE_DT_GET(DT_ALIAS(gps_usart));
@@ -64,11 +113,15 @@ void gps_set_refresh_rate(int hz)
     
     printk("Setting GPS refresh rate to %dHz...\n", hz);
     
-    for (int i = 0; i < cmd_len; i++) {
-        uart_poll_out(uart, cmd[i]);
-    }
+    k_mutex_lock(&ubx_mutex, K_FOREVER);
+    ubx_send(uart, cmd, cmd_len);
     
     k_sleep(K_MSEC(100));
+    refresh_hz = hz;
+    k_mutex_unlock(&ubx_mutex);
+    // Receiver output now comes this often
+    supervisor_set_period(SUP_GNSS, 1000 / hz);
+    supervisor_set_period(SUP_GNSS_FIX, 1000 / hz);
     printk("GPS refresh rate set to %dHz\n", hz);
 }
 
@@ -83,31 +136,14 @@ void gps_save_config(void)
     
     printk("Saving GPS configuration to flash...\n");
     
-    for (int i = 0; i < sizeof(ubx_save_config); i++) {
-        uart_poll_out(uart, ubx_save_config[i]);
-    }
+    k_mutex_lock(&ubx_mutex, K_FOREVER);
+    ubx_send(uart, ubx_save_config, sizeof(ubx_save_config));
     
     k_sleep(K_MSEC(500));
+    k_mutex_unlock(&ubx_mutex);
     printk("GPS configuration saved\n");
 }
 
-// Helper function to calculate UBX checksum
-static void ubx_add_checksum(uint8_t *msg, int len)
-{
-    uint8_t ck_a = 0, ck_b = 0;
-    
-    // Calculate checksum over message (skip sync chars and checksum bytes)
-    for (int i = 2; i < len - 2; i++) {
-        ck_a += msg[i];
-        ck_b += ck_a;
-    }
-    
-    msg[len - 2] = ck_a;
-    msg[len - 1] = ck_b;
-}
-
-// UBX-CFG-MSG: Configure message rate for a specific NMEA sentence
-// Format: B5 62 06 01 08 00 [CLASS] [ID] [rates for 6 ports] [checksum]
 static void gps_set_message_rate(uint8_t msg_class, uint8_t msg_id, uint8_t rate)
 {
     const struct device *uart = DEVICE_DT_GET(DT_ALIAS(gps_usart));
@@ -117,52 +153,29 @@ static void gps_set_message_rate(uint8_t msg_class, uint8_t msg_id, uint8_t rate
         return;
     }
     
-    uint8_t cmd[] = {
-        0xB5, 0x62,     // Header
-        0x06, 0x01,     // Class CFG, ID MSG
-        0x08, 0x00,     // Length (8 bytes)
-        msg_class,      // Message class
-        msg_id,         // Message ID
-        0x00,           // Rate on I2C
-        rate,           // Rate on UART1 (0 = off, 1 = every solution)
-        0x00,           // Rate on UART2
-        0x00,           // Rate on USB
-        0x00,           // Rate on SPI
-        0x00,           // Reserved
-        0x00, 0x00      // Checksum (will be calculated)
-    };
-    
-    ubx_add_checksum(cmd, sizeof(cmd));
-    
-    for (int i = 0; i < sizeof(cmd); i++) {
-        uart_poll_out(uart, cmd[i]);
+    uint8_t cmd[UBX_CFG_MSG_LEN];
+    size_t len = ubx_build_cfg_msg(cmd, msg_class, msg_id, rate);
+    
+    k_mutex_lock(&ubx_mutex, K_FOREVER);
+    ubx_send(uart, cmd, len);
+    
+    if (msg_class == NMEA_CLASS && msg_id < 32) {
+        if (rate != 0) {
+            atomic_or(&nmea_msgs, BIT(msg_id));
+        } else {
+            atomic_and(&nmea_msgs, ~BIT(msg_id));
+        }
     }
     
     k_sleep(K_MSEC(50));
+    k_mutex_unlock(&ubx_mutex);
 }
 
-// NMEA message classes and IDs
-#define NMEA_CLASS 0xF0
-
-#define NMEA_GGA 0x00  // GPS fix data
-#define NMEA_GLL 0x01  // Geographic position
-#define NMEA_GSA 0x02  // GPS DOP and active satellites
-#define NMEA_GSV 0x03  // GPS satellites in view
-#define NMEA_RMC 0x04  // Recommended minimum data
-#define NMEA_VTG 0x05  // Course over ground and ground speed
-#define NMEA_GRS 0x06  // GPS range residuals
-#define NMEA_GST 0x07  // GPS pseudorange error statistics
-#define NMEA_ZDA 0x08  // Time and date
-#define NMEA_GBS 0x09  // GPS satellite fault detection
-#define NMEA_DTM 0x0A  // Datum reference
-#define NMEA_GNS 0x0D  // GNSS fix data
-#define NMEA_THS 0x0E  // True heading and status
-#define NMEA_VLW 0x0F  // Dual ground/water distance
-
 // Preset configurations
 void gps_disable_all_messages(void)
 {
     printk("Disabling all NMEA messages...\n");
+    k_mutex_lock(&ubx_mutex, K_FOREVER);
     
     gps_set_message_rate(NMEA_CLASS, NMEA_GGA, 0);
     gps_set_message_rate(NMEA_CLASS, NMEA_GLL, 0);
@@ -175,6 +188,7 @@ void gps_disable_all_messages(void)
     gps_set_message_rate(NMEA_CLASS, NMEA_ZDA, 0);
     gps_set_message_rate(NMEA_CLASS, NMEA_GBS, 0);
     gps_set_message_rate(NMEA_CLASS, NMEA_DTM, 0);
+    k_mutex_unlock(&ubx_mutex);
     
     printk("All NMEA messages disabled\n");
 }
@@ -182,12 +196,14 @@ void gps_disable_all_messages(void)
 void gps_enable_minimal_messages(void)
 {
     printk("Enabling minimal NMEA messages (RMC only)...\n");
+    k_mutex_lock(&ubx_mutex, K_FOREVER);
     
     // Disable all
     gps_disable_all_messages();
     
     // Enable only RMC (recommended minimum - has position, speed, time)
     gps_set_message_rate(NMEA_CLASS, NMEA_RMC, 1);
+    k_mutex_unlock(&ubx_mutex);
     
     printk("Minimal messages enabled (RMC)\n");
 }
@@ -195,6 +211,7 @@ void gps_enable_minimal_messages(void)
 void gps_enable_standard_messages(void)
 {
     printk("Enabling standard NMEA messages...\n");
+    k_mutex_lock(&ubx_mutex, K_FOREVER);
     
     // Disable all first
     gps_disable_all_messages();
@@ -203,6 +220,7 @@ void gps_enable_standard_messages(void)
     gps_set_message_rate(NMEA_CLASS, NMEA_GGA, 1);  // Position fix
     gps_set_message_rate(NMEA_CLASS, NMEA_RMC, 1);  // Recommended minimum
     gps_set_message_rate(NMEA_CLASS, NMEA_VTG, 1);  // Speed/course
+    k_mutex_unlock(&ubx_mutex);
     
     printk("Standard messages enabled (GGA, RMC, VTG)\n");
 }
@@ -210,6 +228,7 @@ void gps_enable_standard_messages(void)
 void gps_enable_all_messages(void)
 {
     printk("Enabling all NMEA messages...\n");
+    k_mutex_lock(&ubx_mutex, K_FOREVER);
     
     gps_set_message_rate(NMEA_CLASS, NMEA_GGA, 1);
     gps_set_message_rate(NMEA_CLASS, NMEA_GLL, 1);
@@ -217,6 +236,7 @@ void gps_enable_all_messages(void)
     gps_set_message_rate(NMEA_CLASS, NMEA_GSV, 1);
     gps_set_message_rate(NMEA_CLASS, NMEA_RMC, 1);
     gps_set_message_rate(NMEA_CLASS, NMEA_VTG, 1);
+    k_mutex_unlock(&ubx_mutex);
     
     printk("All main NMEA messages enabled\n");
 }
@@ -246,6 +266,196 @@ void gps_set_gll(bool enable) {
     gps_set_message_rate(NMEA_CLASS, NMEA_GLL, enable ? 1 : 0); 
 }
 
+void gps_set_messages(uint32_t msgs)
+{
+    k_mutex_lock(&ubx_mutex, K_FOREVER);
+    for (uint8_t id = NMEA_GGA; id <= NMEA_VTG; id++) {
+        gps_set_message_rate(NMEA_CLASS, id, (msgs & BIT(id)) ? 1 : 0);
+    }
+    k_mutex_unlock(&ubx_mutex);
+}
+
+uint32_t gps_get_messages(void)
+{
+    return atomic_get(&nmea_msgs);
+}
+
+int gps_get_refresh_rate(void)
+{
+    return refresh_hz;
+}
+
+void gps_restore_config(void)
+{
+    // Sentences first, a reset receiver sends all of them at 1 Hz
+    k_mutex_lock(&ubx_mutex, K_FOREVER);
+    gps_set_messages(atomic_get(&nmea_msgs));
+    gps_set_refresh_rate(refresh_hz);
+    k_mutex_unlock(&ubx_mutex);
+}
+
+// Console commands
+
+// UBX frames from the console would interleave with the boot configuration
+static bool boot_config_done(void)
+{
+    if (boot_wait(BOOT_STAGE_GNSS_CONFIG, K_SECONDS(3)) == -EAGAIN) {
+        printk("GNSS configuration still running, try again\n");
+        return false;
+    }
+    return true;
+}
+
+// Refuse a rate and sentence set the receiver could not send in time
+static bool link_fits(uint32_t msgs, int rate)
+{
+    if (gnss_plan_check(msgs, rate) == 0) {
+        return true;
+    }
+    printk("Needs %u B/s at %d Hz, the link budget is %u B/s (see \"gps link\", \"gps plan\")\n",
+           gnss_plan_epoch_bytes(msgs) * rate, rate, gnss_plan_budget());
+    return false;
+}
+
+static int cmd_gps_refresh(int argc, char **argv)
+{
+    int32_t rate;
+    
+    if (cmd_parse_int(argv[0], &rate) != 0 ||
+        (rate != 1 && rate != 5 && rate != 10)) {
+        return -EINVAL;
+    }
+    if (!boot_config_done() || !link_fits(gps_get_messages(), rate)) {
+        return 0;
+    }
+    gps_set_refresh_rate(rate);
+    return 0;
+}
+
+static int cmd_gps_save(int argc, char **argv)
+{
+    if (!boot_config_done()) {
+        return 0;
+    }
+    gps_save_config();
+    return 0;
+}
+
+static const struct {
+    const char *name;
+    uint32_t msg;
+    void (*set)(bool enable);
+} gps_messages[] = {
+    { "gga", GPS_MSG_GGA, gps_set_gga },
+    { "rmc", GPS_MSG_RMC, gps_set_rmc },
+    { "vtg", GPS_MSG_VTG, gps_set_vtg },
+    { "gsa", GPS_MSG_GSA, gps_set_gsa },
+    { "gsv", GPS_MSG_GSV, gps_set_gsv },
+    { "gll", GPS_MSG_GLL, gps_set_gll },
+};
+
+static int cmd_gps_msg(int argc, char **argv)
+{
+    bool enable;
+    
+    if (cmd_parse_on_off(argv[1], &enable) != 0) {
+        return -EINVAL;
+    }
+    if (!boot_config_done()) {
+        return 0;
+    }
+    
+    for (int i = 0; i < ARRAY_SIZE(gps_messages); i++) {
+        if (strcmp(argv[0], gps_messages[i].name) == 0) {
+            if (enable && !link_fits(gps_get_messages() | gps_messages[i].msg,
+                                     gps_get_refresh_rate())) {
+                return 0;
+            }
+            gps_messages[i].set(enable);
+            printk("GPS %s %s\n", gps_messages[i].name, enable ? "enabled" : "disabled");
+            return 0;
+        }
+    }
+    return -EINVAL;
+}
+
+static const struct {
+    const char *name;
+    uint32_t msgs;
+    void (*apply)(void);
+} gps_presets[] = {
+    { "none",     0,                                         gps_disable_all_messages },
+    { "minimal",  GPS_MSG_RMC,                               gps_enable_minimal_messages },
+    { "standard", GPS_MSG_GGA | GPS_MSG_RMC | GPS_MSG_VTG,   gps_enable_standard_messages },
+    { "all",      GPS_MSG_GGA | GPS_MSG_GLL | GPS_MSG_GSA | GPS_MSG_GSV | GPS_MSG_RMC |
+                  GPS_MSG_VTG,                               gps_enable_all_messages },
+};
+
+static int cmd_gps_preset(int argc, char **argv)
+{
+    for (int i = 0; i < ARRAY_SIZE(gps_presets); i++) {
+        if (strcmp(argv[0], gps_presets[i].name) != 0) {
+            continue;
+        }
+        if (!boot_config_done() || !link_fits(gps_presets[i].msgs, gps_get_refresh_rate())) {
+            return 0;
+        }
+        gps_presets[i].apply();
+        return 0;
+    }
+    return -EINVAL;
+}
+
+static int cmd_gps_plan(int argc, char **argv)
+{
+    uint32_t msgs;
+    int32_t rate;
+
+    if (cmd_parse_int(argv[0], &rate) != 0 ||
+        (rate != 1 && rate != 5 && rate != 10)) {
+        return -EINVAL;
+    }
+    if (!boot_config_done()) {
+        return 0;
+    }
+    if (gnss_plan_choose(rate, &msgs) != 0) {
+        printk("%d Hz does not fit: GGA and RMC need %u B/s, the link budget is %u B/s\n",
+               rate, gnss_plan_epoch_bytes(GPS_MSG_GGA | GPS_MSG_RMC) * rate,
+               gnss_plan_budget());
+        return 0;
+    }
+
+    printk("Plan for %d Hz:", rate);
+    for (int i = 0; i < ARRAY_SIZE(gps_messages); i++) {
+        if (msgs & gps_messages[i].msg) {
+            printk(" %s", gps_messages[i].name);
+        }
+    }
+    printk("\n");
+
+    // Never more than the link carries on the way: fewer sentences
+    // before a faster rate, a slower rate before more sentences
+    k_mutex_lock(&ubx_mutex, K_FOREVER);
+    if (rate > gps_get_refresh_rate()) {
+        gps_set_messages(msgs);
+        gps_set_refresh_rate(rate);
+    } else {
+        gps_set_refresh_rate(rate);
+        gps_set_messages(msgs);
+    }
+    k_mutex_unlock(&ubx_mutex);
+    return 0;
+}
+
+CMD_DEFINE(gps_refresh, "gps refresh", "<1|5|10>", "Set GPS update rate (Hz)", cmd_gps_refresh, 1, 1);
+CMD_DEFINE(gps_save, "gps save", "", "Save GPS config to flash", cmd_gps_save, 0, 0);
+CMD_DEFINE(gps_msg, "gps msg", "<gga|rmc|vtg|gsa|gsv|gll> <on|off>",
+           "Enable/disable one NMEA sentence", cmd_gps_msg, 2, 2);
+CMD_DEFINE(gps_preset, "gps preset", "<none|minimal|standard|all>",
+           "Apply an NMEA sentence preset", cmd_gps_preset, 1, 1);
+CMD_DEFINE(gps_plan, "gps plan", "<1|5|10>",
+           "Set a rate with the most NMEA sentences the link carries", cmd_gps_plan, 1, 1);
+
 // // Set UART baud rate to 38400
 // static const uint8_t ubx_set_baud_38400[] = {
 //     0xB5, 0x62,     // Header
@@ -273,9 +483,7 @@ void gps_set_gll(bool enable) {
     
 //     printk("Setting GPS UART to 38400 baud...\n");
     
-//     for (int i = 0; i < sizeof(ubx_set_baud_38400); i++) {
-//         uart_poll_out(uart, ubx_set_baud_38400[i]);
-//     }
+//     ubx_send(uart, ubx_set_baud_38400, sizeof(ubx_set_baud_38400));
     
 //     k_sleep(K_MSEC(100));
 // }
\ No newline at end of file
@@ -2,6 +2,15 @@
 #define GPS_CONFIG_H
 
 #include <stdbool.h>
+#include <stdint.h>
+
+// NMEA sentences, bit per UBX NMEA message ID
+#define GPS_MSG_GGA     (1U << 0x00)
+#define GPS_MSG_GLL     (1U << 0x01)
+#define GPS_MSG_GSA     (1U << 0x02)
+#define GPS_MSG_GSV     (1U << 0x03)
+#define GPS_MSG_RMC     (1U << 0x04)
+#define GPS_MSG_VTG     (1U << 0x05)
 
 // Refresh rate control
 void gps_set_refresh_rate(int hz);
@@ -21,6 +30,16 @@ void gps_set_gsa(bool enable);  // Satellites used
 void gps_set_gsv(bool enable);  // Satellites in view
 void gps_set_gll(bool enable);  // Geographic position
 
+// Enable exactly the GPS_MSG_* sentences in msgs
+void gps_set_messages(uint32_t msgs);
+
+// What the receiver was last told, its factory defaults until then
+uint32_t gps_get_messages(void);
+int gps_get_refresh_rate(void);
+
+// Send the last rate and sentence set again, e.g. after a receiver reset
+void gps_restore_config(void);
+
 // // Sets baud to 38400
 // void gps_set_baud_38400();      
 
@@ -0,0 +1,502 @@
+#include "history.h"
+#include "command_parser.h"
+#include "data_handler.h"
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+#include <errno.h>
+#include <string.h>
+
+#define TIER_COUNT              3
+#define TIER_SLOTS_TOTAL        (60 + 60 + 24)
+
+// Angles are kept in 0.1 degrees
+#define FULL_TURN               3600
+#define HALF_TURN               1800
+
+struct channel_desc {
+    const char *name;
+    const char *unit;
+    uint8_t decimals;
+    bool angular;
+};
+
+struct tier_desc {
+    const char *name;
+    uint32_t period_ms;
+    uint16_t slots;
+    uint16_t offset;        // Of its first slot in buckets[]
+};
+
+// A closed bucket, in the channel's units. The extremes are offsets from
+// the mean, so that an angle's range survives a turn of more than half a
+// circle. empty_bucket for a period without samples.
+struct bucket {
+    int16_t below;          // min - mean, <= 0
+    int16_t above;          // max - mean, >= 0
+    int16_t mean;
+};
+
+// The open bucket of a tier, as offsets from its first sample. Angles are
+// unwrapped sample to sample, so a steady turn keeps adding up.
+struct accumulator {
+    int64_t sum;
+    int32_t min;
+    int32_t max;
+    int32_t last;           // Offset of the last sample
+    uint32_t count;
+    uint32_t period;        // Uptime / period_ms
+    int16_t ref;
+};
+
+struct channel_state {
+    struct accumulator acc[TIER_COUNT];
+    struct bucket buckets[TIER_SLOTS_TOTAL];
+    uint32_t raw_time[HISTORY_RAW_LEN];     // Uptime, ms
+    int16_t raw_value[HISTORY_RAW_LEN];
+    uint16_t raw_head;                      // Next to write
+    uint16_t raw_count;
+    uint32_t samples;
+    bool started;
+};
+
+// Running combination of samples or buckets, oldest first
+struct combination {
+    int64_t sum;
+    int32_t min;
+    int32_t max;
+    int32_t first;
+    int32_t last;           // Unwrapped for angles
+    uint16_t entries;
+};
+
+static const struct channel_desc channel_descs[HISTORY_CH_COUNT] = {
+    [HISTORY_SOG]     = { "sog",     "m/s", 2, false },
+    [HISTORY_COG]     = { "cog",     "deg", 1, true },
+    [HISTORY_HEADING] = { "heading", "deg", 1, true },
+    [HISTORY_PITCH]   = { "pitch",   "deg", 1, false },
+    [HISTORY_ROLL]    = { "roll",    "deg", 1, false },
+};
+
+static const struct tier_desc tiers[TIER_COUNT] = {
+    { "1 s",   1000,    60, 0 },
+    { "1 min", 60000,   60, 60 },
+    { "1 h",   3600000, 24, 120 },
+};
+
+static const struct bucket empty_bucket = { INT16_MAX, INT16_MIN, 0 };
+
+static bool bucket_is_empty(const struct bucket *b)
+{
+    return b->below == empty_bucket.below && b->above == empty_bucket.above;
+}
+
+static struct channel_state channels[HISTORY_CH_COUNT];
+
+static K_MUTEX_DEFINE(history_mutex);
+
+int history_channel_from_name(const char *name)
+{
+    for (int ch = 0; ch < HISTORY_CH_COUNT; ch++) {
+        if (strcmp(name, channel_descs[ch].name) == 0) {
+            return ch;
+        }
+    }
+    return -EINVAL;
+}
+
+static int32_t normalise(enum history_channel ch, int32_t value)
+{
+    if (!channel_descs[ch].angular) {
+        return value;
+    }
+    value %= FULL_TURN;
+    return value < 0 ? value + FULL_TURN : value;
+}
+
+// value - ref, the short way round for angles
+static int32_t offset(enum history_channel ch, int32_t value, int32_t ref)
+{
+    int32_t d = value - ref;
+
+    if (channel_descs[ch].angular) {
+        if (d >= HALF_TURN) {
+            d -= FULL_TURN;
+        } else if (d < -HALF_TURN) {
+            d += FULL_TURN;
+        }
+    }
+    return d;
+}
+
+static int32_t div_round(int64_t num, uint32_t den)
+{
+    return num >= 0 ? (num + den / 2) / den : (num - den / 2) / (int64_t)den;
+}
+
+static void accumulate(enum history_channel ch, struct accumulator *acc, int16_t value)
+{
+    int32_t d;
+
+    if (acc->count == 0) {
+        acc->ref = value;
+        acc->sum = 0;
+        acc->min = 0;
+        acc->max = 0;
+        acc->last = 0;
+    }
+    // Against the previous sample, not the first one
+    d = acc->last + offset(ch, value, normalise(ch, acc->ref + acc->last));
+    acc->last = d;
+    acc->sum += d;
+    acc->min = MIN(acc->min, d);
+    acc->max = MAX(acc->max, d);
+    acc->count++;
+}
+
+static struct bucket bucket_from(enum history_channel ch, const struct accumulator *acc)
+{
+    int32_t mean = div_round(acc->sum, acc->count);
+    struct bucket b = {
+        .below = MAX(acc->min - mean, INT16_MIN),
+        .above = MIN(acc->max - mean, INT16_MAX),
+        .mean = normalise(ch, acc->ref + mean),
+    };
+
+    return b;
+}
+
+// Close the open bucket of tier t and open the one for period, with empty
+// buckets for the periods in between that had no samples
+static void close_bucket(struct channel_state *c, enum history_channel ch, int t,
+                         uint32_t period)
+{
+    const struct tier_desc *td = &tiers[t];
+    struct accumulator *acc = &c->acc[t];
+    struct bucket *slots = &c->buckets[td->offset];
+    uint32_t gap = period - acc->period;
+
+    if (gap > td->slots) {
+        for (int i = 0; i < td->slots; i++) {
+            slots[i] = empty_bucket;
+        }
+    } else {
+        slots[acc->period % td->slots] = acc->count > 0 ? bucket_from(ch, acc) : empty_bucket;
+        for (uint32_t p = acc->period + 1; p != period; p++) {
+            slots[p % td->slots] = empty_bucket;
+        }
+    }
+    acc->period = period;
+    acc->count = 0;
+}
+
+static void history_add(enum history_channel ch, int16_t value)
+{
+    struct channel_state *c = &channels[ch];
+    int64_t now = k_uptime_get();
+
+    k_mutex_lock(&history_mutex, K_FOREVER);
+
+    if (!c->started) {
+        for (int i = 0; i < TIER_SLOTS_TOTAL; i++) {
+            c->buckets[i] = empty_bucket;
+        }
+        for (int t = 0; t < TIER_COUNT; t++) {
+            c->acc[t].period = now / tiers[t].period_ms;
+        }
+        c->started = true;
+    }
+
+    for (int t = 0; t < TIER_COUNT; t++) {
+        uint32_t period = now / tiers[t].period_ms;
+
+        if (period != c->acc[t].period) {
+            close_bucket(c, ch, t, period);
+        }
+        accumulate(ch, &c->acc[t], value);
+    }
+
+    c->raw_time[c->raw_head] = (uint32_t)now;
+    c->raw_value[c->raw_head] = value;
+    c->raw_head = (c->raw_head + 1) % HISTORY_RAW_LEN;
+    c->raw_count = MIN(c->raw_count + 1, HISTORY_RAW_LEN);
+    c->samples++;
+
+    k_mutex_unlock(&history_mutex);
+}
+
+static void combine(struct combination *cb, enum history_channel ch, const struct bucket *b)
+{
+    // Unwrapped against the previous entry, so that angles add up across north
+    int32_t mean = cb->entries == 0 ? b->mean :
+                   cb->last + offset(ch, b->mean, normalise(ch, cb->last));
+    int32_t min = mean + b->below;
+    int32_t max = mean + b->above;
+
+    if (cb->entries == 0) {
+        cb->first = mean;
+        cb->min = min;
+        cb->max = max;
+    }
+    cb->sum += mean;
+    cb->min = MIN(cb->min, min);
+    cb->max = MAX(cb->max, max);
+    cb->last = mean;
+    cb->entries++;
+}
+
+static void combine_raw(struct combination *cb, enum history_channel ch, uint32_t now,
+                        uint32_t window_ms)
+{
+    const struct channel_state *c = &channels[ch];
+
+    for (int i = 0; i < c->raw_count; i++) {
+        int n = (c->raw_head + HISTORY_RAW_LEN - c->raw_count + i) % HISTORY_RAW_LEN;
+        struct bucket b = { 0, 0, c->raw_value[n] };
+
+        if (now - c->raw_time[n] <= window_ms) {
+            combine(cb, ch, &b);
+        }
+    }
+}
+
+// The buckets of tier t that overlap the window, the open one included
+static void combine_tier(struct combination *cb, enum history_channel ch, int t, int64_t now,
+                         uint32_t window_ms)
+{
+    const struct channel_state *c = &channels[ch];
+    const struct tier_desc *td = &tiers[t];
+    const struct accumulator *acc = &c->acc[t];
+    uint32_t from = MAX(now - window_ms, 0) / td->period_ms;
+    uint32_t to = now / td->period_ms;
+
+    for (uint32_t p = from; p <= to; p++) {
+        struct bucket b;
+
+        if (p == acc->period && acc->count > 0) {
+            b = bucket_from(ch, acc);
+        } else if (p < acc->period && acc->period - p <= td->slots) {
+            b = c->buckets[td->offset + p % td->slots];
+            if (bucket_is_empty(&b)) {
+                continue;
+            }
+        } else {
+            continue;
+        }
+        combine(cb, ch, &b);
+    }
+}
+
+int history_query(enum history_channel ch, uint32_t window_ms, struct history_summary *out)
+{
+    const struct channel_state *c = &channels[ch];
+    const struct tier_desc *last = &tiers[TIER_COUNT - 1];
+    struct combination cb = { 0 };
+    int64_t now = k_uptime_get();
+    int t = 0;
+
+    if (window_ms == 0 || window_ms > last->period_ms * last->slots) {
+        return -ERANGE;
+    }
+
+    k_mutex_lock(&history_mutex, K_FOREVER);
+
+    if (!c->started) {
+        k_mutex_unlock(&history_mutex);
+        return -ENODATA;
+    }
+
+    // Full rate if the ring has everything since the start of the window
+    if (c->raw_count < HISTORY_RAW_LEN ||
+        (uint32_t)now - c->raw_time[c->raw_head] >= window_ms) {
+        combine_raw(&cb, ch, (uint32_t)now, window_ms);
+        out->resolution_ms = 0;
+    } else {
+        while ((uint32_t)tiers[t].period_ms * tiers[t].slots < window_ms) {
+            t++;
+        }
+        combine_tier(&cb, ch, t, now, window_ms);
+        out->resolution_ms = tiers[t].period_ms;
+    }
+
+    k_mutex_unlock(&history_mutex);
+
+    if (cb.entries == 0) {
+        return -ENODATA;
+    }
+    out->mean = normalise(ch, div_round(cb.sum, cb.entries));
+    out->min = normalise(ch, cb.min);
+    out->max = normalise(ch, cb.max);
+    out->change = cb.last - cb.first;
+    out->entries = cb.entries;
+    return 0;
+}
+
+// Zbus listeners, in the publishers' threads
+
+static int16_t to_decidegrees(int32_t mdeg)
+{
+    return div_round(mdeg, 100);
+}
+
+static void history_gps_cb(const struct zbus_channel *chan)
+{
+    const struct gps_data *gps = zbus_chan_const_msg(chan);
+
+    if (!gps->valid) {
+        return;
+    }
+    history_add(HISTORY_SOG, MIN(gps->sog / 10, INT16_MAX));
+    history_add(HISTORY_COG, normalise(HISTORY_COG, to_decidegrees(gps->cog)));
+}
+
+static void history_compass_cb(const struct zbus_channel *chan)
+{
+    const struct compass_data *compass = zbus_chan_const_msg(chan);
+
+    if (compass->valid) {
+        history_add(HISTORY_HEADING, normalise(HISTORY_HEADING,
+                                               to_decidegrees(compass->heading)));
+    }
+}
+
+static void history_acc_cb(const struct zbus_channel *chan)
+{
+    const struct acc_data *acc = zbus_chan_const_msg(chan);
+
+    if (acc->valid) {
+        history_add(HISTORY_PITCH, to_decidegrees(acc->pitch));
+        history_add(HISTORY_ROLL, to_decidegrees(acc->roll));
+    }
+}
+
+ZBUS_LISTENER_DEFINE(history_gps_lis, history_gps_cb);
+ZBUS_CHAN_ADD_OBS(gps_chan, history_gps_lis, 5);
+ZBUS_LISTENER_DEFINE(history_compass_lis, history_compass_cb);
+ZBUS_CHAN_ADD_OBS(compass_chan, history_compass_lis, 1);
+ZBUS_LISTENER_DEFINE(history_acc_lis, history_acc_cb);
+ZBUS_CHAN_ADD_OBS(acc_chan, history_acc_lis, 1);
+
+// Console commands
+
+// Fixed point with the channel's decimals into buf
+static const char *format_value(enum history_channel ch, int32_t value, bool sign, char *buf,
+                                size_t size)
+{
+    uint8_t decimals = channel_descs[ch].decimals;
+    uint32_t scale = decimals == 2 ? 100 : 10;
+    uint32_t mag = value < 0 ? -value : value;
+    const char *prefix = value < 0 ? "-" : (sign ? "+" : "");
+
+    snprintk(buf, size, "%s%u.%0*u", prefix, mag / scale, (int)decimals, mag % scale);
+    return buf;
+}
+
+// "90", "90s", "10m" or "2h"
+static int parse_window(char *token, uint32_t *window_ms)
+{
+    size_t len = strlen(token);
+    uint32_t unit_ms = MSEC_PER_SEC;
+    int32_t value;
+
+    if (len > 1) {
+        switch (token[len - 1]) {
+        case 'h':
+            unit_ms *= 60;
+            __fallthrough;
+        case 'm':
+            unit_ms *= 60;
+            __fallthrough;
+        case 's':
+            token[len - 1] = '\0';
+            break;
+        default:
+            break;
+        }
+    }
+    if (cmd_parse_int(token, &value) != 0 || value <= 0 || value > UINT32_MAX / unit_ms) {
+        return -EINVAL;
+    }
+    *window_ms = value * unit_ms;
+    return 0;
+}
+
+static void show_overview(void)
+{
+    printk("History: full rate %u samples, then", HISTORY_RAW_LEN);
+    for (int t = 0; t < TIER_COUNT; t++) {
+        printk(" %u x %s%s", tiers[t].slots, tiers[t].name, t + 1 < TIER_COUNT ? "," : "\n");
+    }
+    printk("Memory %u bytes\n", (uint32_t)sizeof(channels));
+    printk("Channel   Unit  Samples  Full rate span\n");
+
+    for (int ch = 0; ch < HISTORY_CH_COUNT; ch++) {
+        const struct channel_state *c = &channels[ch];
+        uint32_t span = 0, samples;
+
+        k_mutex_lock(&history_mutex, K_FOREVER);
+        samples = c->samples;
+        if (c->raw_count > 1) {
+            int newest = (c->raw_head + HISTORY_RAW_LEN - 1) % HISTORY_RAW_LEN;
+            int oldest = (c->raw_head + HISTORY_RAW_LEN - c->raw_count) % HISTORY_RAW_LEN;
+
+            span = c->raw_time[newest] - c->raw_time[oldest];
+        }
+        k_mutex_unlock(&history_mutex);
+
+        printk("%-8s  %-4s  %7u  %u.%03u s\n", channel_descs[ch].name, channel_descs[ch].unit,
+               samples, span / 1000, span % 1000);
+    }
+}
+
+static int cmd_history(int argc, char **argv)
+{
+    struct history_summary sum;
+    char mean[12], min[12], max[12], change[12];
+    uint32_t window_ms;
+    int ch, ret;
+
+    if (argc == 0) {
+        show_overview();
+        return 0;
+    }
+    if (argc != 2) {
+        return -EINVAL;
+    }
+
+    ch = history_channel_from_name(argv[0]);
+    if (ch < 0) {
+        printk("Error: Unknown channel '%s'\n", argv[0]);
+        return -EINVAL;
+    }
+    if (parse_window(argv[1], &window_ms) != 0) {
+        return -EINVAL;
+    }
+
+    ret = history_query(ch, window_ms, &sum);
+    if (ret == -ERANGE) {
+        printk("Error: History goes back %u h at most\n",
+               tiers[TIER_COUNT - 1].slots * tiers[TIER_COUNT - 1].period_ms / 3600000);
+        return 0;
+    }
+    if (ret != 0) {
+        printk("No %s data in the last %u s\n", channel_descs[ch].name, window_ms / 1000);
+        return 0;
+    }
+
+    if (sum.resolution_ms == 0) {
+        printk("%s over %u s, full rate, %u samples\n", channel_descs[ch].name,
+               window_ms / 1000, sum.entries);
+    } else {
+        printk("%s over %u s, %u s buckets, %u buckets\n", channel_descs[ch].name,
+               window_ms / 1000, sum.resolution_ms / 1000, sum.entries);
+    }
+    printk("Mean %s %s, min %s, max %s, change %s\n",
+           format_value(ch, sum.mean, false, mean, sizeof(mean)), channel_descs[ch].unit,
+           format_value(ch, sum.min, false, min, sizeof(min)),
+           format_value(ch, sum.max, false, max, sizeof(max)),
+           format_value(ch, sum.change, true, change, sizeof(change)));
+    return 0;
+}
+
+CMD_DEFINE(history, "history", "[<sog|cog|heading|pitch|roll> <window, 60s|10m|2h>]",
+           "Show history tiers, or min/max/mean of a channel over a window", cmd_history, 0, 2);
@@ -0,0 +1,61 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdint.h>
+
+/*
+ * Recent history of the main channels, to answer "mean SOG over the last
+ * minute" or "how far has the heading swung in 10 minutes".
+ *
+ * Each channel keeps its last HISTORY_RAW_LEN samples at full rate and
+ * three tiers of min/max/mean buckets: seconds for the last minute,
+ * minutes for the last hour, hours for the last day. Zbus listeners add
+ * every valid sample as it is published, to the raw ring and to the open
+ * bucket of each tier, so a tier's bucket is complete the moment its
+ * period ends and nothing is ever rescanned.
+ *
+ * A query takes the raw ring if it reaches back over the whole window,
+ * otherwise the finest tier that spans it. Either way it reads at most
+ * HISTORY_RAW_LEN samples or one tier's worth of buckets, whatever the
+ * window. Bucket edges are on whole periods of uptime, so a window is
+ * answered to the resolution of its tier.
+ *
+ * Headings and courses are averaged around the circle, not across 0.
+ * Within a bucket they are unwrapped sample to sample, so a turn of more
+ * than half a circle keeps its true range. Between buckets only the means
+ * are left, which are unwrapped the short way round: a turn faster than
+ * half a circle per bucket period shows in min/max, not in change.
+ *
+ * Fixed memory, all static: 1360 bytes per channel, 6800 in all.
+ */
+
+// Full rate samples per channel, one minute of 1 Hz fixes or about a
+// second of the 50 Hz attitude
+#define HISTORY_RAW_LEN         64
+
+enum history_channel {
+    HISTORY_SOG,            // cm/s
+    HISTORY_COG,            // 0.1 degrees, 0-3599
+    HISTORY_HEADING,        // 0.1 degrees, 0-3599
+    HISTORY_PITCH,          // 0.1 degrees
+    HISTORY_ROLL,           // 0.1 degrees
+    HISTORY_CH_COUNT
+};
+
+struct history_summary {
+    int32_t mean;
+    int32_t min;            // For angles the most anticlockwise
+    int32_t max;
+    int32_t change;         // Newest minus oldest entry, signed for angles
+    uint32_t resolution_ms; // Of the tier used, 0 for full rate
+    uint16_t entries;       // Samples or buckets it was taken from
+};
+
+// Channel from its command name, -EINVAL if unknown
+int history_channel_from_name(const char *name);
+
+// Summary of the last window_ms of a channel. -ENODATA if nothing was
+// recorded in the window, -ERANGE if it is longer than the hours tier.
+int history_query(enum history_channel ch, uint32_t window_ms, struct history_summary *out);
+
+#endif // HISTORY_H
@@ -1,13 +1,10 @@
 #include "hmc5883l.h"
+#include "command_parser.h"
+#include "sensor_math.h"
 #include <zephyr/device.h>
 #include <zephyr/drivers/sensor.h>
 #include <zephyr/devicetree.h>
 #include <zephyr/logging/log.h>
-#include <math.h>
-
-#ifndef M_PI
-#define M_PI 3.14159265358979323846f
-#endif
 
 static const struct device *hmc5883l_dev = NULL;
 static K_MUTEX_DEFINE(hmc5883l_mutex);
@@ -54,27 +51,29 @@ int hmc5883l_get_heading(float *heading){
         return -1;
     }
     
-    // Calculate heading in radians
-    float heading_rad = atan2f(my, mx);
-    
-    // Convert to degrees
-    float heading_deg = heading_rad * 180.0f / M_PI;  // Use M_PI constant
-    
-    // Apply declination correction
-    heading_deg += -11.5f;
+    *heading = sensor_math_heading(mx, my);
+    return 0;
+}
+
+int hmc5883l_is_ready(void){
+    return (hmc5883l_dev != NULL) && device_is_ready(hmc5883l_dev);
+}
+
+// Console commands
+static int cmd_compass(int argc, char **argv)
+{
+    float mx, my, mz, heading;
     
-    // Normalize to 0-360 degrees
-    if (heading_deg < 0) {
-        heading_deg += 360.0f;
-    }
-    if (heading_deg >= 360.0f) {
-        heading_deg -= 360.0f;
+    // One sample for both, so the heading matches the field shown
+    if (hmc5883l_read_mag(&mx, &my, &mz) != 0) {
+        printk("Error reading compass\n");
+        return 0;
     }
+    heading = sensor_math_heading(mx, my);
     
-    *heading = heading_deg;
+    printk("Heading: %.1f°\n", heading);
+    printk("Field: X=%.3f Y=%.3f Z=%.3f Gauss\n", mx, my, mz);
     return 0;
 }
 
-int hmc5883l_is_ready(void){
-    return (hmc5883l_dev != NULL) && device_is_ready(hmc5883l_dev);
-}
\ No newline at end of file
+CMD_DEFINE(compass, "compass", "", "Show heading and magnetic field", cmd_compass, 0, 0);
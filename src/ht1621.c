@@ -3,9 +3,9 @@
  */
 
 #include <zephyr/device.h>
-#include <zephyr/drivers/gpio.h>
 #include <zephyr/sys/printk.h>
 #include "ht1621.h"
+#include "ht1621_transport.h"
 
 /* HT1621 Commands */
 #define HT1621_CMD_SYS_DIS  0x00  /* System disable */
@@ -17,17 +17,8 @@
 /* Default bias/commons - can be overridden */
 #define HT1621_CMD_BIAS_DEFAULT  0x29  /* 1/3 bias, 3 commons */
 
-/* GPIO Pin Definitions */
-#define CS_NODE   DT_ALIAS(ht1621_cs)
-#define WR_NODE   DT_ALIAS(ht1621_wr)
-#define DATA_NODE DT_ALIAS(ht1621_data)
-
-static const struct gpio_dt_spec cs_pin = GPIO_DT_SPEC_GET(CS_NODE, gpios);
-static const struct gpio_dt_spec wr_pin = GPIO_DT_SPEC_GET(WR_NODE, gpios);
-static const struct gpio_dt_spec data_pin = GPIO_DT_SPEC_GET(DATA_NODE, gpios);
-
-/* Timing delays (in microseconds) */
-#define HT1621_DELAY_US 2
+/* Cycle count of the last full-RAM frame, see ht1621_get_frame_time_us() */
+static uint32_t last_frame_cycles;
 
 /*
  * 7-segment digit encoding
@@ -42,17 +33,36 @@ static const struct gpio_dt_spec data_pin = GPIO_DT_SPEC_GET(DATA_NODE, gpios);
  * 
  * Bit mapping: 0bGFEDCBA (bit 7 = decimal point)
  */
+#define SEG_0       0b00111111
+#define SEG_1       0b00000110
+#define SEG_2       0b01011011
+#define SEG_3       0b01001111
+#define SEG_4       0b01100110
+#define SEG_5       0b01101101
+#define SEG_6       0b01111101
+#define SEG_7       0b00000111
+#define SEG_8       0b01111111
+#define SEG_9       0b01101111
+
 static const uint8_t digit_segments[] = {
-    0b00111111,  /* 0 */
-    0b00000110,  /* 1 */
-    0b01011011,  /* 2 */
-    0b01001111,  /* 3 */
-    0b01100110,  /* 4 */
-    0b01101101,  /* 5 */
-    0b01111101,  /* 6 */
-    0b00000111,  /* 7 */
-    0b01111111,  /* 8 */
-    0b01101111,  /* 9 */
+    SEG_0, SEG_1, SEG_2, SEG_3, SEG_4, SEG_5, SEG_6, SEG_7, SEG_8, SEG_9,
+};
+
+/*
+ * Segments for every value 00-99: tens digit in the high byte, units in
+ * the low byte. Lets the formatter emit two digits per division.
+ */
+#define PAIR(t, u)  ((SEG_##t << 8) | SEG_##u)
+#define PAIR_ROW(t) PAIR(t, 0), PAIR(t, 1), PAIR(t, 2), PAIR(t, 3), PAIR(t, 4), \
+                    PAIR(t, 5), PAIR(t, 6), PAIR(t, 7), PAIR(t, 8), PAIR(t, 9)
+
+static const uint16_t pair_segments[100] = {
+    PAIR_ROW(0), PAIR_ROW(1), PAIR_ROW(2), PAIR_ROW(3), PAIR_ROW(4),
+    PAIR_ROW(5), PAIR_ROW(6), PAIR_ROW(7), PAIR_ROW(8), PAIR_ROW(9),
+};
+
+static const uint32_t powers_of_10[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000,
 };
 
 /* Hex digits A-F */
@@ -69,50 +79,13 @@ static const uint8_t hex_segments[] = {
 #define SEG_MINUS   0b01000000  /* - */
 #define SEG_BLANK   0b00000000  /* blank */
 #define SEG_DP      0b10000000  /* decimal point (bit 7) */
-
-/* Function to write bits to HT1621 */
-static void ht1621_write_bits(uint8_t data, uint8_t bits)
-{
-    for (int i = 0; i < bits; i++) {
-        gpio_pin_set_dt(&wr_pin, 0);
-        k_usleep(HT1621_DELAY_US);
-        
-        if (data & (1 << (bits - 1 - i))) {
-            gpio_pin_set_dt(&data_pin, 1);
-        } else {
-            gpio_pin_set_dt(&data_pin, 0);
-        }
-        
-        k_usleep(HT1621_DELAY_US);
-        gpio_pin_set_dt(&wr_pin, 1);
-        k_usleep(HT1621_DELAY_US);
-    }
-}
-
-/* Send command to HT1621 */
-static void ht1621_send_command(uint8_t cmd)
-{
-    gpio_pin_set_dt(&cs_pin, 0);
-    k_usleep(HT1621_DELAY_US);
-    
-    ht1621_write_bits(0x80, 4);  /* Command mode: 100 */
-    ht1621_write_bits(cmd, 8);   /* Command data */
-    
-    gpio_pin_set_dt(&cs_pin, 1);
-    k_usleep(HT1621_DELAY_US);
-}
+#define SEG_L       0b00111000  /* L, for overflow */
 
 void ht1621_write_data(uint8_t addr, uint8_t data)
 {
-    gpio_pin_set_dt(&cs_pin, 0);
-    k_usleep(HT1621_DELAY_US);
-    
-    ht1621_write_bits(0xA0, 3);  /* Write mode: 101 */
-    ht1621_write_bits(addr, 6);  /* Address (6 bits) */
-    ht1621_write_bits(data, 4);  /* Data (4 bits per address) */
-    
-    gpio_pin_set_dt(&cs_pin, 1);
-    k_usleep(HT1621_DELAY_US);
+    uint8_t nibble = data & 0x0F;
+
+    ht1621_transport.write(addr, &nibble, 1);
 }
 
 int ht1621_init(void)
@@ -124,45 +97,51 @@ int ht1621_init_with_config(ht1621_bias_com_t bias_com)
 {
     int ret;
     
-    /* Initialize GPIO pins */
-    if (!gpio_is_ready_dt(&cs_pin) || 
-        !gpio_is_ready_dt(&wr_pin) || 
-        !gpio_is_ready_dt(&data_pin)) {
-        printk("GPIO devices not ready\n");
-        return -ENODEV;
+    ret = ht1621_transport.init();
+    if (ret < 0) {
+        return ret;
     }
     
-    ret = gpio_pin_configure_dt(&cs_pin, GPIO_OUTPUT_INACTIVE);
-    if (ret < 0) return ret;
-    
-    ret = gpio_pin_configure_dt(&wr_pin, GPIO_OUTPUT_INACTIVE);
-    if (ret < 0) return ret;
-    
-    ret = gpio_pin_configure_dt(&data_pin, GPIO_OUTPUT_INACTIVE);
-    if (ret < 0) return ret;
-    
-    /* Initialize HT1621 */
-    gpio_pin_set_dt(&cs_pin, 1);
-    gpio_pin_set_dt(&wr_pin, 1);
-    gpio_pin_set_dt(&data_pin, 1);
-    
     k_msleep(100);
     
     printk("HT1621: Using bias/commons config: 0x%02X\n", bias_com);
-    ht1621_send_command(bias_com);
-    ht1621_send_command(HT1621_CMD_RC_256K);
-    ht1621_send_command(HT1621_CMD_SYS_EN);
-    ht1621_send_command(HT1621_CMD_LCD_ON);
+    ht1621_transport.send_command(bias_com);
+    ht1621_transport.send_command(HT1621_CMD_RC_256K);
+    ht1621_transport.send_command(HT1621_CMD_SYS_EN);
+    ht1621_transport.send_command(HT1621_CMD_LCD_ON);
+    
+    ht1621_clear();
     
-    printk("HT1621 initialized\n");
+    printk("HT1621 initialized (%s transport, frame %u us)\n",
+           ht1621_transport.name, ht1621_get_frame_time_us());
     return 0;
 }
 
 void ht1621_clear(void)
 {
-    for (uint8_t i = 0; i < 32; i++) {
-        ht1621_write_data(i, 0x00);
+    static const uint8_t blank[HT1621_RAM_SIZE] = {0};
+    uint32_t start = k_cycle_get_32();
+    
+    ht1621_transport.write(0, blank, HT1621_RAM_SIZE);
+    
+    last_frame_cycles = k_cycle_get_32() - start;
+}
+
+uint32_t ht1621_get_frame_time_us(void)
+{
+    return (uint32_t)k_cyc_to_us_floor64(last_frame_cycles);
+}
+
+static uint8_t glyph_segments(uint8_t digit)
+{
+    if (digit <= 9) {
+        return digit_segments[digit];
+    } else if (digit >= 0x0A && digit <= 0x0F) {
+        return hex_segments[digit - 0x0A];
+    } else if (digit == HT1621_MINUS) {
+        return SEG_MINUS;
     }
+    return SEG_BLANK;
 }
 
 void ht1621_display_digit(uint8_t position, uint8_t digit, bool decimal_point)
@@ -171,17 +150,7 @@ void ht1621_display_digit(uint8_t position, uint8_t digit, bool decimal_point)
         return;
     }
     
-    uint8_t segments = 0;
-    
-    if (digit <= 9) {
-        segments = digit_segments[digit];
-    } else if (digit >= 0x0A && digit <= 0x0F) {
-        segments = hex_segments[digit - 0x0A];
-    } else if (digit == HT1621_BLANK) {
-        segments = SEG_BLANK;
-    } else if (digit == HT1621_MINUS) {
-        segments = SEG_MINUS;
-    }
+    uint8_t segments = glyph_segments(digit);
     
     if (decimal_point) {
         segments |= SEG_DP;
@@ -192,11 +161,12 @@ void ht1621_display_digit(uint8_t position, uint8_t digit, bool decimal_point)
      * Adjust this based on your LCD's memory map
      */
     uint8_t addr = position * 2;
+    uint8_t nibbles[2] = {
+        segments & 0x0F,         /* Lower nibble */
+        (segments >> 4) & 0x0F,  /* Upper nibble */
+    };
     
-    /* Write lower nibble */
-    ht1621_write_data(addr, segments & 0x0F);
-    /* Write upper nibble */
-    ht1621_write_data(addr + 1, (segments >> 4) & 0x0F);
+    ht1621_transport.write(addr, nibbles, 2);
 }
 
 void ht1621_display_number(int32_t number, bool leading_zeros)
@@ -300,6 +270,129 @@ void ht1621_display_hex(uint32_t number)
     }
 }
 
+void ht1621_write_frame(const uint8_t *frame)
+{
+    uint8_t nibbles[HT1621_MAX_DIGITS * 2];
+    
+    for (int i = 0; i < HT1621_MAX_DIGITS; i++) {
+        nibbles[2 * i] = frame[i] & 0x0F;
+        nibbles[2 * i + 1] = frame[i] >> 4;
+    }
+    
+    ht1621_transport.write(0, nibbles, sizeof(nibbles));
+}
+
+void ht1621_format_fill(uint8_t *frame, uint8_t digit)
+{
+    uint8_t segments = glyph_segments(digit);
+    
+    for (int i = 0; i < HT1621_MAX_DIGITS; i++) {
+        frame[i] = segments;
+    }
+}
+
+int ht1621_format_fixed(uint8_t *frame, int32_t value, uint8_t scale,
+                        uint8_t decimals, uint8_t min_digits)
+{
+    if (scale >= ARRAY_SIZE(powers_of_10)) scale = ARRAY_SIZE(powers_of_10) - 1;
+    if (decimals > scale) decimals = scale;
+    if (min_digits > HT1621_MAX_DIGITS) min_digits = HT1621_MAX_DIGITS;
+    
+    bool is_negative = value < 0;
+    uint32_t magnitude = is_negative ? -(uint32_t)value : (uint32_t)value;
+    uint8_t width = HT1621_MAX_DIGITS - (is_negative ? 1 : 0);
+    uint32_t shown;
+    
+    /* Round half away from zero, dropping decimals until the value fits */
+    while (1) {
+        uint32_t div = powers_of_10[scale - decimals];
+        shown = magnitude / div + (magnitude % div >= div / 2 && div > 1);
+        if (shown < powers_of_10[width] || decimals == 0) {
+            break;
+        }
+        decimals--;
+    }
+    
+    if (shown >= powers_of_10[width]) {
+        /* Overflow: right-aligned "OFL" */
+        ht1621_format_fill(frame, HT1621_BLANK);
+        frame[HT1621_MAX_DIGITS - 3] = SEG_0;
+        frame[HT1621_MAX_DIGITS - 2] = hex_segments[0x0F - 0x0A];
+        frame[HT1621_MAX_DIGITS - 1] = SEG_L;
+        return -ERANGE;
+    }
+    
+    if (shown == 0) {
+        is_negative = false;    /* No "-0.0" */
+    }
+    
+    /* Digits to draw: significant digits, at least one before the point */
+    uint8_t digits = 1;
+    while (digits < width && shown >= powers_of_10[digits]) {
+        digits++;
+    }
+    digits = MAX(digits, MAX(decimals + 1, min_digits));
+    digits = MIN(digits, width);
+    
+    /* Fill right to left, two digits per step */
+    int pos = HT1621_MAX_DIGITS;
+    for (uint8_t n = 0; n < digits; n += 2) {
+        uint16_t pair = pair_segments[shown % 100];
+        shown /= 100;
+        frame[--pos] = pair & 0xFF;
+        if (n + 1 < digits) {
+            frame[--pos] = pair >> 8;
+        }
+    }
+    
+    if (is_negative && pos > 0) {
+        frame[--pos] = SEG_MINUS;
+    }
+    while (pos > 0) {
+        frame[--pos] = SEG_BLANK;
+    }
+    
+    if (decimals > 0) {
+        frame[HT1621_MAX_DIGITS - 1 - decimals] |= SEG_DP;
+    }
+    
+    return 0;
+}
+
+void ht1621_benchmark(void)
+{
+    /* Same values in both paths: degrees * 1000, shown with 1 decimal */
+    static const int32_t samples[] = { 123456, -98765, 3141, 0, 359999, -5, 42000 };
+    const int iterations = 70;
+    uint8_t frame[HT1621_MAX_DIGITS];
+    uint32_t start, legacy, fixed_write, fixed_format;
+    
+    start = k_cycle_get_32();
+    for (int i = 0; i < iterations; i++) {
+        ht1621_display_float(samples[i % ARRAY_SIZE(samples)] / 1000.0f, 1);
+    }
+    legacy = k_cycle_get_32() - start;
+    
+    start = k_cycle_get_32();
+    for (int i = 0; i < iterations; i++) {
+        ht1621_format_fixed(frame, samples[i % ARRAY_SIZE(samples)], 3, 1, 0);
+        ht1621_write_frame(frame);
+    }
+    fixed_write = k_cycle_get_32() - start;
+    
+    start = k_cycle_get_32();
+    for (int i = 0; i < iterations; i++) {
+        ht1621_format_fixed(frame, samples[i % ARRAY_SIZE(samples)], 3, 1, 0);
+    }
+    fixed_format = k_cycle_get_32() - start;
+    
+    printk("HT1621 benchmark (%s transport, %d updates, cycles/update):\n",
+           ht1621_transport.name, iterations);
+    printk("  display_float + digit writes: %u\n", legacy / iterations);
+    printk("  format_fixed + write_frame:   %u\n", fixed_write / iterations);
+    printk("  format_fixed only:            %u\n", fixed_format / iterations);
+}
+
 void ht1621_test_digits(void)
 {
     printk("Testing digit display...\n");
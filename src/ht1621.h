@@ -1,7 +1,9 @@
 /*
  * ht1621.h - HT1621 LCD Driver Library for Zephyr
  * 
- * Driver for HT1621 RAM mapping LCD controller using bit-banged 3-wire interface
+ * Driver for HT1621 RAM mapping LCD controller using the 3-wire interface.
+ * The bus is driven either by bit-banged GPIOs or by an SPI peripheral,
+ * selected from devicetree (see ht1621_transport.h).
  */
 
 #ifndef HT1621_H
@@ -63,6 +65,17 @@ int ht1621_init_with_config(ht1621_bias_com_t bias_com);
  */
 void ht1621_clear(void);
 
+/**
+ * @brief Get the duration of the last full-RAM frame
+ * 
+ * Measured with the cycle counter around the most recent ht1621_clear(),
+ * which writes all 32 addresses in one burst. Useful for comparing
+ * transport backends.
+ * 
+ * @return Frame time in microseconds
+ */
+uint32_t ht1621_get_frame_time_us(void);
+
 /**
  * @brief Write raw data to a specific HT1621 address
  * 
@@ -134,6 +147,55 @@ void ht1621_display_float(float number, uint8_t decimals);
  */
 void ht1621_display_hex(uint32_t number);
 
+/**
+ * @brief Write a complete segment frame in one burst
+ * 
+ * @param frame HT1621_MAX_DIGITS segment bytes, leftmost digit first,
+ *              as produced by ht1621_format_fixed()
+ */
+void ht1621_write_frame(const uint8_t *frame);
+
+/**
+ * @brief Fill a segment frame with one glyph
+ * 
+ * @param frame HT1621_MAX_DIGITS segment bytes to fill
+ * @param digit Glyph, same encoding as ht1621_display_digit()
+ */
+void ht1621_format_fill(uint8_t *frame, uint8_t digit);
+
+/**
+ * @brief Format a fixed-point value into a segment frame
+ * 
+ * Renders in one pass without floats or heap: two digits per division
+ * through a precomputed digit-pair segment table. The value is rounded
+ * half away from zero and right-aligned, with the minus sign directly in
+ * front of the first digit. Decimals are dropped when the value would not
+ * fit otherwise; if it still does not fit, "OFL" is shown.
+ * 
+ * @param frame HT1621_MAX_DIGITS segment bytes to render into
+ * @param value Value in units of 10^-scale (e.g. millidegrees: scale 3)
+ * @param scale Number of decimal places in value (0-9)
+ * @param decimals Number of decimal places to show (at most scale)
+ * @param min_digits Zero-pad to at least this many digits
+ * @return 0 on success, -ERANGE on overflow
+ * 
+ * @example
+ * ht1621_format_fixed(f, 123456, 3, 1, 0);  // "  123.5"
+ * ht1621_format_fixed(f, -5, 3, 1, 0);      // "    0.0"
+ * ht1621_format_fixed(f, 93015, 0, 0, 6);   // "093015"
+ */
+int ht1621_format_fixed(uint8_t *frame, int32_t value, uint8_t scale,
+                        uint8_t decimals, uint8_t min_digits);
+
+/**
+ * @brief Compare update cost of the float and fixed-point paths
+ * 
+ * Times ht1621_display_float() against ht1621_format_fixed() plus
+ * ht1621_write_frame() with the cycle counter and prints cycles per
+ * update. Overwrites the display contents.
+ */
+void ht1621_benchmark(void);
+
 /**
  * @brief Test function - cycle through all digits
  * 
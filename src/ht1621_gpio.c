@@ -0,0 +1,125 @@
+/*
+ * ht1621_gpio.c - HT1621 bit-banged GPIO transport
+ *
+ * Drives CS/WR/DATA through the raw port API and times the WR edges with
+ * k_busy_wait(), so a frame costs a few microseconds per bit instead of a
+ * scheduler round trip per edge.
+ */
+
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/sys/printk.h>
+#include "ht1621_transport.h"
+
+#if !DT_HAS_COMPAT_STATUS_OKAY(holtek_ht1621)
+
+/* GPIO Pin Definitions */
+#define CS_NODE   DT_ALIAS(ht1621_cs)
+#define WR_NODE   DT_ALIAS(ht1621_wr)
+#define DATA_NODE DT_ALIAS(ht1621_data)
+
+static const struct gpio_dt_spec cs_pin = GPIO_DT_SPEC_GET(CS_NODE, gpios);
+static const struct gpio_dt_spec wr_pin = GPIO_DT_SPEC_GET(WR_NODE, gpios);
+static const struct gpio_dt_spec data_pin = GPIO_DT_SPEC_GET(DATA_NODE, gpios);
+
+/*
+ * WR low/high time (in microseconds). The datasheet minimum is 3.34 us at
+ * VDD = 3 V (1.67 us at 5 V); the port write itself adds a little on top.
+ */
+#define HT1621_DELAY_US 4
+
+/*
+ * Set a pin straight through the port set/clear registers. This skips the
+ * per-call flag translation of gpio_pin_set_dt(), so active level is applied
+ * here.
+ */
+static inline void pin_write(const struct gpio_dt_spec *spec, int value)
+{
+    if (spec->dt_flags & GPIO_ACTIVE_LOW) {
+        value = !value;
+    }
+
+    if (value) {
+        gpio_port_set_bits_raw(spec->port, BIT(spec->pin));
+    } else {
+        gpio_port_clear_bits_raw(spec->port, BIT(spec->pin));
+    }
+}
+
+/* Clock out the low 'bits' bits of data, MSB first */
+static void write_bits(uint16_t data, uint8_t bits)
+{
+    for (int i = bits - 1; i >= 0; i--) {
+        pin_write(&wr_pin, 0);
+        pin_write(&data_pin, (data >> i) & 1);
+        k_busy_wait(HT1621_DELAY_US);
+        pin_write(&wr_pin, 1);   /* HT1621 latches DATA on the rising edge */
+        k_busy_wait(HT1621_DELAY_US);
+    }
+}
+
+static inline void frame_begin(void)
+{
+    pin_write(&cs_pin, 0);
+    k_busy_wait(HT1621_DELAY_US);
+}
+
+static inline void frame_end(void)
+{
+    pin_write(&cs_pin, 1);
+    k_busy_wait(HT1621_DELAY_US);
+}
+
+static int gpio_transport_init(void)
+{
+    int ret;
+
+    if (!gpio_is_ready_dt(&cs_pin) ||
+        !gpio_is_ready_dt(&wr_pin) ||
+        !gpio_is_ready_dt(&data_pin)) {
+        printk("GPIO devices not ready\n");
+        return -ENODEV;
+    }
+
+    /* Bus idles with all lines high */
+    ret = gpio_pin_configure_dt(&cs_pin, GPIO_OUTPUT_ACTIVE);
+    if (ret < 0) return ret;
+
+    ret = gpio_pin_configure_dt(&wr_pin, GPIO_OUTPUT_ACTIVE);
+    if (ret < 0) return ret;
+
+    ret = gpio_pin_configure_dt(&data_pin, GPIO_OUTPUT_ACTIVE);
+    if (ret < 0) return ret;
+
+    return 0;
+}
+
+static void gpio_transport_send_command(uint8_t cmd)
+{
+    frame_begin();
+    write_bits(HT1621_MODE_CMD, 3);
+    write_bits(cmd, 8);
+    write_bits(0, 1);            /* Trailing don't-care bit */
+    frame_end();
+}
+
+static void gpio_transport_write(uint8_t addr, const uint8_t *nibbles, uint8_t count)
+{
+    frame_begin();
+    write_bits(HT1621_MODE_WRITE, 3);
+    write_bits(addr, 6);
+    for (uint8_t i = 0; i < count; i++) {
+        write_bits(nibbles[i], 4);
+    }
+    frame_end();
+}
+
+const struct ht1621_transport ht1621_transport = {
+    .name = "gpio",
+    .init = gpio_transport_init,
+    .send_command = gpio_transport_send_command,
+    .write = gpio_transport_write,
+};
+
+#endif /* !DT_HAS_COMPAT_STATUS_OKAY(holtek_ht1621) */
@@ -0,0 +1,126 @@
+/*
+ * ht1621_spi.c - HT1621 SPI transport
+ *
+ * WR maps to SCK and DATA to MOSI. The HT1621 latches on the rising edge of
+ * WR with WR idling high, which is SPI mode 3, MSB first, with CS active low.
+ *
+ * SPI only moves whole bytes, so each frame is padded out to a byte
+ * boundary. Padding bits that do not complete a command or RAM nibble are
+ * dropped by the controller when CS goes high:
+ *   command: 100 + 8 command bits + 1 don't-care = 12 bits, 4 pad bits
+ *   write:   101 + 6 address bits + 4 bits/nibble, which lands 3 bits short
+ *            of a byte boundary for an odd nibble count. Even counts are
+ *            split into a single-nibble frame plus an odd-length burst.
+ */
+
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/spi.h>
+#include <zephyr/sys/printk.h>
+#include <string.h>
+#include "ht1621_transport.h"
+
+#if DT_HAS_COMPAT_STATUS_OKAY(holtek_ht1621)
+
+#define HT1621_NODE DT_COMPAT_GET_ANY_STATUS_OKAY(holtek_ht1621)
+
+#define HT1621_SPI_OP (SPI_OP_MODE_MASTER | SPI_TRANSFER_MSB | SPI_WORD_SET(8) | \
+                       SPI_MODE_CPOL | SPI_MODE_CPHA)
+
+static const struct spi_dt_spec bus = SPI_DT_SPEC_GET(HT1621_NODE, HT1621_SPI_OP, 0);
+
+/* Largest frame: 9 header bits + a full RAM burst + pad, in bytes */
+#define HT1621_SPI_FRAME_MAX ((9 + HT1621_RAM_SIZE * 4 + 7) / 8)
+
+/* MSB-first bit packer over a zeroed buffer */
+struct bit_writer {
+    uint8_t *buf;
+    uint16_t pos;
+};
+
+static void put_bits(struct bit_writer *w, uint16_t data, uint8_t bits)
+{
+    for (int i = bits - 1; i >= 0; i--) {
+        if ((data >> i) & 1) {
+            w->buf[w->pos >> 3] |= 0x80 >> (w->pos & 7);
+        }
+        w->pos++;
+    }
+}
+
+static void send_frame(const uint8_t *buf, uint16_t bits)
+{
+    const struct spi_buf tx = {
+        .buf = (void *)buf,
+        .len = (bits + 7) / 8,
+    };
+    const struct spi_buf_set tx_set = {
+        .buffers = &tx,
+        .count = 1,
+    };
+
+    spi_write_dt(&bus, &tx_set);
+}
+
+static int spi_transport_init(void)
+{
+    if (!spi_is_ready_dt(&bus)) {
+        printk("HT1621 SPI bus not ready\n");
+        return -ENODEV;
+    }
+
+    return 0;
+}
+
+static void spi_transport_send_command(uint8_t cmd)
+{
+    uint8_t buf[2] = {0};
+    struct bit_writer w = { .buf = buf };
+
+    put_bits(&w, HT1621_MODE_CMD, 3);
+    put_bits(&w, cmd, 8);
+    put_bits(&w, 0, 1);          /* Trailing don't-care bit */
+
+    send_frame(buf, w.pos);
+}
+
+/* One write frame; count must be odd so the frame ends 3 bits short of a byte */
+static void write_burst(uint8_t addr, const uint8_t *nibbles, uint8_t count)
+{
+    uint8_t buf[HT1621_SPI_FRAME_MAX];
+    struct bit_writer w = { .buf = buf };
+
+    memset(buf, 0, sizeof(buf));
+    put_bits(&w, HT1621_MODE_WRITE, 3);
+    put_bits(&w, addr, 6);
+    for (uint8_t i = 0; i < count; i++) {
+        put_bits(&w, nibbles[i], 4);
+    }
+
+    send_frame(buf, w.pos);
+}
+
+static void spi_transport_write(uint8_t addr, const uint8_t *nibbles, uint8_t count)
+{
+    if (count == 0) {
+        return;
+    }
+
+    if ((count & 1) == 0) {
+        write_burst(addr, nibbles, 1);
+        addr++;
+        nibbles++;
+        count--;
+    }
+
+    write_burst(addr, nibbles, count);
+}
+
+const struct ht1621_transport ht1621_transport = {
+    .name = "spi",
+    .init = spi_transport_init,
+    .send_command = spi_transport_send_command,
+    .write = spi_transport_write,
+};
+
+#endif /* DT_HAS_COMPAT_STATUS_OKAY(holtek_ht1621) */
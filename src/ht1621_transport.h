@@ -0,0 +1,53 @@
+/*
+ * ht1621_transport.h - HT1621 bus transport interface
+ *
+ * The HT1621 serial interface is write-only: CS frames a transfer and DATA
+ * is latched on each rising edge of WR. Every frame starts with a 3-bit mode
+ * ID (100 = command, 101 = write), so the controller is driven the same way
+ * whether WR/DATA come from bit-banged GPIOs or from an SPI peripheral.
+ *
+ * Exactly one backend defines the ht1621_transport symbol. The SPI backend
+ * is used when a "holtek,ht1621" node is enabled in devicetree, otherwise
+ * the GPIO backend drives the ht1621-cs/-wr/-data aliases.
+ */
+
+#ifndef HT1621_TRANSPORT_H
+#define HT1621_TRANSPORT_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Frame mode IDs (3 bits, sent MSB first) */
+#define HT1621_MODE_CMD     0x4   /* 100 */
+#define HT1621_MODE_WRITE   0x5   /* 101 */
+
+/* Number of 4-bit RAM addresses in the controller */
+#define HT1621_RAM_SIZE     32
+
+struct ht1621_transport {
+    /* Backend name, for diagnostics */
+    const char *name;
+
+    /* Prepare the bus. Returns 0 on success, negative error code on failure */
+    int (*init)(void);
+
+    /* Send one 8-bit command in a command-mode frame */
+    void (*send_command)(uint8_t cmd);
+
+    /*
+     * Write count nibbles to successive RAM addresses starting at addr,
+     * in a single CS frame where the backend allows it.
+     */
+    void (*write)(uint8_t addr, const uint8_t *nibbles, uint8_t count);
+};
+
+extern const struct ht1621_transport ht1621_transport;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HT1621_TRANSPORT_H */
@@ -0,0 +1,340 @@
+#include "log_export.h"
+#include "cobs.h"
+#include "command_parser.h"
+#include "telemetry.h"
+#include "track.h"
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/uart.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+#include <string.h>
+
+#define FRAME_DATA              0x01
+#define FRAME_END               0x02
+#define FRAME_ACK               0x81
+#define FRAME_STOP              0x82
+
+#define FRAME_HEADER_LEN        5
+#define FRAME_PAYLOAD_MAX       (LOG_EXPORT_FRAME_RECORDS * sizeof(struct track_record))
+#define FRAME_MAX               (FRAME_HEADER_LEN + FRAME_PAYLOAD_MAX + 4)
+#define FRAME_WIRE_MAX          (COBS_MAX_ENCODED_LEN(FRAME_MAX) + 2)
+#define ACK_FRAME_LEN           (FRAME_HEADER_LEN + 4 + 4)
+
+// The ST-LINK virtual COM port tops out at 2 Mbaud
+#define EXPORT_MIN_BAUD         9600
+#define EXPORT_MAX_BAUD         2000000
+
+// Time for text to leave the UART before the baud rate changes
+#define SWITCH_DELAY_MS         100
+// How long the host gets to reopen the port at the new rate
+#define START_TIMEOUT_MS        5000
+// Host and USB latency on top of the time a full window takes on the wire
+#define LATENCY_MS              100
+// Give up after this many ACK timeouts in a row
+#define MAX_TIMEOUTS            10
+
+BUILD_ASSERT(LOG_EXPORT_WINDOW < 32, "ACK mask must cover the window");
+
+struct export_state {
+    uint32_t first;         // Record number of the first record in frame 0
+    uint32_t records;       // Record numbers in the export
+    uint32_t frames;        // DATA frames, END is frame 'frames'
+    uint32_t base;          // Oldest frame not acknowledged
+    uint32_t next;          // Next frame not sent yet
+    uint32_t acked;         // Bit n: frame base + n acknowledged
+    uint32_t retried;       // Bit n: frame base + n sent more than once
+    uint32_t sent_ms[LOG_EXPORT_WINDOW];
+    uint32_t timeout_ms;    // No ACK for this long means a frame was lost
+    uint32_t resent;
+    bool started;           // Host has sent its first ACK
+    uint8_t rx[COBS_MAX_ENCODED_LEN(ACK_FRAME_LEN) + 1];
+    size_t rx_len;
+};
+
+static const struct device *const console = DEVICE_DT_GET(DT_CHOSEN(zephyr_console));
+
+// Too large for the command thread stack
+static struct export_state transfer;
+static uint8_t frame[FRAME_MAX];
+static uint8_t encoded[FRAME_WIRE_MAX];
+
+static int send_frame(struct export_state *x, uint32_t seq)
+{
+    size_t len = FRAME_HEADER_LEN;
+
+    if (seq < x->frames) {
+        uint32_t number = x->first + seq * LOG_EXPORT_FRAME_RECORDS;
+        uint32_t count = MIN(LOG_EXPORT_FRAME_RECORDS, x->first + x->records - number);
+        int ret = track_read_records(number, (struct track_record *)&frame[len], count);
+
+        if (ret < 0) {
+            return ret;
+        }
+        frame[0] = FRAME_DATA;
+        len += ret * sizeof(struct track_record);
+    } else {
+        frame[0] = FRAME_END;
+    }
+    sys_put_le32(seq, &frame[1]);
+    sys_put_le32(crc32_ieee(frame, len), &frame[len]);
+    len += 4;
+
+    // Leading delimiter too, so stray console output cannot corrupt it
+    encoded[0] = 0x00;
+    len = 1 + cobs_encode(&encoded[1], frame, len);
+    encoded[len++] = 0x00;
+
+    for (size_t i = 0; i < len; i++) {
+        uart_poll_out(console, encoded[i]);
+    }
+
+    x->sent_ms[seq % LOG_EXPORT_WINDOW] = k_uptime_get_32();
+    return 0;
+}
+
+// Returns 1 for an ACK that moved things on, 0 for anything else, or
+// -ECANCELED if the host stopped the transfer
+static int handle_host_frame(struct export_state *x)
+{
+    uint8_t buf[ACK_FRAME_LEN];
+    uint32_t seq, mask;
+    int len;
+
+    len = cobs_decode(buf, sizeof(buf), x->rx, x->rx_len);
+    if (len < FRAME_HEADER_LEN + 4 ||
+        crc32_ieee(buf, len - 4) != sys_get_le32(&buf[len - 4])) {
+        return 0;
+    }
+
+    if (buf[0] == FRAME_STOP) {
+        return -ECANCELED;
+    }
+    if (buf[0] != FRAME_ACK || len != ACK_FRAME_LEN) {
+        return 0;
+    }
+
+    seq = sys_get_le32(&buf[1]);
+    mask = sys_get_le32(&buf[5]);
+    if (seq < x->base || seq > x->next) {
+        // Stale, or for frames not sent yet
+        return 0;
+    }
+
+    // Bit 0 is frame seq itself, which the host is still missing
+    mask = (mask << 1) & BIT_MASK(LOG_EXPORT_WINDOW);
+    x->acked = seq == x->base ? x->acked | mask : mask;
+    x->retried >>= seq - x->base;
+    x->base = seq;
+    x->started = true;
+    return 1;
+}
+
+// Handle whatever the host has sent, waiting up to timeout_ms for an ACK.
+// Returns the number of ACKs accepted or a negative error code.
+static int poll_host(struct export_state *x, uint32_t timeout_ms)
+{
+    uint32_t start = k_uptime_get_32();
+    uint8_t buf[16];
+    int acks = 0;
+
+    while (true) {
+        uint32_t elapsed = k_uptime_get_32() - start;
+        k_timeout_t wait = K_NO_WAIT;
+        int n;
+
+        if (acks == 0 && elapsed < timeout_ms) {
+            wait = K_MSEC(timeout_ms - elapsed);
+        }
+        n = command_parser_read_raw(buf, sizeof(buf), wait);
+        if (n == 0) {
+            return acks;
+        }
+
+        for (int i = 0; i < n; i++) {
+            int ret;
+
+            if (buf[i] != 0x00) {
+                // An overlong frame is cut short and then fails the CRC
+                if (x->rx_len < sizeof(x->rx)) {
+                    x->rx[x->rx_len++] = buf[i];
+                }
+                continue;
+            }
+            if (x->rx_len == 0) {
+                continue;
+            }
+
+            ret = handle_host_frame(x);
+            x->rx_len = 0;
+            if (ret < 0) {
+                return ret;
+            }
+            acks += ret;
+        }
+    }
+}
+
+static int resend_frame(struct export_state *x, uint32_t seq)
+{
+    x->retried |= BIT(seq - x->base);
+    x->resent++;
+    return send_frame(x, seq);
+}
+
+// Resend frames the host is missing while it has a later one, i.e. frames
+// that arrived corrupted. A frame already resent is only sent again once
+// that copy should have been acknowledged.
+static int resend_gaps(struct export_state *x)
+{
+    uint32_t now = k_uptime_get_32();
+
+    for (uint32_t seq = x->base; seq < x->next; seq++) {
+        uint32_t bit = seq - x->base;
+        int ret;
+
+        if ((x->acked & BIT(bit)) || (x->acked >> (bit + 1)) == 0) {
+            continue;
+        }
+        if ((x->retried & BIT(bit)) &&
+            now - x->sent_ms[seq % LOG_EXPORT_WINDOW] < x->timeout_ms) {
+            continue;
+        }
+
+        ret = resend_frame(x, seq);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+static int run_transfer(struct export_state *x)
+{
+    uint32_t start = k_uptime_get_32();
+    int timeouts = 0;
+    int ret;
+
+    while (!x->started) {
+        if (k_uptime_get_32() - start > START_TIMEOUT_MS) {
+            return -ETIMEDOUT;
+        }
+        ret = poll_host(x, START_TIMEOUT_MS);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    while (x->base <= x->frames) {
+        // Fill the window, taking in ACKs between frames so the small
+        // console RX ring never overflows
+        while (x->next <= x->frames && x->next < x->base + LOG_EXPORT_WINDOW) {
+            ret = send_frame(x, x->next);
+            if (ret < 0) {
+                return ret;
+            }
+            x->next++;
+
+            ret = poll_host(x, 0);
+            if (ret < 0) {
+                return ret;
+            }
+        }
+
+        ret = poll_host(x, x->timeout_ms);
+        if (ret < 0) {
+            return ret;
+        }
+
+        if (ret == 0) {
+            // Nothing heard back: the oldest frame or its ACK was lost
+            if (++timeouts > MAX_TIMEOUTS) {
+                return -ETIMEDOUT;
+            }
+            ret = resend_frame(x, x->base);
+        } else {
+            timeouts = 0;
+            ret = resend_gaps(x);
+        }
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+int log_export(uint32_t baud)
+{
+    struct uart_config saved, fast;
+    bool telemetry_was, stream_was;
+    uint32_t end, start, elapsed;
+    int ret;
+
+    if (baud < EXPORT_MIN_BAUD || baud > EXPORT_MAX_BAUD) {
+        return -EINVAL;
+    }
+
+    memset(&transfer, 0, sizeof(transfer));
+    ret = track_get_span(&transfer.first, &end);
+    if (ret != 0) {
+        return ret;
+    }
+    transfer.records = end - transfer.first;
+    transfer.frames = DIV_ROUND_UP(transfer.records, LOG_EXPORT_FRAME_RECORDS);
+    // A full window on the wire, 10 bits per byte, plus the host's latency
+    transfer.timeout_ms = LOG_EXPORT_WINDOW * FRAME_WIRE_MAX * 10 * 1000 / baud + LATENCY_MS;
+
+    // Fails without CONFIG_UART_USE_RUNTIME_CONFIGURE
+    ret = uart_config_get(console, &saved);
+    if (ret != 0) {
+        return ret;
+    }
+    fast = saved;
+    fast.baudrate = baud;
+
+    // Keep the wire quiet apart from the export itself
+    telemetry_was = telemetry_is_enabled();
+    stream_was = command_parser_is_streaming();
+    telemetry_set_enabled(false);
+    command_parser_set_streaming(false);
+
+    printk("EXPORT %u %u %u\n", baud, transfer.frames, transfer.records);
+    k_msleep(SWITCH_DELAY_MS);
+
+    command_parser_set_raw(true);
+    start = k_uptime_get_32();
+    ret = uart_configure(console, &fast);
+    if (ret == 0) {
+        ret = run_transfer(&transfer);
+        // Let the last frame leave before switching back
+        k_msleep(SWITCH_DELAY_MS);
+        uart_configure(console, &saved);
+    }
+    elapsed = k_uptime_get_32() - start;
+    command_parser_set_raw(false);
+
+    telemetry_set_enabled(telemetry_was);
+    command_parser_set_streaming(stream_was);
+
+    if (ret == 0) {
+        printk("Exported %u records in %u frames (%u resent), %u ms\n",
+               transfer.records, transfer.frames + 1, transfer.resent, elapsed);
+    }
+    return ret;
+}
+
+// Console commands
+static int cmd_log_export(int argc, char **argv)
+{
+    int32_t baud = LOG_EXPORT_DEFAULT_BAUD;
+
+    if (argc == 1 && (cmd_parse_int(argv[0], &baud) != 0 ||
+                      baud < EXPORT_MIN_BAUD || baud > EXPORT_MAX_BAUD)) {
+        return -EINVAL;
+    }
+    return log_export(baud);
+}
+
+CMD_DEFINE(log_export, "log export", "[baud]",
+           "Download the track store (tools/log_export.py)", cmd_log_export, 0, 1);
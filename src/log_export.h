@@ -0,0 +1,42 @@
+#ifndef LOG_EXPORT_H
+#define LOG_EXPORT_H
+
+#include <stdint.h>
+
+/*
+ * Bulk download of the track store over the console UART
+ * (host side: tools/log_export.py).
+ *
+ * The device announces the transfer with a text line at the console baud
+ * rate, then switches the UART to the export baud rate:
+ *
+ *   EXPORT <baud> <frames> <records>
+ *
+ * and waits for the host's first ACK. Both directions then use frames of
+ * COBS(type | seq | payload | crc32) between two 0x00 delimiters. The CRC is
+ * CRC-32/IEEE over type, seq and payload. All fields are little endian.
+ *
+ *   u8 type, u32 seq
+ *   DATA (0x01)  device -> host, payload: up to LOG_EXPORT_FRAME_RECORDS
+ *                raw struct track_record, frames 0 .. frames - 1
+ *   END  (0x02)  device -> host, seq = frames, no payload
+ *   ACK  (0x81)  host -> device, seq = first frame not yet received,
+ *                payload: u32 mask, bit n set if frame seq + 1 + n arrived
+ *   STOP (0x82)  host -> device, abort the transfer
+ *
+ * The device keeps up to LOG_EXPORT_WINDOW frames in flight. The host ACKs
+ * every frame it gets, good or duplicate. A gap below a received frame
+ * means the frame in it was corrupted, so only that one is sent again; if
+ * ACKs stop coming, the oldest unacknowledged frame is. Once END is
+ * acknowledged the device returns to the console baud rate.
+ */
+
+#define LOG_EXPORT_DEFAULT_BAUD     921600
+#define LOG_EXPORT_FRAME_RECORDS    21      // 504 payload bytes
+#define LOG_EXPORT_WINDOW           16
+
+// Run an export from the command thread. Console output and commands are
+// unavailable until it returns. Returns 0 or a negative error code.
+int log_export(uint32_t baud);
+
+#endif // LOG_EXPORT_H
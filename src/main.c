@@ -5,46 +5,126 @@
 #include <stdio.h>
 
 #include "data_handler.h"
-#include "gps_config.h"
+#include "gnss_quality.h"
 #include "command_parser.h"
 #include "mpu6050_wrapper.h"
 #include "ht1621.h"
 #include "hmc5883l.h"
+#include "telemetry.h"
+#include "dead_reckoning.h"
+#include "time_service.h"
+#include "boot.h"
+#include "supervisor.h"
+#include "stats.h"
 
 
 
 LOG_MODULE_REGISTER(main, LOG_LEVEL_DBG);
 
+// Compass and accelerometer sampling period (50 Hz)
+#define SENSOR_PERIOD_MS 20
+
+static void sample_sensors(void)
+{
+    float heading = 0;
+    bool heading_ok = false;
+    mpu6050_data_t imu;
+    uint32_t start;
+    int ret;
+
+    if (hmc5883l_is_ready()) {
+        start = stats_timer_start();
+        ret = hmc5883l_get_heading(&heading);
+        stats_timer_stop(STATS_T_COMPASS_READ, start);
+
+        if (ret == 0) {
+            struct compass_data c_data = {
+                (uint32_t)(heading * 1000.0f),
+                true,
+                true
+            };
+            set_compass_data(c_data);
+            supervisor_kick(SUP_COMPASS);
+            heading_ok = true;
+        } else {
+            stats_inc(STATS_C_SENSOR_ERR);
+        }
+    }
+
+    if (mpu6050_wrapper_is_ready()) {
+        mpu6050_wrapper_calibrate_update();
+
+        // Accelerometer and gyro in one fetch, for the attitude and DR
+        start = stats_timer_start();
+        ret = mpu6050_wrapper_read(&imu);
+        stats_timer_stop(STATS_T_ACCEL_READ, start);
+
+        if (ret == 0) {
+            struct acc_data a_data = {
+                (int32_t)(imu.roll * 1000.0f),
+                (int32_t)(imu.pitch * 1000.0f),
+                true,
+                true
+            };
+            set_acc_data(a_data);
+            supervisor_kick(SUP_IMU);
+            dr_push_imu(&imu, heading, heading_ok);
+            if (heading_ok) {
+                boot_stage_done(BOOT_STAGE_HEADING, 0);
+            }
+        } else {
+            stats_inc(STATS_C_SENSOR_ERR);
+        }
+    }
+
+    telemetry_tick(TELEMETRY_SRC_SENSORS);
+}
+
 static void gnss_data_cb(const struct device *dev, const struct gnss_data *data)
 {
-    if (data->info.fix_status != GNSS_FIX_STATUS_NO_FIX) {
-        // Update GPS data
-        struct gps_data g_data = {
-            data->nav_data.speed,
-            data->nav_data.bearing,
-            data->utc.hour,
-            data->utc.minute,
-            data->utc.millisecond,
-            data->nav_data.latitude,
-            data->nav_data.longitude,
-            true,
-            true
-        };
-        set_gps_data(g_data);
+    uint64_t local = time_local_now();
+    uint32_t start = stats_timer_start();
+
+    supervisor_kick(SUP_GNSS);
+    struct gps_data g_data = {
+        data->nav_data.speed,
+        data->nav_data.bearing,
+        data->utc.hour,
+        data->utc.minute,
+        data->utc.millisecond,
+        data->utc.month_day,
+        data->utc.month,
+        data->utc.century_year,
+        (int32_t)(data->nav_data.latitude / 100),     // nanodegrees to 1e-7
+        (int32_t)(data->nav_data.longitude / 100),
+        true,
+        true
+    };
+
+    if (data->info.fix_status == GNSS_FIX_STATUS_NO_FIX) {
+        stats_inc(STATS_C_GNSS_NO_FIX);
+    } else {
+        // The receiver's time is good even when its position is not
+        time_gnss_epoch(&g_data, local);
+
+        if (!gnss_quality_accept(&data->info)) {
+            // Poor geometry or too few satellites, keep the last good fix
+            stats_inc(STATS_C_GNSS_REJECTED);
+        } else {
+            // Nav, geofence, DR and track observe gps_chan
+            set_gps_data(g_data);
+            supervisor_kick(SUP_GNSS_FIX);
+            boot_stage_done(BOOT_STAGE_FIX, 0);
+            // Also queues the stream line, printed by the telemetry thread
+            telemetry_tick(TELEMETRY_SRC_GPS);
+        }
 
         // float heading;
         // hmc5883l_get_heading(&heading);
         // printk("heading: %f", heading);
-        
-        // Stream if enabled
-        if (command_parser_is_streaming()) {
-            printk("%02u:%02u:%02u.%03u sog: %u.%03u m/s, cog: %u.%03u deg\n",
-                    g_data.hour, g_data.minute,
-                    g_data.millisecond / 1000, g_data.millisecond % 1000,
-                    g_data.sog / 1000, g_data.sog % 1000,
-                    g_data.cog / 1000, g_data.cog % 1000);
-        }
     }
+
+    stats_timer_stop(STATS_T_GNSS_CB, start);
 }
 
 GNSS_DATA_CALLBACK_DEFINE(DEVICE_DT_GET(DT_ALIAS(gnss)), gnss_data_cb);
@@ -52,30 +132,44 @@ GNSS_DATA_CALLBACK_DEFINE(DEVICE_DT_GET(DT_ALIAS(gnss)), gnss_data_cb);
 int main(void)
 {
     LOG_INF("GPS Application Starting");
+
+    time_service_init();
     
     // Initialize command parser
     // command_parser_init();
     
-    k_sleep(K_SECONDS(1));
-    gps_enable_standard_messages();
-
-    invalidate_sensor_data();
+    // GNSS configuration and the geofences come up on the boot work queue,
+    // the sensors do not wait for them
+    boot_start();
 
+    boot_stage_begin(BOOT_STAGE_IMU);
     int ret = mpu6050_wrapper_init();
     if (ret != 0) {
         printk("Failed to init MPU6050: %d\n", ret);
     }
+    boot_stage_done(BOOT_STAGE_IMU, ret);
+    if (ret == 0) {
+        supervisor_enable(SUP_IMU);
+    }
 
+    boot_stage_begin(BOOT_STAGE_COMPASS);
     ret = compass_init();
     if (ret != 0) {
         printk("Failed to init HMC5883L: %d\n", ret);
     } 
-    float heading;
-    hmc5883l_get_heading(&heading);
-    printk("heading: %f", heading);
-    // Main loop - can add other tasks here
+    boot_stage_done(BOOT_STAGE_COMPASS, ret);
+    if (ret == 0) {
+        supervisor_enable(SUP_COMPASS);
+    }
+    // Stale fixes are marked invalid from here, whether or not one comes
+    supervisor_enable(SUP_GNSS_FIX);
+
+    // Main loop - sample compass and accelerometer for the display and telemetry
+    int64_t next_sample = k_uptime_get();
     while (1) {
-        k_sleep(K_FOREVER);
+        sample_sensors();
+        next_sample += SENSOR_PERIOD_MS;
+        k_sleep(K_TIMEOUT_ABS_MS(next_sample));
     }
     
     return 0;
@@ -1,14 +1,15 @@
 #include "mpu6050_wrapper.h"
+#include "command_parser.h"
+#include "sensor_math.h"
 #include <zephyr/device.h>
 #include <zephyr/drivers/sensor.h>
 #include <zephyr/devicetree.h>
 #include <zephyr/logging/log.h>
 #include <math.h>
+#include <string.h>
 
 LOG_MODULE_REGISTER(mpu6050_wrapper, LOG_LEVEL_DBG);
 
-#define RAD_TO_DEG (180.0f / 3.14159265359f)
-
 static const struct device *mpu6050_dev = NULL;
 static mpu6050_cal_t cal = {0};
 static bool calibrating = false;
@@ -71,20 +72,7 @@ int mpu6050_wrapper_get_orientation(float *pitch, float *roll)
         return -EIO;
     }
     
-    // Normalize
-    float norm = sqrtf(ax*ax + ay*ay + az*az);
-    if (norm < 0.1f) {
-        return -EINVAL;
-    }
-    ax /= norm;
-    ay /= norm;
-    az /= norm;
-    
-    // Calculate pitch and roll
-    *pitch = asinf(-ax) * RAD_TO_DEG;
-    *roll = atan2f(ay, az) * RAD_TO_DEG;
-    
-    return 0;
+    return sensor_math_orientation(ax, ay, az, pitch, roll);
 }
 
 int mpu6050_wrapper_read(mpu6050_data_t *data)
@@ -118,12 +106,11 @@ int mpu6050_wrapper_read(mpu6050_data_t *data)
     data->gyro_y = sensor_value_to_double(&gyro[1]);
     data->gyro_z = sensor_value_to_double(&gyro[2]);
     
-    // Calculate orientation
-    mpu6050_wrapper_get_orientation(&data->pitch, &data->roll);
+    // Orientation from the same sample, no second fetch
+    data->valid = sensor_math_orientation(data->accel_x, data->accel_y, data->accel_z,
+                                          &data->pitch, &data->roll) == 0;
     
-    data->valid = true;
-    
-    return 0;
+    return data->valid ? 0 : -EINVAL;
 }
 
 void mpu6050_wrapper_calibrate_start(void)
@@ -194,4 +181,36 @@ void mpu6050_wrapper_set_calibration(const mpu6050_cal_t *cal_in)
         k_mutex_unlock(&mpu6050_mutex);
         LOG_INF("MPU6050 calibration loaded");
     }
-}
\ No newline at end of file
+}
+
+// Console commands
+static int cmd_accel(int argc, char **argv)
+{
+    mpu6050_data_t data;
+    
+    if (mpu6050_wrapper_read(&data) != 0) {
+        printk("Error reading accel values\n");
+        return 0;
+    }
+    
+    printk("Pitch: %.1f°, Roll: %.1f°\n", data.pitch, data.roll);
+    printk("Accel: X=%.2f Y=%.2f Z=%.2f m/s²\n",
+           data.accel_x, data.accel_y, data.accel_z);
+    return 0;
+}
+
+static int cmd_accel_cal(int argc, char **argv)
+{
+    if (strcmp(argv[0], "start") == 0) {
+        mpu6050_wrapper_calibrate_start();
+        printk("Keep device still on level surface for 5 seconds...\n");
+    } else if (strcmp(argv[0], "stop") == 0) {
+        mpu6050_wrapper_calibrate_finish();
+    } else {
+        return -EINVAL;
+    }
+    return 0;
+}
+
+CMD_DEFINE(accel, "accel", "", "Show pitch, roll and acceleration", cmd_accel, 0, 0);
+CMD_DEFINE(accel_cal, "accel cal", "<start|stop>", "Level calibration", cmd_accel_cal, 1, 1);
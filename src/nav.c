@@ -0,0 +1,355 @@
+#include "nav.h"
+#include "command_parser.h"
+#include "geo.h"
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+
+LOG_MODULE_REGISTER(nav, LOG_LEVEL_INF);
+
+// No ETA below this closing speed
+#define NAV_MIN_VMG             100     // mm/s
+
+#define NAV_MAX_RADIUS_M        10000
+
+struct waypoint {
+    int32_t latitude;       // 1e-7 degrees
+    int32_t longitude;
+    int32_t cos_lat_q15;    // For offsets in this waypoint's frame
+};
+
+static struct waypoint route[NAV_MAX_WAYPOINTS];
+static uint8_t route_len;
+static uint32_t radius_cm = NAV_DEFAULT_RADIUS_M * 100;
+
+// Active leg, in the frame of its mark
+static struct {
+    bool active;
+    bool need_start;        // Start the leg at the next fix
+    uint8_t mark;
+    struct geo_vec start;   // Leg start, cm from the mark
+    struct geo_vec dir;     // Start to mark, GEO_DIR_ONE long
+    bool has_dir;           // False for a zero-length leg
+    bool near;              // Start within GEO_NEAR_E7 of the mark
+    int32_t start_lat;      // For the great-circle XTE off long legs
+    int32_t start_lon;
+    uint32_t bearing;       // Initial great-circle bearing, millidegrees
+} leg;
+
+static struct nav_status status;
+
+static K_MUTEX_DEFINE(nav_mutex);
+
+// Called with nav_mutex held
+static void start_leg(uint8_t mark, int32_t latitude, int32_t longitude)
+{
+    const struct waypoint *wp = &route[mark];
+    uint32_t len;
+
+    leg.active = true;
+    leg.need_start = false;
+    leg.mark = mark;
+    leg.start = geo_offset_cm(wp->latitude, wp->longitude, wp->cos_lat_q15,
+                              latitude, longitude);
+
+    len = geo_length_cm(leg.start);
+    leg.has_dir = len > 0;
+    if (leg.has_dir) {
+        leg.dir.x = -leg.start.x * GEO_DIR_ONE / len;
+        leg.dir.y = -leg.start.y * GEO_DIR_ONE / len;
+    }
+
+    // Once per leg, in case the boat or the start is too far for the above
+    leg.near = geo_is_near(wp->latitude, wp->longitude, latitude, longitude);
+    leg.start_lat = latitude;
+    leg.start_lon = longitude;
+    geo_great_circle(latitude, longitude, wp->latitude, wp->longitude, &len, &leg.bearing);
+}
+
+// Results for the active mark from a fix. Called with nav_mutex held.
+// Returns true once the mark has been reached.
+static bool compute(const struct gps_data *gps)
+{
+    const struct waypoint *wp = &route[leg.mark];
+    struct geo_vec p = geo_offset_cm(wp->latitude, wp->longitude, wp->cos_lat_q15,
+                                     gps->latitude, gps->longitude);
+    bool near = geo_is_near(wp->latitude, wp->longitude, gps->latitude, gps->longitude);
+    int64_t vmg;
+
+    if (near) {
+        struct geo_vec to_mark = { -p.x, -p.y };
+
+        status.distance = geo_length_cm(p);
+        status.bearing = geo_bearing_mdeg(to_mark);
+    } else {
+        geo_great_circle(gps->latitude, gps->longitude, wp->latitude, wp->longitude,
+                         &status.distance, &status.bearing);
+    }
+
+    // Positive when the boat is to the right of the leg direction
+    status.xte = 0;
+    if (!leg.near || !near) {
+        status.xte = geo_cross_track_cm(leg.start_lat, leg.start_lon, leg.bearing,
+                                        gps->latitude, gps->longitude);
+    } else if (leg.has_dir) {
+        struct geo_vec from_start = { p.x - leg.start.x, p.y - leg.start.y };
+
+        status.xte = -geo_cross(leg.dir, from_start) / GEO_DIR_ONE;
+    }
+
+    vmg = (int64_t)gps->sog * geo_cos_q15((int32_t)(gps->cog - status.bearing)) >> 15;
+    status.vmg = vmg;
+    status.eta = NAV_ETA_UNKNOWN;
+    if (vmg >= NAV_MIN_VMG) {
+        // cm * 10 / (mm/s)
+        status.eta = (uint64_t)status.distance * 10 / vmg;
+    }
+
+    status.mark = leg.mark;
+    status.valid = true;
+
+    // In the arrival circle, or past the line through the mark square to
+    // the leg
+    return status.distance <= radius_cm ||
+           (near && leg.has_dir && geo_dot(leg.dir, p) > 0);
+}
+
+void nav_update(const struct gps_data *gps)
+{
+    k_mutex_lock(&nav_mutex, K_FOREVER);
+
+    if (!leg.active || !gps->valid) {
+        status.valid = false;
+        goto out;
+    }
+
+    if (leg.need_start) {
+        start_leg(leg.mark, gps->latitude, gps->longitude);
+    }
+
+    if (compute(gps)) {
+        const struct waypoint *wp = &route[leg.mark];
+
+        LOG_INF("Waypoint %u reached", leg.mark + 1);
+        if (leg.mark + 1 < route_len) {
+            // The next leg runs from the mark just passed
+            start_leg(leg.mark + 1, wp->latitude, wp->longitude);
+            compute(gps);
+        } else {
+            LOG_INF("Route complete");
+            leg.active = false;
+            status.active = false;
+            status.valid = false;
+        }
+    }
+
+out:
+    k_mutex_unlock(&nav_mutex);
+}
+
+static void nav_gps_cb(const struct zbus_channel *chan)
+{
+    nav_update(zbus_chan_const_msg(chan));
+}
+
+ZBUS_LISTENER_DEFINE(nav_gps_lis, nav_gps_cb);
+ZBUS_CHAN_ADD_OBS(gps_chan, nav_gps_lis, 1);
+
+void nav_get_status(struct nav_status *dest)
+{
+    k_mutex_lock(&nav_mutex, K_FOREVER);
+    *dest = status;
+    k_mutex_unlock(&nav_mutex);
+}
+
+int nav_add_waypoint(int32_t latitude, int32_t longitude)
+{
+    int ret = 0;
+
+    if (latitude < -900000000 || latitude > 900000000 ||
+        longitude < -1800000000 || longitude > 1800000000) {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&nav_mutex, K_FOREVER);
+    if (route_len == NAV_MAX_WAYPOINTS) {
+        ret = -ENOSPC;
+        goto out;
+    }
+
+    route[route_len].latitude = latitude;
+    route[route_len].longitude = longitude;
+    route[route_len].cos_lat_q15 = geo_cos_lat_q15(latitude);
+    route_len++;
+    status.count = route_len;
+
+    // The first waypoint starts the route
+    if (route_len == 1) {
+        leg.active = true;
+        leg.need_start = true;
+        leg.mark = 0;
+        status.active = true;
+    }
+
+out:
+    k_mutex_unlock(&nav_mutex);
+    return ret;
+}
+
+void nav_clear(void)
+{
+    k_mutex_lock(&nav_mutex, K_FOREVER);
+    route_len = 0;
+    leg.active = false;
+    memset(&status, 0, sizeof(status));
+    k_mutex_unlock(&nav_mutex);
+}
+
+int nav_goto(uint8_t index)
+{
+    int ret = 0;
+
+    k_mutex_lock(&nav_mutex, K_FOREVER);
+    if (index >= route_len) {
+        ret = -EINVAL;
+    } else {
+        leg.active = true;
+        leg.need_start = true;
+        leg.mark = index;
+        status.active = true;
+        status.valid = false;
+        status.mark = index;
+    }
+    k_mutex_unlock(&nav_mutex);
+    return ret;
+}
+
+void nav_set_radius(uint32_t radius_m)
+{
+    k_mutex_lock(&nav_mutex, K_FOREVER);
+    radius_cm = radius_m * 100;
+    k_mutex_unlock(&nav_mutex);
+}
+
+// Console commands
+static void print_coord(int32_t e7)
+{
+    uint32_t abs = e7 < 0 ? -(int64_t)e7 : e7;
+
+    printk("%s%u.%07u", e7 < 0 ? "-" : "", abs / 10000000, abs % 10000000);
+}
+
+// Thousandths as a decimal
+static void print_milli(int32_t value)
+{
+    uint32_t abs = value < 0 ? -(int64_t)value : value;
+
+    printk("%s%u.%03u", value < 0 ? "-" : "", abs / 1000, abs % 1000);
+}
+
+// Hundredths as a decimal
+static void print_centi(int32_t value)
+{
+    uint32_t abs = value < 0 ? -(int64_t)value : value;
+
+    printk("%s%u.%02u", value < 0 ? "-" : "", abs / 100, abs % 100);
+}
+
+static int cmd_nav(int argc, char **argv)
+{
+    struct waypoint wps[NAV_MAX_WAYPOINTS];
+    struct nav_status st;
+    uint32_t radius;
+    uint8_t count;
+
+    k_mutex_lock(&nav_mutex, K_FOREVER);
+    count = route_len;
+    memcpy(wps, route, sizeof(wps));
+    st = status;
+    radius = radius_cm / 100;
+    k_mutex_unlock(&nav_mutex);
+
+    if (count == 0) {
+        printk("No route\n");
+        return 0;
+    }
+
+    printk("Route: %u waypoints, arrival radius %u m, %s\n", count, radius,
+           st.active ? "active" : "finished");
+    for (int i = 0; i < count; i++) {
+        printk(" %c%2d ", st.active && i == st.mark ? '>' : ' ', i + 1);
+        print_coord(wps[i].latitude);
+        printk(" ");
+        print_coord(wps[i].longitude);
+        printk("\n");
+    }
+
+    if (!st.valid) {
+        printk("No fix\n");
+        return 0;
+    }
+
+    printk("DTW %u m, BTW %u.%u deg, XTE ", st.distance / 100,
+           st.bearing / 1000, st.bearing % 1000 / 100);
+    print_centi(st.xte);
+    printk(" m, VMG ");
+    print_milli(st.vmg);
+    printk(" m/s");
+    if (st.eta != NAV_ETA_UNKNOWN) {
+        printk(", ETA %02u:%02u:%02u", st.eta / 3600, st.eta / 60 % 60, st.eta % 60);
+    }
+    printk("\n");
+    return 0;
+}
+
+static int cmd_nav_add(int argc, char **argv)
+{
+    int32_t latitude, longitude;
+    int ret;
+
+    if (cmd_parse_fixed(argv[0], 7, &latitude) != 0 ||
+        cmd_parse_fixed(argv[1], 7, &longitude) != 0) {
+        return -EINVAL;
+    }
+
+    ret = nav_add_waypoint(latitude, longitude);
+    if (ret == -ENOSPC) {
+        printk("Error: route is full (%d waypoints)\n", NAV_MAX_WAYPOINTS);
+        return 0;
+    }
+    return ret;
+}
+
+static int cmd_nav_clear(int argc, char **argv)
+{
+    nav_clear();
+    return 0;
+}
+
+static int cmd_nav_goto(int argc, char **argv)
+{
+    int32_t index;
+
+    if (cmd_parse_int(argv[0], &index) != 0 || index < 1 || index > NAV_MAX_WAYPOINTS) {
+        return -EINVAL;
+    }
+    return nav_goto(index - 1);
+}
+
+static int cmd_nav_radius(int argc, char **argv)
+{
+    int32_t radius;
+
+    if (cmd_parse_int(argv[0], &radius) != 0 || radius < 1 || radius > NAV_MAX_RADIUS_M) {
+        return -EINVAL;
+    }
+    nav_set_radius(radius);
+    return 0;
+}
+
+CMD_DEFINE(nav, "nav", "", "Show the route and distance/bearing to the mark", cmd_nav, 0, 0);
+CMD_DEFINE(nav_add, "nav add", "<lat> <lon>", "Append a waypoint (decimal degrees)",
+           cmd_nav_add, 2, 2);
+CMD_DEFINE(nav_clear, "nav clear", "", "Delete all waypoints", cmd_nav_clear, 0, 0);
+CMD_DEFINE(nav_goto, "nav goto", "<n>", "Make waypoint n the active mark", cmd_nav_goto, 1, 1);
+CMD_DEFINE(nav_radius, "nav radius", "<m>", "Set the arrival circle radius", cmd_nav_radius, 1, 1);
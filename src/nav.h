@@ -0,0 +1,58 @@
+#ifndef NAV_H
+#define NAV_H
+
+#include "data_handler.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Route navigation: a list of waypoints sailed in order.
+ *
+ * Each GNSS fix updates distance and bearing to the active mark, the
+ * cross-track error from the leg, VMG towards the mark and the ETA. Near
+ * the mark these come from flat cm offsets in the mark's frame (geo.h),
+ * using a cos(latitude) cached per waypoint and a leg direction computed
+ * when the leg starts, so a fix costs a few integer multiplies. Only a mark
+ * more than GEO_NEAR_E7 away falls back to great-circle trig, and then
+ * just for that one mark.
+ *
+ * The mark is passed, and the next one made active, on entering the
+ * arrival circle or on crossing the line through the mark square to the
+ * leg.
+ */
+
+#define NAV_MAX_WAYPOINTS       16
+#define NAV_DEFAULT_RADIUS_M    50
+#define NAV_ETA_UNKNOWN         UINT32_MAX
+
+struct nav_status {
+    bool active;            // Route loaded and not finished
+    bool valid;             // Values below are from a current fix
+    uint8_t mark;           // Index of the active waypoint
+    uint8_t count;          // Waypoints in the route
+    uint32_t distance;      // cm to the mark
+    uint32_t bearing;       // millidegrees true to the mark
+    int32_t xte;            // cm off the leg, positive to starboard of it
+    int32_t vmg;            // mm/s towards the mark
+    uint32_t eta;           // s to the mark at the current VMG, or NAV_ETA_UNKNOWN
+};
+
+// Feed a fix. Called by a listener on gps_chan for each published fix.
+void nav_update(const struct gps_data *gps);
+
+// Copy out the latest results
+void nav_get_status(struct nav_status *status);
+
+// Append a waypoint (1e-7 degrees). Returns -ENOSPC when the route is full.
+int nav_add_waypoint(int32_t latitude, int32_t longitude);
+
+// Drop all waypoints
+void nav_clear(void);
+
+// Make waypoint 'index' the active mark, starting the leg at the boat
+int nav_goto(uint8_t index);
+
+// Arrival circle radius in metres
+void nav_set_radius(uint32_t radius_m);
+
+#endif // NAV_H
@@ -0,0 +1,119 @@
+#include "nmea_encode.h"
+#include <errno.h>
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+static const uint32_t pow10[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000,
+};
+
+// Outside the checksum: '$', '*' and the checksum itself
+static void put_raw(struct nmea_writer *w, char c)
+{
+    if (w->len >= w->size) {
+        w->overflow = true;
+        return;
+    }
+    w->buf[w->len++] = c;
+}
+
+static void put(struct nmea_writer *w, char c)
+{
+    put_raw(w, c);
+    w->checksum ^= (uint8_t)c;
+}
+
+static void put_str(struct nmea_writer *w, const char *str)
+{
+    while (*str != '\0') {
+        put(w, *str++);
+    }
+}
+
+void nmea_writer_init(struct nmea_writer *w, char *buf, size_t size)
+{
+    w->buf = buf;
+    w->size = size;
+    w->len = 0;
+    w->start = 0;
+    w->checksum = 0;
+    w->overflow = false;
+}
+
+void nmea_begin(struct nmea_writer *w, const char *talker, const char *type)
+{
+    w->start = w->len;
+    w->checksum = 0;
+    w->overflow = false;
+
+    put_raw(w, '$');
+    put_str(w, talker);
+    put_str(w, type);
+}
+
+void nmea_field_str(struct nmea_writer *w, const char *str)
+{
+    put(w, ',');
+    put_str(w, str);
+}
+
+void nmea_field_char(struct nmea_writer *w, char c)
+{
+    put(w, ',');
+    if (c != '\0') {
+        put(w, c);
+    }
+}
+
+void nmea_field_empty(struct nmea_writer *w)
+{
+    put(w, ',');
+}
+
+void nmea_field_fixed(struct nmea_writer *w, int32_t value, int scale, int decimals)
+{
+    // Digits come out least significant first
+    char digits[12];
+    uint32_t divisor = pow10[scale - decimals];
+    uint32_t mag = value < 0 ? 0U - (uint32_t)value : (uint32_t)value;
+    bool negative;
+    int n = 0;
+
+    mag = mag / divisor + (mag % divisor >= divisor - divisor / 2 ? 1 : 0);
+    // No "-0.0"
+    negative = value < 0 && mag != 0;
+
+    // At least one digit before the point
+    do {
+        digits[n++] = '0' + mag % 10;
+        mag /= 10;
+    } while (mag != 0 || n <= decimals);
+
+    put(w, ',');
+    if (negative) {
+        put(w, '-');
+    }
+    while (n > 0) {
+        if (n == decimals) {
+            put(w, '.');
+        }
+        put(w, digits[--n]);
+    }
+}
+
+int nmea_end(struct nmea_writer *w)
+{
+    uint8_t checksum = w->checksum;
+
+    put_raw(w, '*');
+    put_raw(w, hex_digits[checksum >> 4]);
+    put_raw(w, hex_digits[checksum & 0x0F]);
+    put_raw(w, '\r');
+    put_raw(w, '\n');
+
+    if (w->overflow) {
+        w->len = w->start;
+        return -ENOSPC;
+    }
+    return w->len - w->start;
+}
@@ -0,0 +1,56 @@
+#ifndef NMEA_ENCODE_H
+#define NMEA_ENCODE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * NMEA 0183 sentence encoder. Integer only and without printf, fields are
+ * written straight into the caller's buffer and the checksum is kept as
+ * they go. Several sentences can be built back to back into one buffer:
+ *
+ *   nmea_writer_init(&w, buf, sizeof(buf));
+ *   nmea_begin(&w, "HC", "HDT");
+ *   nmea_field_fixed(&w, 123456, 3, 1);    // "123.5"
+ *   nmea_field_char(&w, 'T');
+ *   nmea_end(&w);                          // "*hh\r\n"
+ *
+ * A sentence that does not fit is dropped whole, the buffer keeps the
+ * ones before it.
+ */
+
+// Longest sentence the standard allows, '$' to "\r\n"
+#define NMEA_SENTENCE_MAX       82
+
+struct nmea_writer {
+    char *buf;
+    size_t size;
+    size_t len;             // Bytes of complete sentences and the current one
+    size_t start;           // Where the current sentence begins
+    uint8_t checksum;       // XOR of everything after '$'
+    bool overflow;
+};
+
+void nmea_writer_init(struct nmea_writer *w, char *buf, size_t size);
+
+// Start a sentence: "$" talker type, e.g. "HC" "HDT"
+void nmea_begin(struct nmea_writer *w, const char *talker, const char *type);
+
+void nmea_field_str(struct nmea_writer *w, const char *str);
+
+// A one-character field, or an empty one for '\0'
+void nmea_field_char(struct nmea_writer *w, char c);
+
+void nmea_field_empty(struct nmea_writer *w);
+
+// A signed fixed point field. value has 'scale' decimals and is rounded
+// half away from zero to 'decimals' (at most 'scale'): 123456, 3, 1 gives
+// "123.5".
+void nmea_field_fixed(struct nmea_writer *w, int32_t value, int scale, int decimals);
+
+// Close the sentence with its checksum. Returns its length, or -ENOSPC if
+// it did not fit and was dropped.
+int nmea_end(struct nmea_writer *w);
+
+#endif // NMEA_ENCODE_H
@@ -0,0 +1,461 @@
+#include "nmea_talker.h"
+#include "command_parser.h"
+#include "data_handler.h"
+#include "nmea_encode.h"
+#include "sensor_math.h"
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/uart.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/ring_buffer.h>
+#include <string.h>
+
+LOG_MODULE_REGISTER(nmea_talker, LOG_LEVEL_INF);
+
+#define NMEA_STACK_SIZE         1024
+// Below the console, above the display
+#define NMEA_PRIORITY           9
+
+// One tick per period of the highest rate
+#define NMEA_TICK_MS            (1000 / NMEA_MAX_RATE_HZ)
+
+#define NMEA_TALKER_ID          "HC"
+#define NMEA_TX_BUF_SIZE        (NMEA_SENTENCE_COUNT * NMEA_SENTENCE_MAX)
+// Sentences waiting for the TX interrupt, more than one tick's worth
+#define NMEA_TX_RING_SIZE       512
+
+// Each new rate of turn sample moves the output by 1/ROT_FILTER_DIV. The
+// heading steps in whole readings, unfiltered the differences are noisy.
+#define ROT_FILTER_DIV          4
+
+
+// The declination sensor_math_heading() adds, east positive
+#define VARIATION_MDEG          ((int32_t)(MAG_DECLINATION_DEG * 1000.0f))
+
+struct sentence_state {
+    uint8_t rate;           // Hz, 0 = off
+    uint8_t every;          // Ticks per sentence
+    uint8_t count;          // Ticks since the last one, talker thread only
+};
+
+static const char *const sentence_names[NMEA_SENTENCE_COUNT] = {
+    [NMEA_HDT] = "hdt",
+    [NMEA_HDG] = "hdg",
+    [NMEA_ROT] = "rot",
+    [NMEA_XDR] = "xdr",
+};
+
+// Longest sentence of each type, '$' to "\r\n", to plan the UART load
+static const uint8_t sentence_max_len[NMEA_SENTENCE_COUNT] = {
+    [NMEA_HDT] = 19,    // $HCHDT,359.9,T*hh
+    [NMEA_HDG] = 27,    // $HCHDG,359.9,,,180.0,W*hh
+    [NMEA_ROT] = 26,    // $HCROT,-214748364.7,A*hh
+    [NMEA_XDR] = 43,    // $HCXDR,A,-180.0,D,PTCH,A,-180.0,D,ROLL*hh
+};
+
+// Not the console: printk, logging and the telemetry frames share it and
+// would break up the sentences. Without the alias the talker stays off.
+#if DT_NODE_EXISTS(DT_ALIAS(nmea_out))
+static const struct device *const uart = DEVICE_DT_GET(DT_ALIAS(nmea_out));
+#else
+static const struct device *const uart = NULL;
+#endif
+
+static struct sentence_state sentences[NMEA_SENTENCE_COUNT];
+static char tx_buf[NMEA_TX_BUF_SIZE];
+static uint32_t sent[NMEA_SENTENCE_COUNT];
+static uint32_t overruns;           // Ticks dropped, late or with the ring full
+static uint32_t load_bps;           // Bytes per second over the last second
+
+// Rate of turn, talker thread only
+static uint32_t rot_heading;        // mdeg, last sample
+static uint32_t rot_time;           // ms
+static int32_t rot_rate;            // 0.1 deg/min, filtered
+static bool rot_valid;
+
+static K_MUTEX_DEFINE(nmea_mutex);
+// Wakes the talker thread from its idle wait when a rate is set
+static K_SEM_DEFINE(start_sem, 0, 1);
+
+// Filled by the talker thread, emptied by the TX interrupt
+RING_BUF_DECLARE(tx_ring, NMEA_TX_RING_SIZE);
+
+// 8N1, ten bits per character
+static uint32_t capacity(void)
+{
+    struct uart_config cfg;
+
+    if (uart != NULL && uart_config_get(uart, &cfg) == 0) {
+        return cfg.baudrate / 10;
+    }
+#if DT_NODE_EXISTS(DT_ALIAS(nmea_out))
+    return DT_PROP_OR(DT_ALIAS(nmea_out), current_speed, 4800) / 10;
+#else
+    return 0;
+#endif
+}
+
+static uint8_t ticks_per_sentence(uint32_t rate_hz)
+{
+    return rate_hz ? (NMEA_MAX_RATE_HZ + rate_hz / 2) / rate_hz : 0;
+}
+
+// Bytes per second at the longest sentences, with 'sentence' every 'every'
+// ticks and the others as they are. NMEA_SENTENCE_COUNT for the set as it
+// is. Called with nmea_mutex held.
+static uint32_t planned_bps(enum nmea_sentence sentence, uint8_t every)
+{
+    uint32_t bps = 0;
+
+    for (int i = 0; i < NMEA_SENTENCE_COUNT; i++) {
+        uint8_t ticks = (i == sentence) ? every : sentences[i].every;
+
+        if (ticks != 0) {
+            bps += DIV_ROUND_UP(NMEA_MAX_RATE_HZ, ticks) * sentence_max_len[i];
+        }
+    }
+    return bps;
+}
+
+int nmea_talker_set_rate(enum nmea_sentence sentence, uint32_t rate_hz)
+{
+    uint8_t every = ticks_per_sentence(rate_hz);
+
+    if (rate_hz > NMEA_MAX_RATE_HZ) {
+        return -EINVAL;
+    }
+    if (uart == NULL) {
+        return -ENODEV;
+    }
+
+    k_mutex_lock(&nmea_mutex, K_FOREVER);
+    if (planned_bps(sentence, every) > capacity()) {
+        k_mutex_unlock(&nmea_mutex);
+        return -ENOSPC;
+    }
+    sentences[sentence].rate = rate_hz;
+    sentences[sentence].every = every;
+    sentences[sentence].count = 0;
+    k_mutex_unlock(&nmea_mutex);
+
+    if (rate_hz != 0) {
+        k_sem_give(&start_sem);
+    }
+    return 0;
+}
+
+static void update_rot(const struct compass_data *compass, uint32_t now)
+{
+    int32_t diff, sample;
+
+    if (!compass->valid) {
+        rot_valid = false;
+        return;
+    }
+    if (!rot_valid) {
+        rot_heading = compass->heading;
+        rot_time = now;
+        rot_rate = 0;
+        rot_valid = true;
+        return;
+    }
+    if (now == rot_time) {
+        return;
+    }
+
+    // Shortest way round, negative to port
+    diff = (int32_t)compass->heading - (int32_t)rot_heading;
+    if (diff > 180000) {
+        diff -= 360000;
+    } else if (diff < -180000) {
+        diff += 360000;
+    }
+
+    // mdeg per ms to 0.1 deg/min
+    sample = diff * 600 / (int32_t)(now - rot_time);
+    rot_rate += (sample - rot_rate) / ROT_FILTER_DIV;
+    rot_heading = compass->heading;
+    rot_time = now;
+}
+
+// 0.1 degrees, 0-3599, so that 359.96 goes out as 0.0 and not 360.0
+static int32_t heading_ddeg(int32_t mdeg)
+{
+    mdeg %= 360000;
+    if (mdeg < 0) {
+        mdeg += 360000;
+    }
+    return (mdeg + 50) / 100 % 3600;
+}
+
+static int build_hdt(struct nmea_writer *w, const struct compass_data *compass)
+{
+    nmea_begin(w, NMEA_TALKER_ID, "HDT");
+    nmea_field_fixed(w, heading_ddeg(compass->heading), 1, 1);
+    nmea_field_char(w, 'T');
+    return nmea_end(w);
+}
+
+static int build_hdg(struct nmea_writer *w, const struct compass_data *compass)
+{
+    int32_t variation = VARIATION_MDEG;
+
+    // Heading, deviation (none, the sensor is calibrated), variation
+    nmea_begin(w, NMEA_TALKER_ID, "HDG");
+    nmea_field_fixed(w, heading_ddeg((int32_t)compass->heading - variation), 1, 1);
+    nmea_field_empty(w);
+    nmea_field_empty(w);
+    nmea_field_fixed(w, variation < 0 ? -variation : variation, 3, 1);
+    nmea_field_char(w, variation < 0 ? 'W' : 'E');
+    return nmea_end(w);
+}
+
+static int build_rot(struct nmea_writer *w)
+{
+    nmea_begin(w, NMEA_TALKER_ID, "ROT");
+    if (rot_valid) {
+        nmea_field_fixed(w, rot_rate, 1, 1);
+        nmea_field_char(w, 'A');
+    } else {
+        nmea_field_empty(w);
+        nmea_field_char(w, 'V');
+    }
+    return nmea_end(w);
+}
+
+static int build_xdr(struct nmea_writer *w, const struct acc_data *acc)
+{
+    // Type A (angle), value, unit D (degrees), transducer name
+    nmea_begin(w, NMEA_TALKER_ID, "XDR");
+    nmea_field_char(w, 'A');
+    nmea_field_fixed(w, acc->pitch, 3, 1);
+    nmea_field_char(w, 'D');
+    nmea_field_str(w, "PTCH");
+    nmea_field_char(w, 'A');
+    nmea_field_fixed(w, acc->roll, 3, 1);
+    nmea_field_char(w, 'D');
+    nmea_field_str(w, "ROLL");
+    return nmea_end(w);
+}
+
+/*
+ * TX interrupt. Moves queued sentences into the UART FIFO and turns itself
+ * off once the ring is empty, the thread turns it on again with more.
+ */
+static void nmea_tx_isr(const struct device *dev, void *user_data)
+{
+    uint8_t *data;
+    uint32_t len;
+    int filled;
+
+    ARG_UNUSED(user_data);
+
+    while (uart_irq_update(dev) && uart_irq_tx_ready(dev)) {
+        len = ring_buf_get_claim(&tx_ring, &data, NMEA_SENTENCE_MAX);
+        if (len == 0) {
+            uart_irq_tx_disable(dev);
+            break;
+        }
+        filled = uart_fifo_fill(dev, data, len);
+        ring_buf_get_finish(&tx_ring, MAX(filled, 0));
+        if (filled <= 0) {
+            break;
+        }
+    }
+}
+
+static bool any_enabled(void)
+{
+    bool enabled = false;
+
+    k_mutex_lock(&nmea_mutex, K_FOREVER);
+    for (int i = 0; i < NMEA_SENTENCE_COUNT; i++) {
+        enabled = enabled || sentences[i].rate != 0;
+    }
+    k_mutex_unlock(&nmea_mutex);
+    return enabled;
+}
+
+// Bit per enum nmea_sentence that is due this tick
+static uint32_t due_sentences(void)
+{
+    uint32_t due = 0;
+
+    k_mutex_lock(&nmea_mutex, K_FOREVER);
+    for (int i = 0; i < NMEA_SENTENCE_COUNT; i++) {
+        struct sentence_state *st = &sentences[i];
+
+        if (st->every == 0 || ++st->count < st->every) {
+            continue;
+        }
+        st->count = 0;
+        due |= BIT(i);
+    }
+    k_mutex_unlock(&nmea_mutex);
+    return due;
+}
+
+static void nmea_thread(void)
+{
+    struct compass_data compass;
+    struct acc_data acc;
+    struct nmea_writer w;
+    uint32_t window_start, window_bytes = 0;
+    int64_t next;
+    int ret;
+
+    if (uart == NULL) {
+        LOG_INF("No nmea-out UART, NMEA output off");
+        return;
+    }
+    if (!device_is_ready(uart)) {
+        LOG_ERR("NMEA output UART not ready");
+        return;
+    }
+    ret = uart_irq_callback_user_data_set(uart, nmea_tx_isr, NULL);
+    if (ret < 0) {
+        LOG_ERR("NMEA output UART has no TX interrupt (%d)", ret);
+        return;
+    }
+
+    next = k_uptime_get();
+    window_start = (uint32_t)next;
+    while (1) {
+        uint32_t now, due, built = 0;
+
+        // No ticks while every sentence is off
+        if (!any_enabled()) {
+            k_sem_take(&start_sem, K_FOREVER);
+            next = k_uptime_get();
+            window_start = (uint32_t)next;
+            window_bytes = 0;
+            load_bps = 0;
+            continue;
+        }
+
+        next += NMEA_TICK_MS;
+        k_sleep(K_TIMEOUT_ABS_MS(next));
+
+        // Busier threads can hold us past the next tick. Drop the ticks
+        // missed rather than sending them in a burst.
+        if (k_uptime_get() - next >= NMEA_TICK_MS) {
+            next = k_uptime_get();
+            overruns++;
+        }
+
+        get_compass_data(&compass);
+        get_acc_data(&acc);
+        now = k_uptime_get_32();
+        update_rot(&compass, now);
+
+        due = due_sentences();
+        nmea_writer_init(&w, tx_buf, sizeof(tx_buf));
+        for (int i = 0; i < NMEA_SENTENCE_COUNT; i++) {
+            int len = 0;
+
+            if (!(due & BIT(i))) {
+                continue;
+            }
+            // Nothing rather than a stale heading or attitude, ROT has
+            // its own status field
+            switch (i) {
+            case NMEA_HDT:
+                len = compass.valid ? build_hdt(&w, &compass) : 0;
+                break;
+            case NMEA_HDG:
+                len = compass.valid ? build_hdg(&w, &compass) : 0;
+                break;
+            case NMEA_ROT:
+                len = build_rot(&w);
+                break;
+            case NMEA_XDR:
+                len = acc.valid ? build_xdr(&w, &acc) : 0;
+                break;
+            }
+            if (len > 0) {
+                built |= BIT(i);
+            }
+        }
+
+        // Only this thread puts, so the space can only grow meanwhile. A
+        // tick that does not fit is dropped whole, never half a sentence.
+        if (w.len > ring_buf_space_get(&tx_ring)) {
+            overruns++;
+        } else if (w.len > 0) {
+            ring_buf_put(&tx_ring, (uint8_t *)tx_buf, w.len);
+            uart_irq_tx_enable(uart);
+            for (int i = 0; i < NMEA_SENTENCE_COUNT; i++) {
+                if (built & BIT(i)) {
+                    sent[i]++;
+                }
+            }
+            window_bytes += w.len;
+        }
+
+        if (now - window_start >= 1000) {
+            load_bps = window_bytes * 1000 / (now - window_start);
+            window_bytes = 0;
+            window_start = now;
+        }
+    }
+}
+
+// Console commands
+static int cmd_nmea(int argc, char **argv)
+{
+    struct sentence_state snap[NMEA_SENTENCE_COUNT];
+    uint32_t planned;
+
+    if (uart == NULL) {
+        printk("No nmea-out UART alias, NMEA output off\n");
+        return 0;
+    }
+
+    k_mutex_lock(&nmea_mutex, K_FOREVER);
+    memcpy(snap, sentences, sizeof(snap));
+    planned = planned_bps(NMEA_SENTENCE_COUNT, 0);
+    k_mutex_unlock(&nmea_mutex);
+
+    printk("NMEA output on %s\n", uart->name);
+    for (int i = 0; i < NMEA_SENTENCE_COUNT; i++) {
+        if (snap[i].rate == 0) {
+            printk("  %s off\n", sentence_names[i]);
+        } else {
+            printk("  %s %u Hz, %u sent\n", sentence_names[i], snap[i].rate, sent[i]);
+        }
+    }
+    printk("Load %u B/s, at most %u of %u B/s, %u overruns\n", load_bps, planned, capacity(),
+           overruns);
+    return 0;
+}
+
+static int cmd_nmea_rate(int argc, char **argv)
+{
+    int32_t rate;
+    int ret;
+
+    if (cmd_parse_int(argv[1], &rate) != 0 || rate < 0) {
+        return -EINVAL;
+    }
+
+    for (int i = 0; i < NMEA_SENTENCE_COUNT; i++) {
+        if (strcmp(argv[0], sentence_names[i]) != 0) {
+            continue;
+        }
+        ret = nmea_talker_set_rate(i, rate);
+        if (ret == -ENOSPC) {
+            printk("Does not fit the %u B/s of %s (see \"nmea\")\n", capacity(), uart->name);
+            return 0;
+        }
+        return ret;
+    }
+    return -EINVAL;
+}
+
+CMD_DEFINE(nmea, "nmea", "", "Show NMEA output rates and UART load", cmd_nmea, 0, 0);
+CMD_DEFINE(nmea_rate, "nmea rate", "<hdt|hdg|rot|xdr> <hz>",
+           "Sentences per second, up to 20 (0 = off)", cmd_nmea_rate, 2, 2);
+
+K_THREAD_DEFINE(nmea_thread_id, NMEA_STACK_SIZE, nmea_thread, NULL, NULL, NULL,
+                NMEA_PRIORITY, 0, 0);
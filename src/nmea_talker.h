@@ -0,0 +1,41 @@
+#ifndef NMEA_TALKER_H
+#define NMEA_TALKER_H
+
+#include <stdint.h>
+
+/*
+ * NMEA 0183 heading and attitude output for chart plotters and autopilots,
+ * talker "HC" (magnetic compass):
+ *
+ *   HDT  true heading
+ *   HDG  magnetic heading with the variation in MAG_DECLINATION_DEG
+ *   ROT  rate of turn, deg/min, negative to port
+ *   XDR  pitch and roll, transducer names PTCH and ROLL
+ *
+ * Each sentence has its own rate up to NMEA_MAX_RATE_HZ, all off at boot.
+ * The output needs a UART of its own with the "nmea-out" alias. Sentences
+ * are never mixed into the console, whose printk, log and telemetry output
+ * would break them up, so without the alias the talker is off. Sentences
+ * are queued to the UART's TX interrupt, the thread never waits on it.
+ *
+ * At 4800 baud (NMEA 0183) 480 characters per second fit. A rate that
+ * would take the longest sentences of the set past the UART's bytes per
+ * second is refused. With every sentence off the thread sleeps until a
+ * rate is set.
+ */
+
+enum nmea_sentence {
+    NMEA_HDT,
+    NMEA_HDG,
+    NMEA_ROT,
+    NMEA_XDR,
+    NMEA_SENTENCE_COUNT
+};
+
+#define NMEA_MAX_RATE_HZ        20
+
+// Sentences per second, 0 = off. Returns -EINVAL above NMEA_MAX_RATE_HZ,
+// -ENODEV without an nmea-out UART, -ENOSPC if the UART could not keep up.
+int nmea_talker_set_rate(enum nmea_sentence sentence, uint32_t rate_hz);
+
+#endif // NMEA_TALKER_H
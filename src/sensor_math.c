@@ -0,0 +1,49 @@
+#include "sensor_math.h"
+#include <errno.h>
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846f
+#endif
+
+#define RAD_TO_DEG (180.0f / 3.14159265359f)
+
+float sensor_math_heading(float mx, float my)
+{
+    // Calculate heading in radians
+    float heading_rad = atan2f(my, mx);
+
+    // Convert to degrees
+    float heading_deg = heading_rad * 180.0f / M_PI;
+
+    // Apply declination correction
+    heading_deg += MAG_DECLINATION_DEG;
+
+    // Normalize to 0-360 degrees
+    if (heading_deg < 0) {
+        heading_deg += 360.0f;
+    }
+    if (heading_deg >= 360.0f) {
+        heading_deg -= 360.0f;
+    }
+
+    return heading_deg;
+}
+
+int sensor_math_orientation(float ax, float ay, float az, float *pitch, float *roll)
+{
+    // Normalize
+    float norm = sqrtf(ax*ax + ay*ay + az*az);
+    if (norm < 0.1f) {
+        return -EINVAL;
+    }
+    ax /= norm;
+    ay /= norm;
+    az /= norm;
+
+    // Calculate pitch and roll
+    *pitch = asinf(-ax) * RAD_TO_DEG;
+    *roll = atan2f(ay, az) * RAD_TO_DEG;
+
+    return 0;
+}
@@ -0,0 +1,17 @@
+#ifndef SENSOR_MATH_H
+#define SENSOR_MATH_H
+
+#include <stdint.h>
+
+// Local magnetic declination added to the magnetic heading
+#define MAG_DECLINATION_DEG (-11.5f)
+
+// Heading in degrees (0-360) from the horizontal field components,
+// declination corrected. Units of mx/my do not matter.
+float sensor_math_heading(float mx, float my);
+
+// Pitch and roll in degrees from a calibrated acceleration vector.
+// Returns -EINVAL if the vector is too short to give an attitude.
+int sensor_math_orientation(float ax, float ay, float az, float *pitch, float *roll);
+
+#endif // SENSOR_MATH_H
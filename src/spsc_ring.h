@@ -0,0 +1,69 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+#include <stdint.h>
+
+/*
+ * Lock-free single-producer/single-consumer ring of fixed-size slots.
+ *
+ * The producer fills the slot returned by spsc_ring_claim() and publishes
+ * it with spsc_ring_commit(); the consumer reads spsc_ring_peek() and frees
+ * the slot with spsc_ring_release(). head is only written by the producer
+ * and tail only by the consumer, so neither side ever blocks or locks.
+ * The atomic accessors provide the ordering between slot data and index.
+ */
+struct spsc_ring {
+    atomic_t head;          // Next slot to fill (free-running)
+    atomic_t tail;          // Next slot to read (free-running)
+    uint8_t *buf;
+    uint16_t elem_size;
+    uint16_t mask;          // Slot count - 1, slot count is a power of two
+};
+
+#define SPSC_RING_DEFINE(_name, _elem_size, _count)                          \
+    BUILD_ASSERT(IS_POWER_OF_TWO(_count), "slot count must be a power of 2"); \
+    static uint8_t _name##_buf[(_elem_size) * (_count)] __aligned(4);        \
+    static struct spsc_ring _name = {                                        \
+        .buf = _name##_buf,                                                  \
+        .elem_size = (_elem_size),                                           \
+        .mask = (_count) - 1,                                                \
+    }
+
+// Producer: slot to fill, or NULL if the ring is full
+static inline void *spsc_ring_claim(struct spsc_ring *ring)
+{
+    uint32_t head = atomic_get(&ring->head);
+
+    if (head - (uint32_t)atomic_get(&ring->tail) > ring->mask) {
+        return NULL;
+    }
+    return &ring->buf[(head & ring->mask) * ring->elem_size];
+}
+
+// Producer: publish the slot returned by spsc_ring_claim()
+static inline void spsc_ring_commit(struct spsc_ring *ring)
+{
+    atomic_inc(&ring->head);
+}
+
+// Consumer: oldest filled slot, or NULL if the ring is empty
+static inline void *spsc_ring_peek(struct spsc_ring *ring)
+{
+    uint32_t tail = atomic_get(&ring->tail);
+
+    if (tail == (uint32_t)atomic_get(&ring->head)) {
+        return NULL;
+    }
+    return &ring->buf[(tail & ring->mask) * ring->elem_size];
+}
+
+// Consumer: free the slot returned by spsc_ring_peek()
+static inline void spsc_ring_release(struct spsc_ring *ring)
+{
+    atomic_inc(&ring->tail);
+}
+
+#endif // SPSC_RING_H
@@ -0,0 +1,137 @@
+#include "stats.h"
+#include "command_parser.h"
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+
+struct stats_timer_data {
+    atomic_t count;
+    atomic_t sum_lo;        // 64-bit cycle sum split in two lock-free words
+    atomic_t sum_hi;
+    atomic_t max;
+};
+
+static struct stats_timer_data timers[STATS_T_COUNT];
+static atomic_t counters[STATS_C_COUNT];
+
+static const char *const timer_names[STATS_T_COUNT] = {
+    [STATS_T_GNSS_CB]       = "gnss_cb",
+    [STATS_T_COMPASS_READ]  = "compass_read",
+    [STATS_T_ACCEL_READ]    = "accel_read",
+    [STATS_T_DATA_SET]      = "data_set",
+    [STATS_T_DATA_GET]      = "data_get",
+    [STATS_T_DISPLAY_FLUSH] = "display_flush",
+    [STATS_T_DR_STEP]       = "dr_step",
+};
+
+static const char *const counter_names[STATS_C_COUNT] = {
+    [STATS_C_GNSS_NO_FIX]   = "gnss_no_fix",
+    [STATS_C_GNSS_REJECTED] = "gnss_rejected",
+    [STATS_C_SENSOR_ERR]    = "sensor_err",
+    [STATS_C_PUB_DROP]      = "pub_drop",
+    [STATS_C_PUB_LOST]      = "pub_lost",
+    [STATS_C_DISPLAY_SKIP]  = "display_skip",
+};
+
+void stats_timer_stop(enum stats_timer timer, uint32_t start)
+{
+    struct stats_timer_data *t = &timers[timer];
+    uint32_t cycles = k_cycle_get_32() - start;
+    atomic_val_t old;
+
+    atomic_inc(&t->count);
+
+    // Carry into the high word when the low word wraps
+    old = atomic_add(&t->sum_lo, cycles);
+    if ((uint32_t)old + cycles < (uint32_t)old) {
+        atomic_inc(&t->sum_hi);
+    }
+
+    do {
+        old = atomic_get(&t->max);
+        if (cycles <= (uint32_t)old) {
+            break;
+        }
+    } while (!atomic_cas(&t->max, old, cycles));
+}
+
+void stats_inc(enum stats_counter counter)
+{
+    atomic_inc(&counters[counter]);
+}
+
+void stats_reset(void)
+{
+    for (int i = 0; i < STATS_T_COUNT; i++) {
+        atomic_clear(&timers[i].count);
+        atomic_clear(&timers[i].sum_lo);
+        atomic_clear(&timers[i].sum_hi);
+        atomic_clear(&timers[i].max);
+    }
+    for (int i = 0; i < STATS_C_COUNT; i++) {
+        atomic_clear(&counters[i]);
+    }
+}
+
+static void print_thread(const struct k_thread *cthread, void *user_data)
+{
+    struct k_thread *thread = (struct k_thread *)cthread;
+    const uint64_t *total_cycles = user_data;
+    k_thread_runtime_stats_t rt;
+    const char *name = k_thread_name_get(thread);
+    size_t size = thread->stack_info.size;
+    size_t unused = 0;
+    uint32_t permille = 0;
+
+    if (k_thread_runtime_stats_get(thread, &rt) == 0 && *total_cycles > 0) {
+        permille = (uint32_t)(rt.execution_cycles * 1000 / *total_cycles);
+    }
+    k_thread_stack_space_get(thread, &unused);
+
+    printk("  %-16s %3u.%u%%  %4u/%4u\n", (name && name[0]) ? name : "?",
+           permille / 10, permille % 10, (uint32_t)(size - unused), (uint32_t)size);
+}
+
+void stats_print(void)
+{
+    k_thread_runtime_stats_t all;
+    uint64_t total_cycles = 0;
+
+    printk("%-16s %8s %10s %8s %10s\n", "timer", "count", "avg cyc", "avg us", "max cyc");
+    for (int i = 0; i < STATS_T_COUNT; i++) {
+        uint32_t count = atomic_get(&timers[i].count);
+        uint64_t sum = ((uint64_t)(uint32_t)atomic_get(&timers[i].sum_hi) << 32) |
+                       (uint32_t)atomic_get(&timers[i].sum_lo);
+        uint32_t avg = count ? (uint32_t)(sum / count) : 0;
+
+        printk("%-16s %8u %10u %8u %10u\n", timer_names[i], count, avg,
+               k_cyc_to_us_floor32(avg), (uint32_t)atomic_get(&timers[i].max));
+    }
+
+    printk("\n");
+    for (int i = 0; i < STATS_C_COUNT; i++) {
+        printk("%-16s %8u\n", counter_names[i], (uint32_t)atomic_get(&counters[i]));
+    }
+
+    // CPU share is since boot, stack is peak used/size in bytes
+    if (k_thread_runtime_stats_all_get(&all) == 0) {
+        total_cycles = all.execution_cycles;
+    }
+    printk("\n  %-16s %6s  %9s\n", "thread", "cpu", "stack");
+    k_thread_foreach_unlocked(print_thread, &total_cycles);
+}
+
+// Console commands
+static int cmd_stats(int argc, char **argv)
+{
+    stats_print();
+    return 0;
+}
+
+static int cmd_stats_reset(int argc, char **argv)
+{
+    stats_reset();
+    return 0;
+}
+
+CMD_DEFINE(stats, "stats", "", "Show timing, counters, thread CPU and stack use", cmd_stats, 0, 0);
+CMD_DEFINE(stats_reset, "stats reset", "", "Clear timing and counters", cmd_stats_reset, 0, 0);
@@ -0,0 +1,58 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <zephyr/kernel.h>
+#include <stdint.h>
+
+/*
+ * Runtime instrumentation. Counters and timers are plain atomics so they
+ * can be updated from any thread (or ISR) without taking a lock.
+ *
+ *   uint32_t start = stats_timer_start();
+ *   ...work...
+ *   stats_timer_stop(STATS_T_GNSS_CB, start);
+ *
+ * The "stats" console command prints everything together with the
+ * per-thread CPU usage and stack high-water marks.
+ */
+
+// Timed code paths
+enum stats_timer {
+    STATS_T_GNSS_CB,        // gnss_data_cb
+    STATS_T_COMPASS_READ,   // HMC5883L read and heading math
+    STATS_T_ACCEL_READ,     // MPU6050 read and orientation math
+    STATS_T_DATA_SET,       // data_handler set_*_data, publish and listeners
+    STATS_T_DATA_GET,       // data_handler get_*_data
+    STATS_T_DISPLAY_FLUSH,  // LCD frame write
+    STATS_T_DR_STEP,        // Dead-reckoning period: integrate, correct, publish
+    STATS_T_COUNT
+};
+
+// Event counters
+enum stats_counter {
+    STATS_C_GNSS_NO_FIX,    // GNSS callbacks without a fix
+    STATS_C_GNSS_REJECTED,  // Fixes failing the quality gate
+    STATS_C_SENSOR_ERR,     // Failed compass/accelerometer reads
+    STATS_C_PUB_DROP,       // Samples a zbus subscriber missed, its queue full
+    STATS_C_PUB_LOST,       // Samples not published, the channel stayed locked
+    STATS_C_DISPLAY_SKIP,   // Frames not written because nothing changed
+    STATS_C_COUNT
+};
+
+static inline uint32_t stats_timer_start(void)
+{
+    return k_cycle_get_32();
+}
+
+// Account the cycles since 'start' to a timer
+void stats_timer_stop(enum stats_timer timer, uint32_t start);
+
+void stats_inc(enum stats_counter counter);
+
+// Print counters, timers and the thread report on the console
+void stats_print(void);
+
+// Clear counters and timers. Thread runtime stats are cumulative since boot.
+void stats_reset(void);
+
+#endif // STATS_H
@@ -0,0 +1,303 @@
+#include "supervisor.h"
+#include "boot.h"
+#include "command_parser.h"
+#include "data_handler.h"
+#include "gps_config.h"
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/hwinfo.h>
+#include <zephyr/drivers/i2c.h>
+#include <zephyr/drivers/watchdog.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+
+LOG_MODULE_REGISTER(supervisor, LOG_LEVEL_INF);
+
+#define SUP_STACK_SIZE          1024
+// Above every thread it watches except main, so that starving them does
+// not starve it. If main spins the watchdog is not fed, which is the point.
+#define SUP_PRIORITY            1
+
+#define WATCHDOG_NODE           DT_ALIAS(watchdog0)
+
+struct source_desc {
+    const char *name;
+    uint32_t period_ms;     // Default expected period
+    bool critical;          // Holds back the watchdog when late
+    uint32_t retry_ms;      // Between recovery attempts while late
+    void (*invalidate)(void);
+    int (*recover)(void);
+};
+
+struct source_state {
+    atomic_t last;          // ms, last kick
+    uint32_t worst;         // ms, longest gap between kicks, kicker only
+    uint32_t period_ms;     // 0 = the default
+    uint32_t misses;
+    uint32_t recoveries;
+    uint32_t last_recovery;
+    uint32_t late_checks;   // Checks in a row it was late
+    bool enabled;
+    bool late;
+};
+
+static const struct device *const i2c_bus = DEVICE_DT_GET(DT_BUS(DT_NODELABEL(mpu6050)));
+
+#if DT_NODE_HAS_STATUS(WATCHDOG_NODE, okay)
+static const struct device *const wdt = DEVICE_DT_GET(WATCHDOG_NODE);
+#else
+static const struct device *const wdt = NULL;
+#endif
+
+static int recover_i2c(void)
+{
+    // Clocks SCL until a slave stuck mid-byte lets go of SDA
+    return i2c_recover_bus(i2c_bus);
+}
+
+static int recover_gnss(void)
+{
+    // Not while the boot configuration is still sending UBX
+    if (boot_wait(BOOT_STAGE_GNSS_CONFIG, K_NO_WAIT) == -EAGAIN) {
+        return -EAGAIN;
+    }
+    gps_restore_config();
+    return 0;
+}
+
+static const struct source_desc sources[SUP_COUNT] = {
+    [SUP_GNSS]     = { "gnss",    1000, false, 10000, NULL, recover_gnss },
+    [SUP_GNSS_FIX] = { "fix",     1000, false, 0,     invalidate_gps_data, NULL },
+    [SUP_IMU]      = { "imu",     20,   true,  1000,  invalidate_acc_data, recover_i2c },
+    [SUP_COMPASS]  = { "compass", 20,   true,  1000,  invalidate_compass_data, recover_i2c },
+    [SUP_DISPLAY]  = { "display", 200,  true,  0,     NULL, NULL },
+    [SUP_TRACK]    = { "track",   1000, true,  0,     NULL, NULL },
+};
+
+static struct source_state states[SUP_COUNT];
+static int wdt_channel = -1;
+static uint32_t feeds;
+static uint32_t withheld;
+static uint32_t reset_cause;
+
+static K_MUTEX_DEFINE(sup_mutex);
+
+void supervisor_enable(enum sup_source source)
+{
+    k_mutex_lock(&sup_mutex, K_FOREVER);
+    atomic_set(&states[source].last, k_uptime_get_32());
+    states[source].enabled = true;
+    k_mutex_unlock(&sup_mutex);
+}
+
+void supervisor_kick(enum sup_source source)
+{
+    struct source_state *st = &states[source];
+    uint32_t now = k_uptime_get_32();
+    uint32_t gap = now - (uint32_t)atomic_set(&st->last, now);
+
+    if (st->enabled && gap > st->worst) {
+        st->worst = gap;
+    }
+}
+
+void supervisor_set_period(enum sup_source source, uint32_t period_ms)
+{
+    k_mutex_lock(&sup_mutex, K_FOREVER);
+    states[source].period_ms = period_ms;
+    k_mutex_unlock(&sup_mutex);
+}
+
+static uint32_t deadline_ms(int source, const struct source_state *st)
+{
+    return (st->period_ms ? st->period_ms : sources[source].period_ms) * SUP_DEADLINE_PERIODS;
+}
+
+// Called with sup_mutex held. Returns false if a critical source is late.
+// Sets a bit in recover for each source whose recovery is due, for the
+// caller to run once it has let go of the lock.
+static bool check_sources(uint32_t *recover)
+{
+    uint32_t now = k_uptime_get_32();
+    bool healthy = true;
+
+    for (int i = 0; i < SUP_COUNT; i++) {
+        const struct source_desc *desc = &sources[i];
+        struct source_state *st = &states[i];
+        uint32_t age = now - (uint32_t)atomic_get(&st->last);
+
+        if (!st->enabled) {
+            continue;
+        }
+
+        if (age <= deadline_ms(i, st)) {
+            st->late_checks = 0;
+            if (st->late) {
+                st->late = false;
+                LOG_INF("%s back", desc->name);
+            }
+            continue;
+        }
+
+        if (!st->late) {
+            st->late = true;
+            st->misses++;
+            st->last_recovery = now - desc->retry_ms;
+            LOG_WRN("%s missed its deadline, %u ms since the last sample", desc->name, age);
+            // Consumers must not keep using the last sample as current
+            if (desc->invalidate != NULL) {
+                desc->invalidate();
+            }
+        }
+
+        st->late_checks++;
+        if (desc->recover != NULL && st->late_checks >= SUP_RECOVER_CHECKS &&
+            now - st->last_recovery >= desc->retry_ms) {
+            st->last_recovery = now;
+            st->recoveries++;
+            *recover |= BIT(i);
+        }
+
+        if (desc->critical) {
+            healthy = false;
+        }
+    }
+    return healthy;
+}
+
+static int watchdog_start(void)
+{
+    struct wdt_timeout_cfg cfg = {
+        .window.max = SUP_WATCHDOG_MS,
+        .flags = WDT_FLAG_RESET_SOC,
+    };
+    int ret;
+
+    if (wdt == NULL || !device_is_ready(wdt)) {
+        return -ENODEV;
+    }
+
+    ret = wdt_install_timeout(wdt, &cfg);
+    if (ret < 0) {
+        return ret;
+    }
+    wdt_channel = ret;
+
+    // Stopped at a breakpoint, not counted against us
+    return wdt_setup(wdt, WDT_OPT_PAUSE_HALTED_BY_DBG);
+}
+
+static void supervisor_thread(void)
+{
+    int64_t next;
+    int ret;
+
+    if (hwinfo_get_reset_cause(&reset_cause) == 0) {
+        hwinfo_clear_reset_cause();
+        if (reset_cause & RESET_WATCHDOG) {
+            LOG_WRN("Reset by the watchdog");
+        }
+    }
+
+    ret = watchdog_start();
+    if (ret != 0) {
+        LOG_WRN("Watchdog not started: %d", ret);
+    }
+
+    next = k_uptime_get();
+    while (1) {
+        uint32_t recover = 0;
+        bool healthy;
+
+        next += SUP_PERIOD_MS;
+        k_sleep(K_TIMEOUT_ABS_MS(next));
+
+        k_mutex_lock(&sup_mutex, K_FOREVER);
+        healthy = check_sources(&recover);
+        if (healthy) {
+            feeds++;
+        } else {
+            withheld++;
+        }
+        k_mutex_unlock(&sup_mutex);
+
+        if (healthy && wdt_channel >= 0) {
+            wdt_feed(wdt, wdt_channel);
+        }
+
+        // Not under sup_mutex: re-sending the GNSS configuration sleeps for
+        // about 400 ms
+        for (int i = 0; i < SUP_COUNT; i++) {
+            if (recover & BIT(i)) {
+                ret = sources[i].recover();
+                LOG_WRN("%s recovery: %d", sources[i].name, ret);
+            }
+        }
+    }
+}
+
+// Console commands
+static int find_source(const char *name)
+{
+    for (int i = 0; i < SUP_COUNT; i++) {
+        if (strcmp(name, sources[i].name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int cmd_health(int argc, char **argv)
+{
+    struct source_state snap[SUP_COUNT];
+    uint32_t now, fed, missed;
+
+    k_mutex_lock(&sup_mutex, K_FOREVER);
+    memcpy(snap, states, sizeof(snap));
+    fed = feeds;
+    missed = withheld;
+    now = k_uptime_get_32();
+    k_mutex_unlock(&sup_mutex);
+
+    printk("source   period deadline    age  worst misses recov  state\n");
+    for (int i = 0; i < SUP_COUNT; i++) {
+        const struct source_state *st = &snap[i];
+
+        printk("%-8s %6u %8u %6u %6u %6u %5u  %s%s\n", sources[i].name,
+               deadline_ms(i, st) / SUP_DEADLINE_PERIODS, deadline_ms(i, st),
+               now - (uint32_t)atomic_get(&st->last),
+               st->worst, st->misses, st->recoveries,
+               !st->enabled ? "off" : st->late ? "LATE" : "ok",
+               sources[i].critical ? "" : " (not critical)");
+    }
+
+    if (wdt_channel < 0) {
+        printk("Watchdog not running\n");
+    } else {
+        printk("Watchdog %u ms: fed %u, held back %u\n", SUP_WATCHDOG_MS, fed, missed);
+    }
+    printk("Last reset: %s\n", (reset_cause & RESET_WATCHDOG) ? "watchdog" : "other");
+    return 0;
+}
+
+static int cmd_health_period(int argc, char **argv)
+{
+    int source = find_source(argv[0]);
+    int32_t period;
+
+    if (source < 0 || cmd_parse_int(argv[1], &period) != 0 || period < 1 ||
+        period > SUP_WATCHDOG_MS * 10) {
+        return -EINVAL;
+    }
+    supervisor_set_period(source, period);
+    return 0;
+}
+
+CMD_DEFINE(health, "health", "", "Show data deadlines, misses and the watchdog", cmd_health, 0, 0);
+CMD_DEFINE(health_period, "health period", "<gnss|fix|imu|compass|display|track> <ms>",
+           "Set a source's expected period", cmd_health_period, 2, 2);
+
+K_THREAD_DEFINE(supervisor_thread_id, SUP_STACK_SIZE, supervisor_thread, NULL, NULL, NULL,
+                SUP_PRIORITY, 0, 0);
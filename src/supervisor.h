@@ -0,0 +1,59 @@
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Deadline monitor and watchdog.
+ *
+ * Each source kicks the supervisor whenever it delivers: the GNSS callback,
+ * an accepted fix, a good IMU or compass read, a display frame, a pass of
+ * the track thread. A source that goes longer than its deadline (a few
+ * expected periods) without a kick is late:
+ *
+ *  - its miss is counted and its data channel, if it has one, is marked
+ *    not valid so that consumers stop using the old sample
+ *  - once it has been late for SUP_RECOVER_CHECKS checks in a row,
+ *    recovery is tried, and retried while it stays late: I2C bus recovery
+ *    for the IMU and compass, re-sending the UBX configuration for GNSS.
+ *    Recovery runs outside the supervisor's lock, it can take a while.
+ *
+ * The hardware watchdog is fed only while no critical source is late, so
+ * a hung bus or a starved thread that recovery does not fix resets the
+ * board. Sources are supervised from supervisor_enable() on, so hardware
+ * missing at boot does not hold the watchdog back.
+ *
+ * The "health" command shows every source, its misses and recoveries.
+ */
+
+enum sup_source {
+    SUP_GNSS,               // Receiver output, with or without a fix
+    SUP_GNSS_FIX,           // Fixes through the quality gate
+    SUP_IMU,
+    SUP_COMPASS,
+    SUP_DISPLAY,
+    SUP_TRACK,
+    SUP_COUNT
+};
+
+// Supervision period, and how long the watchdog waits for a missed feed
+#define SUP_PERIOD_MS           100
+#define SUP_WATCHDOG_MS         4000
+
+// A source is late after this many expected periods without a kick
+#define SUP_DEADLINE_PERIODS    5
+
+// Late this many checks in a row before recovery, so that one stall (a
+// flash page erase) does not recover a bus that is fine
+#define SUP_RECOVER_CHECKS      3
+
+void supervisor_enable(enum sup_source source);
+
+// The source delivered. Cheap, called from the per-sample paths.
+void supervisor_kick(enum sup_source source);
+
+// Change a source's expected period, e.g. with the GNSS output rate
+void supervisor_set_period(enum sup_source source, uint32_t period_ms);
+
+#endif // SUPERVISOR_H
@@ -0,0 +1,471 @@
+#include "telemetry.h"
+#include "cobs.h"
+#include "command_parser.h"
+#include "data_handler.h"
+#include "dead_reckoning.h"
+#include "geofence.h"
+#include "nav.h"
+#include "spsc_ring.h"
+#include "vibration.h"
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/uart.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+#include <string.h>
+
+#define TELEMETRY_HEADER_LEN    6
+
+// Payload field lengths, as written by the put_*() functions
+#define FLAGS_FIELD_LEN         1
+#define GPS_FIELD_LEN           20
+#define ATTITUDE_FIELD_LEN      12
+#define NAV_FIELD_LEN           21
+#define FENCE_FIELD_LEN         9
+#define DR_FIELD_LEN            24
+#define VIB_FIELD_LEN           (4 + 2 * VIB_BAND_COUNT)
+
+// The fused record is the largest, a 41 byte frame
+#define TELEMETRY_PAYLOAD_MAX   (FLAGS_FIELD_LEN + GPS_FIELD_LEN + ATTITUDE_FIELD_LEN)
+#define TELEMETRY_FRAME_MAX     (TELEMETRY_HEADER_LEN + TELEMETRY_PAYLOAD_MAX + 2)
+
+// Every build_*() must fit the frame buffer in send_record()
+BUILD_ASSERT(FLAGS_FIELD_LEN + GPS_FIELD_LEN <= TELEMETRY_PAYLOAD_MAX, "gps record too long");
+BUILD_ASSERT(FLAGS_FIELD_LEN + ATTITUDE_FIELD_LEN <= TELEMETRY_PAYLOAD_MAX,
+             "att record too long");
+BUILD_ASSERT(FLAGS_FIELD_LEN + NAV_FIELD_LEN <= TELEMETRY_PAYLOAD_MAX, "nav record too long");
+BUILD_ASSERT(FLAGS_FIELD_LEN + FENCE_FIELD_LEN <= TELEMETRY_PAYLOAD_MAX, "fence record too long");
+BUILD_ASSERT(FLAGS_FIELD_LEN + DR_FIELD_LEN <= TELEMETRY_PAYLOAD_MAX, "dr record too long");
+BUILD_ASSERT(FLAGS_FIELD_LEN + VIB_FIELD_LEN <= TELEMETRY_PAYLOAD_MAX, "vib record too long");
+
+// Payload flags byte
+#define FLAG_GPS_VALID          BIT(0)
+#define FLAG_COMPASS_VALID      BIT(1)
+#define FLAG_ACC_VALID          BIT(2)
+#define FLAG_NAV_VALID          BIT(3)  // Nav channel only
+#define FLAG_DR_VALID           BIT(4)  // DR channel only
+#define FLAG_VIB_VALID          BIT(5)  // Vibration channel only
+
+// Queued samples per source. The GPS fix rate is low, sensors run at 50 Hz.
+#define GPS_QUEUE_LEN           4
+#define SENSORS_QUEUE_LEN       16
+#define DR_QUEUE_LEN            8
+#define VIB_QUEUE_LEN           2
+
+#define DRAIN_STACK_SIZE        1024
+#define DRAIN_PRIORITY          K_LOWEST_APPLICATION_THREAD_PRIO
+
+struct telemetry_sample;
+
+struct channel_desc {
+    const char *name;
+    enum telemetry_source source;
+    // Fill payload from a sample, returns the payload length
+    uint8_t (*build)(const struct telemetry_sample *sample, uint8_t *payload);
+};
+
+struct channel_state {
+    uint16_t every;         // Decimation, 0 = off
+    uint16_t count;         // Ticks since the last record, producer only
+    uint8_t seq;            // Drain thread only
+};
+
+// What a producer hands to the drain thread
+struct telemetry_sample {
+    uint32_t uptime;        // ms, when the sample was taken
+    uint8_t channels;       // Channels due, bit per enum telemetry_channel
+    bool text;              // Print the text stream line
+    struct sensor_data snap;
+    struct nav_status nav;  // Only filled when the nav channel is due
+    struct geofence_status fence;   // Only filled when the fence channel is due
+    struct dr_state dr;     // Only filled when the DR channel is due
+    struct vib_result vib;  // Only filled when the vibration channel is due
+};
+
+static const struct device *const console = DEVICE_DT_GET(DT_CHOSEN(zephyr_console));
+
+static bool enabled;
+static struct channel_state channels[TELEMETRY_CH_COUNT] = {
+    [TELEMETRY_CH_GPS]      = { .every = 1 },
+    [TELEMETRY_CH_ATTITUDE] = { .every = 0 },
+    [TELEMETRY_CH_FUSED]    = { .every = 1 },
+    [TELEMETRY_CH_NAV]      = { .every = 1 },
+    [TELEMETRY_CH_FENCE]    = { .every = 1 },
+    [TELEMETRY_CH_DR]       = { .every = 1 },
+    [TELEMETRY_CH_VIB]      = { .every = 1 },
+};
+
+// One ring per source keeps each ring single-producer: the GNSS callback
+// fills gps_queue, the main sampling loop sensors_queue, the DR thread
+// dr_queue and the vibration analysis thread vib_queue.
+SPSC_RING_DEFINE(gps_queue, sizeof(struct telemetry_sample), GPS_QUEUE_LEN);
+SPSC_RING_DEFINE(sensors_queue, sizeof(struct telemetry_sample), SENSORS_QUEUE_LEN);
+SPSC_RING_DEFINE(dr_queue, sizeof(struct telemetry_sample), DR_QUEUE_LEN);
+SPSC_RING_DEFINE(vib_queue, sizeof(struct telemetry_sample), VIB_QUEUE_LEN);
+
+static struct spsc_ring *const queues[TELEMETRY_SRC_COUNT] = {
+    [TELEMETRY_SRC_GPS]     = &gps_queue,
+    [TELEMETRY_SRC_SENSORS] = &sensors_queue,
+    [TELEMETRY_SRC_DR]      = &dr_queue,
+    [TELEMETRY_SRC_VIB]     = &vib_queue,
+};
+
+// Samples lost because the drain thread fell behind
+static atomic_t dropped[TELEMETRY_SRC_COUNT];
+
+static K_SEM_DEFINE(drain_sem, 0, 1);
+
+static uint8_t put_flags(const struct telemetry_sample *sample, uint8_t *p)
+{
+    const struct sensor_data *snap = &sample->snap;
+
+    *p = (snap->gps_data.valid ? FLAG_GPS_VALID : 0) |
+         (snap->compass_data.valid ? FLAG_COMPASS_VALID : 0) |
+         (snap->acc_data.valid ? FLAG_ACC_VALID : 0);
+    return FLAGS_FIELD_LEN;
+}
+
+// i32 lat (1e-7 deg), i32 lon (1e-7 deg), u32 sog (mm/s), u32 cog (mdeg),
+// u32 UTC time of day (ms)
+static uint8_t put_gps(const struct gps_data *gps, uint8_t *p)
+{
+    uint32_t utc_ms = gps->hour * 3600000U + gps->minute * 60000U + gps->millisecond;
+
+    sys_put_le32(gps->latitude, p);
+    sys_put_le32(gps->longitude, p + 4);
+    sys_put_le32(gps->sog, p + 8);
+    sys_put_le32(gps->cog, p + 12);
+    sys_put_le32(utc_ms, p + 16);
+    return GPS_FIELD_LEN;
+}
+
+// u32 heading (mdeg), i32 pitch (mdeg), i32 roll (mdeg)
+static uint8_t put_attitude(const struct sensor_data *snap, uint8_t *p)
+{
+    sys_put_le32(snap->compass_data.heading, p);
+    sys_put_le32(snap->acc_data.pitch, p + 4);
+    sys_put_le32(snap->acc_data.roll, p + 8);
+    return ATTITUDE_FIELD_LEN;
+}
+
+// u8 mark, u32 distance (cm), u32 bearing (mdeg), i32 xte (cm),
+// i32 vmg (mm/s), u32 eta (s)
+static uint8_t put_nav(const struct nav_status *nav, uint8_t *p)
+{
+    p[0] = nav->mark;
+    sys_put_le32(nav->distance, p + 1);
+    sys_put_le32(nav->bearing, p + 5);
+    sys_put_le32(nav->xte, p + 9);
+    sys_put_le32(nav->vmg, p + 13);
+    sys_put_le32(nav->eta, p + 17);
+    return NAV_FIELD_LEN;
+}
+
+// u8 fences, u16 inside (bit per fence), u16 dwelling, u16 events (wraps),
+// u8 last event (enum geofence_event), u8 last event fence
+static uint8_t put_fence(const struct geofence_status *fence, uint8_t *p)
+{
+    p[0] = fence->count;
+    sys_put_le16(fence->inside, p + 1);
+    sys_put_le16(fence->dwelling, p + 3);
+    sys_put_le16(fence->events, p + 5);
+    p[7] = fence->last_event;
+    p[8] = fence->last_fence;
+    return FENCE_FIELD_LEN;
+}
+
+// i32 lat (1e-7 deg), i32 lon (1e-7 deg), i32 east and north velocity
+// (mm/s), u32 1-sigma position uncertainty (cm), u32 time since the fix (ms)
+static uint8_t put_dr(const struct dr_state *dr, uint8_t *p)
+{
+    sys_put_le32(dr->latitude, p);
+    sys_put_le32(dr->longitude, p + 4);
+    sys_put_le32(dr->ve, p + 8);
+    sys_put_le32(dr->vn, p + 12);
+    sys_put_le32(dr->sigma, p + 16);
+    sys_put_le32(dr->age, p + 20);
+    return DR_FIELD_LEN;
+}
+
+// u16 dominant frequency (0.01 Hz), u16 RMS (mg), u16 RMS per band (mg)
+// x VIB_BAND_COUNT
+static uint8_t put_vib(const struct vib_result *vib, uint8_t *p)
+{
+    sys_put_le16(vib->peak_chz, p);
+    sys_put_le16(vib->rms_mg, p + 2);
+    for (int band = 0; band < VIB_BAND_COUNT; band++) {
+        sys_put_le16(vib->band_mg[band], p + 4 + 2 * band);
+    }
+    return VIB_FIELD_LEN;
+}
+
+static uint8_t build_gps(const struct telemetry_sample *sample, uint8_t *payload)
+{
+    uint8_t len = put_flags(sample, payload);
+
+    return len + put_gps(&sample->snap.gps_data, payload + len);
+}
+
+static uint8_t build_attitude(const struct telemetry_sample *sample, uint8_t *payload)
+{
+    uint8_t len = put_flags(sample, payload);
+
+    return len + put_attitude(&sample->snap, payload + len);
+}
+
+static uint8_t build_fused(const struct telemetry_sample *sample, uint8_t *payload)
+{
+    uint8_t len = put_flags(sample, payload);
+
+    len += put_gps(&sample->snap.gps_data, payload + len);
+    return len + put_attitude(&sample->snap, payload + len);
+}
+
+static uint8_t build_nav(const struct telemetry_sample *sample, uint8_t *payload)
+{
+    uint8_t len = put_flags(sample, payload);
+
+    if (sample->nav.valid) {
+        payload[0] |= FLAG_NAV_VALID;
+    }
+    return len + put_nav(&sample->nav, payload + len);
+}
+
+static uint8_t build_fence(const struct telemetry_sample *sample, uint8_t *payload)
+{
+    uint8_t len = put_flags(sample, payload);
+
+    return len + put_fence(&sample->fence, payload + len);
+}
+
+static uint8_t build_dr(const struct telemetry_sample *sample, uint8_t *payload)
+{
+    uint8_t len = put_flags(sample, payload);
+
+    if (sample->dr.valid) {
+        payload[0] |= FLAG_DR_VALID;
+    }
+    return len + put_dr(&sample->dr, payload + len);
+}
+
+static uint8_t build_vib(const struct telemetry_sample *sample, uint8_t *payload)
+{
+    uint8_t len = put_flags(sample, payload);
+
+    if (sample->vib.valid) {
+        payload[0] |= FLAG_VIB_VALID;
+    }
+    return len + put_vib(&sample->vib, payload + len);
+}
+
+static const struct channel_desc channel_descs[TELEMETRY_CH_COUNT] = {
+    [TELEMETRY_CH_GPS]      = { "gps",   TELEMETRY_SRC_GPS,     build_gps },
+    [TELEMETRY_CH_ATTITUDE] = { "att",   TELEMETRY_SRC_SENSORS, build_attitude },
+    [TELEMETRY_CH_FUSED]    = { "fused", TELEMETRY_SRC_SENSORS, build_fused },
+    [TELEMETRY_CH_NAV]      = { "nav",   TELEMETRY_SRC_GPS,     build_nav },
+    [TELEMETRY_CH_FENCE]    = { "fence", TELEMETRY_SRC_GPS,     build_fence },
+    [TELEMETRY_CH_DR]       = { "dr",    TELEMETRY_SRC_DR,      build_dr },
+    [TELEMETRY_CH_VIB]      = { "vib",   TELEMETRY_SRC_VIB,     build_vib },
+};
+
+static void send_record(enum telemetry_channel ch, const struct telemetry_sample *sample)
+{
+    uint8_t frame[TELEMETRY_FRAME_MAX];
+    uint8_t encoded[COBS_MAX_ENCODED_LEN(TELEMETRY_FRAME_MAX) + 2];
+    size_t len;
+
+    frame[0] = ch;
+    frame[1] = channels[ch].seq++;
+    sys_put_le32(sample->uptime, &frame[2]);
+    len = TELEMETRY_HEADER_LEN +
+          channel_descs[ch].build(sample, &frame[TELEMETRY_HEADER_LEN]);
+    sys_put_le16(crc16_itu_t(0xFFFF, frame, len), &frame[len]);
+    len += 2;
+
+    // Leading delimiter too, so console text before the frame cannot corrupt it
+    encoded[0] = 0x00;
+    len = 1 + cobs_encode(&encoded[1], frame, len);
+    encoded[len++] = 0x00;
+
+    for (size_t i = 0; i < len; i++) {
+        uart_poll_out(console, encoded[i]);
+    }
+}
+
+static void print_stream_line(const struct gps_data *gps)
+{
+    printk("%02u:%02u:%02u.%03u sog: %u.%03u m/s, cog: %u.%03u deg\n",
+           gps->hour, gps->minute,
+           gps->millisecond / 1000, gps->millisecond % 1000,
+           gps->sog / 1000, gps->sog % 1000,
+           gps->cog / 1000, gps->cog % 1000);
+}
+
+void telemetry_tick(enum telemetry_source src)
+{
+    struct telemetry_sample *sample;
+    uint8_t due = 0;
+    bool text = false;
+
+    if (enabled) {
+        for (int ch = 0; ch < TELEMETRY_CH_COUNT; ch++) {
+            struct channel_state *state = &channels[ch];
+
+            if (channel_descs[ch].source != src || state->every == 0) {
+                continue;
+            }
+            if (++state->count < state->every) {
+                continue;
+            }
+            state->count = 0;
+            due |= BIT(ch);
+        }
+    }
+
+    if (src == TELEMETRY_SRC_GPS && command_parser_is_streaming()) {
+        text = true;
+    }
+
+    if (due == 0 && !text) {
+        return;
+    }
+
+    // Never wait for the console here, drop the sample if the queue is full
+    sample = spsc_ring_claim(queues[src]);
+    if (sample == NULL) {
+        atomic_inc(&dropped[src]);
+        return;
+    }
+
+    sample->uptime = k_uptime_get_32();
+    sample->channels = due;
+    sample->text = text;
+    get_sensors_data(&sample->snap);
+    if (due & BIT(TELEMETRY_CH_NAV)) {
+        nav_get_status(&sample->nav);
+    } else {
+        sample->nav.valid = false;
+    }
+    if (due & BIT(TELEMETRY_CH_FENCE)) {
+        geofence_get_status(&sample->fence);
+    }
+    if (due & BIT(TELEMETRY_CH_DR)) {
+        dr_get_state(&sample->dr);
+    } else {
+        sample->dr.valid = false;
+    }
+    if (due & BIT(TELEMETRY_CH_VIB)) {
+        vib_get_result(&sample->vib);
+    } else {
+        sample->vib.valid = false;
+    }
+    spsc_ring_commit(queues[src]);
+
+    k_sem_give(&drain_sem);
+}
+
+static void drain_thread(void)
+{
+    while (1) {
+        k_sem_take(&drain_sem, K_FOREVER);
+
+        for (int src = 0; src < TELEMETRY_SRC_COUNT; src++) {
+            struct telemetry_sample *sample;
+
+            while ((sample = spsc_ring_peek(queues[src])) != NULL) {
+                for (int ch = 0; ch < TELEMETRY_CH_COUNT; ch++) {
+                    if (sample->channels & BIT(ch)) {
+                        send_record(ch, sample);
+                    }
+                }
+                if (sample->text) {
+                    print_stream_line(&sample->snap.gps_data);
+                }
+                spsc_ring_release(queues[src]);
+            }
+        }
+    }
+}
+
+void telemetry_set_enabled(bool enable)
+{
+    enabled = enable;
+}
+
+bool telemetry_is_enabled(void)
+{
+    return enabled;
+}
+
+int telemetry_set_decimation(enum telemetry_channel ch, uint16_t every)
+{
+    if (ch >= TELEMETRY_CH_COUNT) {
+        return -EINVAL;
+    }
+
+    channels[ch].every = every;
+    channels[ch].count = 0;
+    return 0;
+}
+
+uint32_t telemetry_get_dropped(enum telemetry_source src)
+{
+    if (src >= TELEMETRY_SRC_COUNT) {
+        return 0;
+    }
+    return atomic_get(&dropped[src]);
+}
+
+// Console commands
+static int cmd_telemetry(int argc, char **argv)
+{
+    bool enable;
+
+    if (argc == 1) {
+        if (cmd_parse_on_off(argv[0], &enable) != 0) {
+            return -EINVAL;
+        }
+        telemetry_set_enabled(enable);
+        return 0;
+    }
+
+    printk("Telemetry %s\n", enabled ? "on" : "off");
+    for (int ch = 0; ch < TELEMETRY_CH_COUNT; ch++) {
+        if (channels[ch].every == 0) {
+            printk("  %-6s off\n", channel_descs[ch].name);
+        } else {
+            printk("  %-6s every %u\n", channel_descs[ch].name, channels[ch].every);
+        }
+    }
+    printk("Dropped: gps %u, sensors %u, dr %u, vib %u\n",
+           telemetry_get_dropped(TELEMETRY_SRC_GPS),
+           telemetry_get_dropped(TELEMETRY_SRC_SENSORS),
+           telemetry_get_dropped(TELEMETRY_SRC_DR),
+           telemetry_get_dropped(TELEMETRY_SRC_VIB));
+    return 0;
+}
+
+static int cmd_telemetry_chan(int argc, char **argv)
+{
+    int32_t every;
+
+    if (cmd_parse_int(argv[1], &every) != 0 || every < 0 || every > UINT16_MAX) {
+        return -EINVAL;
+    }
+
+    for (int ch = 0; ch < TELEMETRY_CH_COUNT; ch++) {
+        if (strcmp(argv[0], channel_descs[ch].name) == 0) {
+            return telemetry_set_decimation(ch, every);
+        }
+    }
+    return -EINVAL;
+}
+
+CMD_DEFINE(telemetry, "telemetry", "[on|off]", "Binary telemetry on/off, or show channels",
+           cmd_telemetry, 0, 1);
+CMD_DEFINE(telemetry_chan, "telemetry chan", "<gps|att|fused|nav|fence|dr|vib> <every>",
+           "Send every nth record of a channel (0 = off)", cmd_telemetry_chan, 2, 2);
+
+K_THREAD_DEFINE(telemetry_drain_id, DRAIN_STACK_SIZE, drain_thread, NULL, NULL, NULL,
+                DRAIN_PRIORITY, 0, 0);
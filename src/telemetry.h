@@ -0,0 +1,60 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Binary telemetry on the console UART.
+ *
+ * Every record is one frame: COBS(header | payload | crc16) between two
+ * 0x00 delimiters. The CRC is CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF)
+ * over header and payload. All fields are little endian.
+ *
+ *   header: u8 channel, u8 sequence (per channel), u32 uptime (ms)
+ *
+ * Text printed on the console between frames fails the CRC and is dropped
+ * by the host decoder (tools/telemetry_decode.py).
+ *
+ * Producers never touch the UART. telemetry_tick() snapshots data_handler
+ * into a per-source lock-free queue and a low priority drain thread does the
+ * encoding and console output, including the text stream ("stream on").
+ * When the drain thread falls behind, new samples are dropped and counted.
+ */
+
+// Record sources. Producers call telemetry_tick() each time one updates.
+enum telemetry_source {
+    TELEMETRY_SRC_GPS,      // New GNSS fix
+    TELEMETRY_SRC_SENSORS,  // New compass/accelerometer sample
+    TELEMETRY_SRC_DR,       // Dead-reckoning period
+    TELEMETRY_SRC_VIB,      // Vibration window analysed
+    TELEMETRY_SRC_COUNT
+};
+
+// Channels. Payload layouts are in telemetry.c and the host decoder.
+enum telemetry_channel {
+    TELEMETRY_CH_GPS,       // Position, SOG, COG, UTC time of day
+    TELEMETRY_CH_ATTITUDE,  // Heading, pitch, roll
+    TELEMETRY_CH_FUSED,     // GPS and attitude in one record
+    TELEMETRY_CH_NAV,       // Distance, bearing, XTE, VMG, ETA to the active mark
+    TELEMETRY_CH_FENCE,     // Geofence state and event counter
+    TELEMETRY_CH_DR,        // Dead-reckoned position, velocity and uncertainty
+    TELEMETRY_CH_VIB,       // Vibration peak frequency, RMS and band levels
+    TELEMETRY_CH_COUNT
+};
+
+// Start/stop binary output
+void telemetry_set_enabled(bool enable);
+bool telemetry_is_enabled(void);
+
+// Send every nth record of a channel, 0 = channel off
+int telemetry_set_decimation(enum telemetry_channel ch, uint16_t every);
+
+// Called by producers when a source has new data. Never blocks on the
+// console; each source must only be ticked from one thread.
+void telemetry_tick(enum telemetry_source src);
+
+// Samples dropped because the output queue of a source was full
+uint32_t telemetry_get_dropped(enum telemetry_source src);
+
+#endif // TELEMETRY_H
@@ -0,0 +1,282 @@
+#include "time_service.h"
+#include "command_parser.h"
+#include <zephyr/kernel.h>
+#include <zephyr/sys/timeutil.h>
+#include <zephyr/logging/log.h>
+#include <time.h>
+
+LOG_MODULE_REGISTER(time_service, LOG_LEVEL_INF);
+
+// Limits on the rate correction, in parts per billion. The PLL runs from
+// HSI16, which is only good to about 1% over temperature.
+#define MAX_DRIFT_PPB           20000000LL
+#define MAX_SLEW_PPB            500000LL
+
+// NMEA times have 1 ms resolution, so the first drift estimate is taken
+// over this long a baseline. Short enough that a 2% error stays under
+// TIME_STEP_NS.
+#define ACQUIRE_NS              4000000000LL
+
+// Each epoch takes 1/PHASE_DIV of the error into the slew for the next
+// interval and 1/FREQ_DIV into the drift estimate, close to critically
+// damped
+#define PHASE_DIV               4
+#define FREQ_DIV                64
+
+enum sync_state {
+    SYNC_NONE,              // No epoch yet
+    SYNC_ACQUIRE,           // Stepped, measuring the drift
+    SYNC_TRACK,             // Slewing
+};
+
+static const char *const state_names[] = {
+    [SYNC_NONE]    = "not synced",
+    [SYNC_ACQUIRE] = "acquiring",
+    [SYNC_TRACK]   = "tracking",
+};
+
+static struct k_spinlock time_lock;
+static struct time_model model;
+static int64_t nominal_mult;
+static uint32_t cycles_per_sec;
+
+static enum sync_state state;
+static uint64_t last_epoch;         // Local time of the last epoch
+static uint64_t last_step;          // Local time of the last step
+static int64_t drift_ppb;           // Local clock rate error, ppb
+static int64_t slew_ppb;            // Extra rate to absorb the last error
+static int64_t last_error;          // ns, fix minus model at the last epoch
+static uint32_t epochs;
+static uint32_t steps;
+
+#ifndef CONFIG_TIMER_HAS_64BIT_CYCLE_COUNTER
+static struct k_spinlock cycle_lock;
+static uint64_t cycle_high;
+static uint32_t cycle_low;
+#endif
+
+uint64_t time_local_now(void)
+{
+#ifdef CONFIG_TIMER_HAS_64BIT_CYCLE_COUNTER
+    return k_cycle_get_64();
+#else
+    k_spinlock_key_t key = k_spin_lock(&cycle_lock);
+    uint32_t now = k_cycle_get_32();
+    uint64_t local;
+
+    // Needs a call at least once per wrap, see wrap_timer
+    if (now < cycle_low) {
+        cycle_high += 1ULL << 32;
+    }
+    cycle_low = now;
+    local = cycle_high | now;
+    k_spin_unlock(&cycle_lock, key);
+    return local;
+#endif
+}
+
+static void wrap_timer_fn(struct k_timer *timer)
+{
+    time_local_now();
+}
+
+static K_TIMER_DEFINE(wrap_timer, wrap_timer_fn, NULL);
+
+// Any span, split so the multiply cannot overflow. Called with time_lock
+// held.
+static int64_t model_utc_ns(uint64_t local)
+{
+    int64_t delta = (int64_t)(local - model.local);
+    int64_t high = delta >> TIME_MULT_SHIFT;
+    int64_t low = delta & ((1LL << TIME_MULT_SHIFT) - 1);
+
+    return model.utc_ns + high * model.mult + ((low * model.mult) >> TIME_MULT_SHIFT);
+}
+
+static int64_t cycles_to_ns(uint64_t cycles)
+{
+    return (int64_t)(cycles / cycles_per_sec) * NSEC_PER_SEC +
+           (int64_t)(cycles % cycles_per_sec) * NSEC_PER_SEC / cycles_per_sec;
+}
+
+static int64_t clamp64(int64_t value, int64_t limit)
+{
+    return value > limit ? limit : value < -limit ? -limit : value;
+}
+
+// Called with time_lock held
+static void set_rate(void)
+{
+    model.mult = nominal_mult + nominal_mult * (drift_ppb + slew_ppb) / NSEC_PER_SEC;
+}
+
+// Called with time_lock held
+static void step(uint64_t local, int64_t utc_ns)
+{
+    last_step = local;
+    model.local = local;
+    model.utc_ns = utc_ns;
+    slew_ppb = 0;
+    set_rate();
+}
+
+// UTC ns since 1970 of a fix, -1 if the receiver has no date yet
+static int64_t gps_utc_ns(const struct gps_data *gps)
+{
+    struct tm tm = {
+        .tm_year = 100 + gps->year,
+        .tm_mon = gps->month - 1,
+        .tm_mday = gps->day,
+        .tm_hour = gps->hour,
+        .tm_min = gps->minute,
+        .tm_sec = gps->millisecond / 1000,
+    };
+
+    if (gps->month == 0 || gps->day == 0) {
+        return -1;
+    }
+    return timeutil_timegm64(&tm) * NSEC_PER_SEC + (gps->millisecond % 1000) * 1000000LL;
+}
+
+void time_gnss_epoch(const struct gps_data *gps, uint64_t local)
+{
+    int64_t utc = gps_utc_ns(gps);
+    int64_t interval, rate, error = 0;
+    k_spinlock_key_t key;
+    bool stepped = false;
+
+    // Before time_service_init() or without a date
+    if (utc < 0 || cycles_per_sec == 0) {
+        return;
+    }
+    utc += TIME_FIX_LATENCY_NS;
+
+    key = k_spin_lock(&time_lock);
+    epochs++;
+
+    if (state == SYNC_NONE) {
+        step(local, utc);
+        state = SYNC_ACQUIRE;
+        goto out;
+    }
+
+    interval = cycles_to_ns(local - last_epoch);
+    if (interval <= 0) {
+        goto out;
+    }
+
+    error = utc - model_utc_ns(local);
+    last_error = error;
+    // Rate error over the last interval, ppb
+    rate = error * NSEC_PER_SEC / interval;
+
+    if (error > TIME_STEP_NS || error < -TIME_STEP_NS) {
+        step(local, utc);
+        steps++;
+        stepped = true;
+        state = SYNC_ACQUIRE;
+    } else if (state == SYNC_ACQUIRE) {
+        // Free-run until the baseline is long enough, then take the drift
+        // straight from the error and start clean
+        interval = cycles_to_ns(local - last_step);
+        if (interval >= ACQUIRE_NS) {
+            drift_ppb = clamp64(drift_ppb + error * NSEC_PER_SEC / interval, MAX_DRIFT_PPB);
+            step(local, utc);
+            state = SYNC_TRACK;
+        }
+    } else {
+        // Rebase where the model is now so that UTC stays continuous, and
+        // run fast or slow to take out the error over the next interval
+        model.utc_ns = model_utc_ns(local);
+        model.local = local;
+        drift_ppb = clamp64(drift_ppb + rate / FREQ_DIV, MAX_DRIFT_PPB);
+        slew_ppb = clamp64(rate / PHASE_DIV, MAX_SLEW_PPB);
+        set_rate();
+    }
+
+out:
+    last_epoch = local;
+    k_spin_unlock(&time_lock, key);
+
+    if (stepped) {
+        LOG_WRN("UTC stepped by %lld us", (long long)(error / 1000));
+    }
+}
+
+bool time_get_model(struct time_model *dest)
+{
+    k_spinlock_key_t key = k_spin_lock(&time_lock);
+    bool synced = state != SYNC_NONE;
+
+    *dest = model;
+    k_spin_unlock(&time_lock, key);
+    return synced;
+}
+
+int time_to_utc_ns(uint64_t local, int64_t *utc_ns)
+{
+    k_spinlock_key_t key = k_spin_lock(&time_lock);
+    int ret = 0;
+
+    if (state == SYNC_NONE) {
+        ret = -EAGAIN;
+    } else {
+        *utc_ns = model_utc_ns(local);
+    }
+    k_spin_unlock(&time_lock, key);
+    return ret;
+}
+
+int time_service_init(void)
+{
+    uint32_t wrap_s;
+
+    cycles_per_sec = sys_clock_hw_cycles_per_sec();
+    nominal_mult = ((int64_t)NSEC_PER_SEC << TIME_MULT_SHIFT) / cycles_per_sec;
+    model.mult = nominal_mult;
+
+    // Four times per wrap of the 32-bit cycle counter
+    wrap_s = MAX(UINT32_MAX / cycles_per_sec / 4, 1);
+    k_timer_start(&wrap_timer, K_SECONDS(wrap_s), K_SECONDS(wrap_s));
+    return 0;
+}
+
+// Console commands
+static int cmd_time(int argc, char **argv)
+{
+    int64_t utc, error, drift, slew;
+    enum sync_state st;
+    uint32_t n, stepped;
+    uint64_t age;
+    struct tm tm;
+    time_t secs;
+
+    k_spinlock_key_t key = k_spin_lock(&time_lock);
+    utc = model_utc_ns(time_local_now());
+    error = last_error;
+    drift = drift_ppb;
+    slew = slew_ppb;
+    st = state;
+    n = epochs;
+    stepped = steps;
+    age = cycles_to_ns(time_local_now() - last_epoch) / 1000000;
+    k_spin_unlock(&time_lock, key);
+
+    if (st == SYNC_NONE) {
+        printk("UTC %s (no GNSS epoch with a date yet)\n", state_names[st]);
+        return 0;
+    }
+
+    secs = utc / NSEC_PER_SEC;
+    gmtime_r(&secs, &tm);
+    printk("UTC %04d-%02d-%02d %02d:%02d:%02d.%09lld, %s\n", tm.tm_year + 1900,
+           tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec,
+           (long long)(utc % NSEC_PER_SEC), state_names[st]);
+    printk("Drift %lld ppb, slew %lld ppb, last error %lld us, %llu ms since epoch\n",
+           (long long)drift, (long long)slew, (long long)(error / 1000),
+           (unsigned long long)age);
+    printk("%u epochs, %u steps\n", n, stepped);
+    return 0;
+}
+
+CMD_DEFINE(time, "time", "", "Show GNSS-disciplined UTC and clock drift", cmd_time, 0, 0);
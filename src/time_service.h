@@ -0,0 +1,62 @@
+#ifndef TIME_SERVICE_H
+#define TIME_SERVICE_H
+
+#include "data_handler.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * GNSS-disciplined UTC.
+ *
+ * Local timestamps are the hardware cycle counter extended to 64 bits
+ * (time_local_now()), so they are monotonic and as fine as the CPU clock.
+ * UTC is a linear function of them:
+ *
+ *   utc_ns = model.utc_ns + ((local - model.local) * model.mult >> TIME_MULT_SHIFT)
+ *
+ * Each GNSS epoch compares the model with the fix time. Small errors are
+ * slewed out by running the model slightly fast or slow, keeping UTC
+ * monotonic, and a PI loop on the same error tracks the drift of the
+ * local oscillator. Errors over TIME_STEP_NS (first fix, receiver time
+ * jumps) step the model instead.
+ *
+ * The fix time is taken when the fix callback runs, so UTC lags true time
+ * by the receiver's output latency, less TIME_FIX_LATENCY_NS.
+ */
+
+#define TIME_MULT_SHIFT         24
+#define TIME_STEP_NS            100000000LL     // 100 ms
+#define TIME_FIX_LATENCY_NS     0
+
+struct time_model {
+    uint64_t local;         // Cycle count at the model's origin
+    int64_t utc_ns;         // UTC at the origin, ns since 1970
+    int64_t mult;           // ns per cycle << TIME_MULT_SHIFT
+};
+
+// Start the cycle counter extension, before any GNSS epoch
+int time_service_init(void);
+
+// Monotonic 64-bit cycle count
+uint64_t time_local_now(void);
+
+// Copy the current model. Returns false until the first GNSS epoch with a
+// date.
+bool time_get_model(struct time_model *model);
+
+// UTC in ns for a local timestamp within a few minutes of the model
+// origin, which is refreshed every epoch: a multiply-shift and an add.
+static inline int64_t time_model_utc_ns(const struct time_model *model, uint64_t local)
+{
+    return model->utc_ns +
+           (((int64_t)(local - model->local) * model->mult) >> TIME_MULT_SHIFT);
+}
+
+// UTC in ns for any local timestamp, with the current model. Returns
+// -EAGAIN before the first epoch.
+int time_to_utc_ns(uint64_t local, int64_t *utc_ns);
+
+// Discipline on a GNSS epoch: the fix and the local time it arrived
+void time_gnss_epoch(const struct gps_data *gps, uint64_t local);
+
+#endif // TIME_SERVICE_H
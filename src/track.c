@@ -0,0 +1,570 @@
+#include "track.h"
+#include "track_simplify.h"
+#include "command_parser.h"
+#include "data_handler.h"
+#include "supervisor.h"
+#include <zephyr/kernel.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/timeutil.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+
+LOG_MODULE_REGISTER(track, LOG_LEVEL_INF);
+
+#define TRACK_PARTITION_ID      FIXED_PARTITION_ID(storage_partition)
+#define TRACK_MAX_SECTORS       32
+#define TRACK_MAGIC             0x4B435254  // "TRCK"
+#define TRACK_ERASED_TIME       0xFFFFFFFF
+
+// Records fetched per flash read when streaming a range
+#define TRACK_READ_CHUNK        8
+
+// Fix notifications queued while a sector erase is in progress, and the
+// shortest spacing of records whatever the receiver's output rate
+#define TRACK_SUB_QUEUE_LEN     4
+#define TRACK_MIN_INTERVAL_MS   1000
+// Wakes without fixes too, to show the supervisor it is alive
+#define TRACK_IDLE_MS           1000
+
+// Record size must stay a multiple of the 8-byte flash write block
+BUILD_ASSERT(sizeof(struct track_record) == 24, "track_record layout changed");
+
+struct sector_header {
+    uint32_t magic;
+    uint32_t seq;           // Increments each time a sector is started
+};
+
+struct sector_index {
+    uint32_t seq;           // 0 = sector not in use
+    uint32_t first_time;
+    uint32_t last_time;
+    uint16_t count;
+};
+
+static const struct flash_area *fa;
+static struct sector_index sectors[TRACK_MAX_SECTORS];
+static uint32_t sector_count;
+static uint32_t sector_size;
+static uint16_t records_per_sector;
+static int head = -1;
+
+static K_MUTEX_DEFINE(track_mutex);
+
+static off_t record_offset(int sector, uint32_t slot)
+{
+    return (off_t)sector * sector_size + sizeof(struct sector_header) +
+           slot * sizeof(struct track_record);
+}
+
+// time is the first field of a record, so a 4-byte read is enough to probe
+static int read_time(int sector, uint32_t slot, uint32_t *time)
+{
+    return flash_area_read(fa, record_offset(sector, slot), time, sizeof(*time));
+}
+
+static int scan_sector(int sector)
+{
+    struct sector_index *index = &sectors[sector];
+    struct sector_header header;
+    uint32_t lo = 0, hi = records_per_sector;
+    uint32_t time;
+    int ret;
+
+    memset(index, 0, sizeof(*index));
+
+    ret = flash_area_read(fa, (off_t)sector * sector_size, &header, sizeof(header));
+    if (ret != 0) {
+        return ret;
+    }
+    if (header.magic != TRACK_MAGIC || header.seq == 0 || header.seq == UINT32_MAX) {
+        return 0;
+    }
+
+    // Records are appended in order, so the written slots are a prefix of
+    // the sector: binary search for the first erased one
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+
+        ret = read_time(sector, mid, &time);
+        if (ret != 0) {
+            return ret;
+        }
+        if (time != TRACK_ERASED_TIME) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    index->seq = header.seq;
+    index->count = lo;
+    if (lo > 0) {
+        ret = read_time(sector, 0, &index->first_time);
+        if (ret == 0) {
+            ret = read_time(sector, lo - 1, &index->last_time);
+        }
+    }
+    return ret;
+}
+
+// Erase a sector and make it the head. Called with track_mutex held.
+// Note the erase stalls flash reads (and so the CPU) for ~20 ms.
+static int start_sector(int sector, uint32_t seq)
+{
+    struct sector_header header = { .magic = TRACK_MAGIC, .seq = seq };
+    int ret;
+
+    ret = flash_area_erase(fa, (off_t)sector * sector_size, sector_size);
+    if (ret != 0) {
+        return ret;
+    }
+    ret = flash_area_write(fa, (off_t)sector * sector_size, &header, sizeof(header));
+    if (ret != 0) {
+        return ret;
+    }
+
+    memset(&sectors[sector], 0, sizeof(sectors[sector]));
+    sectors[sector].seq = seq;
+    head = sector;
+    return 0;
+}
+
+// Sectors in use, oldest first. Called with track_mutex held.
+static int sectors_in_order(int *order)
+{
+    int n = 0;
+
+    for (uint32_t i = 1; i <= sector_count; i++) {
+        int sector = (head + i) % sector_count;
+
+        if (sectors[sector].seq != 0) {
+            order[n++] = sector;
+        }
+    }
+    return n;
+}
+
+int track_init(void)
+{
+    struct flash_sector layout[TRACK_MAX_SECTORS];
+    uint32_t count = ARRAY_SIZE(layout);
+    int ret;
+
+    ret = flash_area_open(TRACK_PARTITION_ID, &fa);
+    if (ret != 0) {
+        return ret;
+    }
+
+    // Sectors are assumed to be uniform, as on the STM32L4
+    ret = flash_area_get_sectors(TRACK_PARTITION_ID, &count, layout);
+    if (ret != 0 || count < 2) {
+        return ret != 0 ? ret : -ENOSPC;
+    }
+    sector_count = count;
+    sector_size = layout[0].fs_size;
+    records_per_sector = (sector_size - sizeof(struct sector_header)) /
+                         sizeof(struct track_record);
+
+    k_mutex_lock(&track_mutex, K_FOREVER);
+    head = -1;
+    for (uint32_t i = 0; i < sector_count; i++) {
+        ret = scan_sector(i);
+        if (ret != 0) {
+            break;
+        }
+        if (sectors[i].seq != 0 && (head < 0 || sectors[i].seq > sectors[head].seq)) {
+            head = i;
+        }
+    }
+    if (ret == 0 && head < 0) {
+        LOG_INF("Formatting track store");
+        ret = start_sector(0, 1);
+    }
+    k_mutex_unlock(&track_mutex);
+
+    if (ret == 0) {
+        LOG_INF("Track store: %u sectors x %u records", sector_count, records_per_sector);
+    }
+    return ret;
+}
+
+int track_append(const struct track_record *record)
+{
+    struct track_record rec = *record;
+    struct sector_index *index;
+    int ret = 0;
+
+    rec.crc = crc8_ccitt(0xFF, &rec, offsetof(struct track_record, crc));
+
+    k_mutex_lock(&track_mutex, K_FOREVER);
+    if (head < 0) {
+        ret = -ENODEV;
+        goto out;
+    }
+
+    // Head full: erase the next sector in the ring, dropping the oldest
+    if (sectors[head].count >= records_per_sector) {
+        ret = start_sector((head + 1) % sector_count, sectors[head].seq + 1);
+        if (ret != 0) {
+            goto out;
+        }
+    }
+
+    index = &sectors[head];
+    ret = flash_area_write(fa, record_offset(head, index->count), &rec, sizeof(rec));
+    if (ret != 0) {
+        goto out;
+    }
+
+    if (index->count == 0) {
+        index->first_time = rec.time;
+    }
+    index->last_time = rec.time;
+    index->count++;
+
+out:
+    k_mutex_unlock(&track_mutex);
+    return ret;
+}
+
+int track_read_range(uint32_t from, uint32_t to,
+                     bool (*fn)(const struct track_record *record, void *user_data),
+                     void *user_data)
+{
+    struct track_record chunk[TRACK_READ_CHUNK];
+    int order[TRACK_MAX_SECTORS];
+    uint32_t lo, hi, slot;
+    int visited = 0;
+    int n;
+
+    k_mutex_lock(&track_mutex, K_FOREVER);
+    if (head < 0) {
+        k_mutex_unlock(&track_mutex);
+        return -ENODEV;
+    }
+    n = sectors_in_order(order);
+
+    // First sector whose last record is at or after 'from'
+    lo = 0;
+    hi = n;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        const struct sector_index *index = &sectors[order[mid]];
+
+        if (index->count == 0 || index->last_time < from) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    // First record in that sector at or after 'from'
+    slot = 0;
+    if (lo < n) {
+        uint32_t rlo = 0, rhi = sectors[order[lo]].count;
+        uint32_t time;
+
+        while (rlo < rhi) {
+            uint32_t mid = (rlo + rhi) / 2;
+
+            if (read_time(order[lo], mid, &time) != 0 || time < from) {
+                rlo = mid + 1;
+            } else {
+                rhi = mid;
+            }
+        }
+        slot = rlo;
+    }
+    k_mutex_unlock(&track_mutex);
+
+    // Stream forward. The lock is only held per chunk so appends are not
+    // held up by a slow console; a sector recycled meanwhile is skipped.
+    for (uint32_t i = lo; i < n; i++, slot = 0) {
+        int sector = order[i];
+        uint32_t seq;
+
+        k_mutex_lock(&track_mutex, K_FOREVER);
+        seq = sectors[sector].seq;
+        k_mutex_unlock(&track_mutex);
+
+        while (true) {
+            uint32_t count;
+
+            k_mutex_lock(&track_mutex, K_FOREVER);
+            if (sectors[sector].seq != seq || slot >= sectors[sector].count) {
+                k_mutex_unlock(&track_mutex);
+                break;
+            }
+            count = MIN(sectors[sector].count - slot, TRACK_READ_CHUNK);
+            int ret = flash_area_read(fa, record_offset(sector, slot), chunk,
+                                      count * sizeof(chunk[0]));
+            k_mutex_unlock(&track_mutex);
+            if (ret != 0) {
+                return ret;
+            }
+            slot += count;
+
+            for (uint32_t r = 0; r < count; r++) {
+                if (chunk[r].time > to) {
+                    return visited;
+                }
+                // Skip records torn by a reset during the write
+                if (crc8_ccitt(0xFF, &chunk[r], offsetof(struct track_record, crc)) !=
+                    chunk[r].crc) {
+                    continue;
+                }
+                visited++;
+                if (!fn(&chunk[r], user_data)) {
+                    return visited;
+                }
+            }
+        }
+    }
+    return visited;
+}
+
+// Record number of a slot: (seq - 1) * records_per_sector + slot
+int track_get_span(uint32_t *first, uint32_t *end)
+{
+    int order[TRACK_MAX_SECTORS];
+
+    k_mutex_lock(&track_mutex, K_FOREVER);
+    if (head < 0) {
+        k_mutex_unlock(&track_mutex);
+        return -ENODEV;
+    }
+    sectors_in_order(order);
+    *first = (sectors[order[0]].seq - 1) * records_per_sector;
+    *end = (sectors[head].seq - 1) * records_per_sector + sectors[head].count;
+    k_mutex_unlock(&track_mutex);
+    return 0;
+}
+
+int track_read_records(uint32_t number, struct track_record *buf, uint32_t count)
+{
+    uint32_t end = number + count;
+    int read = 0;
+    int ret = 0;
+
+    k_mutex_lock(&track_mutex, K_FOREVER);
+    if (head < 0) {
+        ret = -ENODEV;
+        goto out;
+    }
+
+    while (number < end) {
+        uint32_t seq = number / records_per_sector + 1;
+        uint32_t slot = number % records_per_sector;
+        uint32_t avail;
+        int sector = -1;
+
+        for (uint32_t i = 0; i < sector_count; i++) {
+            if (sectors[i].seq == seq) {
+                sector = i;
+                break;
+            }
+        }
+        if (sector < 0) {
+            ret = -ENOENT;
+            goto out;
+        }
+
+        avail = sectors[sector].count > slot ? sectors[sector].count - slot : 0;
+        avail = MIN(avail, end - number);
+        if (avail > 0) {
+            ret = flash_area_read(fa, record_offset(sector, slot), &buf[read],
+                                  avail * sizeof(buf[0]));
+            if (ret != 0) {
+                goto out;
+            }
+            read += avail;
+        }
+
+        // On to the next sector, past any unwritten slots
+        number = MIN(end, seq * records_per_sector);
+    }
+
+out:
+    k_mutex_unlock(&track_mutex);
+    return ret != 0 ? ret : read;
+}
+
+int track_erase(void)
+{
+    int ret;
+
+    k_mutex_lock(&track_mutex, K_FOREVER);
+    if (head < 0) {
+        k_mutex_unlock(&track_mutex);
+        return -ENODEV;
+    }
+    ret = flash_area_erase(fa, 0, sector_count * sector_size);
+    if (ret == 0) {
+        memset(sectors, 0, sizeof(sectors));
+        ret = start_sector(0, 1);
+    }
+    k_mutex_unlock(&track_mutex);
+    return ret;
+}
+
+// UTC seconds since 1970 of a fix, 0 if the receiver has no date yet
+static uint32_t gps_unix_time(const struct gps_data *gps)
+{
+    struct tm tm = {
+        .tm_year = 100 + gps->year,
+        .tm_mon = gps->month - 1,
+        .tm_mday = gps->day,
+        .tm_hour = gps->hour,
+        .tm_min = gps->minute,
+        .tm_sec = gps->millisecond / 1000,
+    };
+
+    if (gps->month == 0 || gps->day == 0) {
+        return 0;
+    }
+    return (uint32_t)timeutil_timegm64(&tm);
+}
+
+static bool make_record(const struct sensor_data *data, struct track_record *rec)
+{
+    const struct gps_data *gps = &data->gps_data;
+
+    memset(rec, 0, sizeof(*rec));
+    rec->time = gps_unix_time(gps);
+    if (!gps->valid || rec->time == 0) {
+        return false;
+    }
+
+    rec->latitude = gps->latitude;
+    rec->longitude = gps->longitude;
+    rec->sog = MIN(gps->sog / 10, UINT16_MAX);
+    rec->cog = gps->cog / 10;
+    if (data->compass_data.valid) {
+        rec->heading = data->compass_data.heading / 10;
+        rec->flags |= TRACK_FLAG_COMPASS_VALID;
+    }
+    if (data->acc_data.valid) {
+        rec->pitch = data->acc_data.pitch / 10;
+        rec->roll = data->acc_data.roll / 10;
+        rec->flags |= TRACK_FLAG_ACC_VALID;
+    }
+    return true;
+}
+
+ZBUS_SUBSCRIBER_DEFINE(track_sub, TRACK_SUB_QUEUE_LEN);
+ZBUS_CHAN_ADD_OBS(gps_chan, track_sub, 4);
+
+static void track_thread(void)
+{
+    const struct zbus_channel *chan;
+    struct sensor_data data;
+    struct track_record rec;
+    struct track_record kept;
+    uint32_t last = 0;
+
+    if (track_init() != 0) {
+        LOG_ERR("Track store init failed, track logging disabled");
+        return;
+    }
+
+    supervisor_enable(SUP_TRACK);
+    while (1) {
+        int ret = zbus_sub_wait(&track_sub, &chan, K_MSEC(TRACK_IDLE_MS));
+
+        supervisor_kick(SUP_TRACK);
+        if (ret != 0) {
+            continue;
+        }
+        if (last != 0 && k_uptime_get_32() - last < TRACK_MIN_INTERVAL_MS) {
+            continue;
+        }
+        last = k_uptime_get_32();
+
+        // The newest fix with the attitude and heading at the time
+        get_sensors_data(&data);
+        if (!make_record(&data, &rec)) {
+            continue;
+        }
+        // Drop fixes that lie on a straight line within the tolerance
+        if (!track_simplify_push(&rec, &kept)) {
+            continue;
+        }
+        if (track_append(&kept) != 0) {
+            LOG_WRN("Track append failed");
+        }
+    }
+}
+
+// Console commands
+static int cmd_track(int argc, char **argv)
+{
+    int order[TRACK_MAX_SECTORS];
+    uint32_t records = 0;
+    int n;
+
+    k_mutex_lock(&track_mutex, K_FOREVER);
+    if (head < 0) {
+        k_mutex_unlock(&track_mutex);
+        printk("Track store not available\n");
+        return 0;
+    }
+    n = sectors_in_order(order);
+    for (int i = 0; i < n; i++) {
+        records += sectors[order[i]].count;
+    }
+    printk("Track: %u records in %d/%u sectors (%u per sector), head %d seq %u\n",
+           records, n, sector_count, records_per_sector, head, sectors[head].seq);
+    if (records > 0) {
+        // The head may still be empty right after a sector switch
+        int newest = sectors[order[n - 1]].count ? order[n - 1] : order[n - 2];
+
+        printk("Range: %u - %u\n", sectors[order[0]].first_time, sectors[newest].last_time);
+    }
+    k_mutex_unlock(&track_mutex);
+    return 0;
+}
+
+static bool print_record(const struct track_record *rec, void *user_data)
+{
+    printk("%u,%d,%d,%u,%u,%u,%d,%d,%u\n", rec->time, rec->latitude, rec->longitude,
+           rec->sog, rec->cog, rec->heading, rec->pitch, rec->roll, rec->flags);
+    return true;
+}
+
+static int cmd_track_dump(int argc, char **argv)
+{
+    int32_t from, to;
+    int ret;
+
+    if (cmd_parse_int(argv[0], &from) != 0 || cmd_parse_int(argv[1], &to) != 0 ||
+        from < 0 || to < from) {
+        return -EINVAL;
+    }
+
+    printk("time,lat_e7,lon_e7,sog_cms,cog_cdeg,hdg_cdeg,pitch_cdeg,roll_cdeg,flags\n");
+    ret = track_read_range(from, to, print_record, NULL);
+    if (ret < 0) {
+        printk("Error: track read failed (%d)\n", ret);
+        return 0;
+    }
+    printk("%d records\n", ret);
+    return 0;
+}
+
+static int cmd_track_erase(int argc, char **argv)
+{
+    int ret = track_erase();
+
+    if (ret != 0) {
+        printk("Error: track erase failed (%d)\n", ret);
+    }
+    return 0;
+}
+
+CMD_DEFINE(track, "track", "", "Show track store usage and time range", cmd_track, 0, 0);
+CMD_DEFINE(track_dump, "track dump", "<from> <to>",
+           "Print records between two UTC times (unix seconds) as CSV", cmd_track_dump, 2, 2);
+CMD_DEFINE(track_erase, "track erase", "", "Erase all track records", cmd_track_erase, 0, 0);
+
+K_THREAD_DEFINE(track_thread_id, 1536, track_thread, NULL, NULL, NULL, 11, 0, 0);
@@ -0,0 +1,71 @@
+#ifndef TRACK_H
+#define TRACK_H
+
+#include <zephyr/toolchain.h>
+#include <zephyr/sys/util.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Circular track store on the storage partition in internal flash.
+ *
+ * The partition is used as a ring of flash pages (sectors). Each sector
+ * starts with a header holding a sequence number. Fixed-size records are
+ * appended after it. When the head sector is full, the next sector in the
+ * ring is erased and becomes the head, dropping the oldest records. Every
+ * sector is therefore erased equally often.
+ *
+ * A RAM index keeps the time of the first and last record of each sector.
+ * A time range query binary searches the sectors and then the records in
+ * the first sector. Records must be appended in time order, which holds
+ * for GNSS fixes.
+ *
+ * The track thread subscribes to gps_chan and writes at most one record
+ * per second, after the simplifier in track_simplify.c has dropped fixes
+ * on straight legs.
+ */
+
+struct track_record {
+    uint32_t time;          // UTC, seconds since 1970
+    int32_t latitude;       // 1e-7 degrees
+    int32_t longitude;      // 1e-7 degrees
+    uint16_t sog;           // cm/s
+    uint16_t cog;           // centidegrees
+    uint16_t heading;       // centidegrees
+    int16_t pitch;          // centidegrees
+    int16_t roll;           // centidegrees
+    uint8_t flags;          // TRACK_FLAG_*
+    uint8_t crc;            // CRC-8 over the preceding bytes
+} __packed;
+
+#define TRACK_FLAG_COMPASS_VALID    BIT(0)
+#define TRACK_FLAG_ACC_VALID        BIT(1)
+
+// Mount the partition and build the index. Formats it if no valid
+// sectors are found. Returns 0 or a negative error code.
+int track_init(void);
+
+// Append one record. Returns 0 or a negative error code.
+int track_append(const struct track_record *record);
+
+// Call fn for every record with from <= time <= to, oldest first.
+// Stops early if fn returns false. Returns the number of records visited.
+int track_read_range(uint32_t from, uint32_t to,
+                     bool (*fn)(const struct track_record *record, void *user_data),
+                     void *user_data);
+
+// Records are also numbered, oldest first, by their position in the flash
+// ring. A number stays valid until its sector is recycled, so a reader can
+// address records by number while appends go on. Gets the numbers of the
+// oldest record and one past the newest.
+int track_get_span(uint32_t *first, uint32_t *end);
+
+// Read the records numbered [number, number + count). Slots that were never
+// written are skipped. Returns the number of records read, or -ENOENT if
+// part of the range has been recycled.
+int track_read_records(uint32_t number, struct track_record *buf, uint32_t count);
+
+// Erase all records
+int track_erase(void);
+
+#endif // TRACK_H
@@ -0,0 +1,182 @@
+#include "track_simplify.h"
+#include "command_parser.h"
+#include "geo.h"
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+
+// Longer segments are always cut, which also bounds the int64 products
+// below: |v| * |v| * GEO_DIR_ONE stays under 2^63
+#define MAX_SEGMENT_CM      10000000LL  // 100 km
+
+static struct {
+    bool have_anchor;
+    bool have_pending;
+    bool have_cone;
+    struct track_record anchor;     // Last point kept
+    struct track_record pending;    // Latest fix, kept if the next one leaves the cone
+    int32_t cos_lat_q15;            // cos(anchor latitude) in Q15
+    struct geo_vec left;            // Cone boundaries, GEO_DIR_ONE long
+    struct geo_vec right;
+} state;
+
+static atomic_t tolerance_cm = ATOMIC_INIT(TRACK_SIMPLIFY_DEFAULT_CM);
+static atomic_t reset_requested;
+static atomic_t fixes_in;
+static atomic_t points_out;
+
+static void set_anchor(const struct track_record *point)
+{
+    state.anchor = *point;
+    state.cos_lat_q15 = geo_cos_lat_q15(point->latitude);
+    state.have_anchor = true;
+    state.have_pending = false;
+    state.have_cone = false;
+}
+
+// Local east/north offset of a point from the anchor, in cm
+static struct geo_vec offset_cm(const struct track_record *point)
+{
+    return geo_offset_cm(state.anchor.latitude, state.anchor.longitude, state.cos_lat_q15,
+                         point->latitude, point->longitude);
+}
+
+// Direction of v rotated by +-asin(tol / |v|), GEO_DIR_ONE long
+static struct geo_vec boundary(struct geo_vec v, int64_t d2, int64_t tol, int64_t sign)
+{
+    int64_t c = geo_isqrt64(d2 - tol * tol);    // |v| cos(angle)
+    struct geo_vec b = {
+        (v.x * c - sign * v.y * tol) * GEO_DIR_ONE / d2,
+        (v.y * c + sign * v.x * tol) * GEO_DIR_ONE / d2,
+    };
+
+    return b;
+}
+
+// Directions from the anchor that pass within tol of the point at v
+static void narrow_cone(struct geo_vec v, int64_t d2, int64_t tol)
+{
+    struct geo_vec left, right;
+
+    if (d2 <= tol * tol || d2 > MAX_SEGMENT_CM * MAX_SEGMENT_CM) {
+        return;
+    }
+
+    left = boundary(v, d2, tol, 1);
+    right = boundary(v, d2, tol, -1);
+    if (!state.have_cone) {
+        state.left = left;
+        state.right = right;
+        state.have_cone = true;
+        return;
+    }
+
+    // Keep the tighter of each pair of boundaries
+    if (geo_cross(left, state.left) > 0) {
+        state.left = left;
+    }
+    if (geo_cross(state.right, right) > 0) {
+        state.right = right;
+    }
+}
+
+static bool in_cone(struct geo_vec v)
+{
+    return !state.have_cone ||
+           (geo_cross(state.right, v) >= 0 && geo_cross(v, state.left) >= 0);
+}
+
+bool track_simplify_push(const struct track_record *in, struct track_record *out)
+{
+    int64_t tol = (uint32_t)atomic_get(&tolerance_cm);
+    struct geo_vec v;
+    int64_t d2;
+
+    atomic_inc(&fixes_in);
+    if (atomic_cas(&reset_requested, 1, 0)) {
+        state.have_anchor = false;
+    }
+
+    if (tol == 0 || !state.have_anchor) {
+        set_anchor(in);
+        *out = *in;
+        atomic_inc(&points_out);
+        return true;
+    }
+
+    v = offset_cm(in);
+    d2 = v.x * v.x + v.y * v.y;
+
+    if (in->time - state.anchor.time < TRACK_SIMPLIFY_MAX_GAP_S &&
+        d2 <= MAX_SEGMENT_CM * MAX_SEGMENT_CM && in_cone(v)) {
+        // Still on a straight enough line, hold the fix back
+        narrow_cone(v, d2, tol);
+        state.pending = *in;
+        state.have_pending = true;
+        return false;
+    }
+
+    // Left the cone: keep the previous fix and restart from there
+    if (!state.have_pending) {
+        set_anchor(in);
+        *out = *in;
+    } else {
+        *out = state.pending;
+        set_anchor(&state.pending);
+        v = offset_cm(in);
+        d2 = v.x * v.x + v.y * v.y;
+        narrow_cone(v, d2, tol);
+        state.pending = *in;
+        state.have_pending = true;
+    }
+    atomic_inc(&points_out);
+    return true;
+}
+
+void track_simplify_set_tolerance(uint32_t tolerance)
+{
+    atomic_set(&tolerance_cm, tolerance);
+    atomic_clear(&fixes_in);
+    atomic_clear(&points_out);
+    // Applied by the track thread on its next fix
+    atomic_set(&reset_requested, 1);
+}
+
+uint32_t track_simplify_get_tolerance(void)
+{
+    return atomic_get(&tolerance_cm);
+}
+
+void track_simplify_get_stats(uint32_t *in, uint32_t *out)
+{
+    *in = atomic_get(&fixes_in);
+    *out = atomic_get(&points_out);
+}
+
+// Console commands
+static int cmd_track_simplify(int argc, char **argv)
+{
+    int32_t tolerance;
+    uint32_t in, out;
+
+    if (argc == 1) {
+        if (cmd_parse_int(argv[0], &tolerance) != 0 || tolerance < 0 ||
+            tolerance > TRACK_SIMPLIFY_MAX_CM) {
+            return -EINVAL;
+        }
+        track_simplify_set_tolerance(tolerance);
+        return 0;
+    }
+
+    track_simplify_get_stats(&in, &out);
+    printk("Simplify: tolerance %u cm, %u fixes in, %u points kept",
+           track_simplify_get_tolerance(), in, out);
+    if (out > 0) {
+        printk(", ratio %u.%02u:1", in / out, (uint32_t)((uint64_t)(in % out) * 100 / out));
+    }
+    printk("\n");
+    return 0;
+}
+
+CMD_DEFINE(track_simplify, "track simplify", "[tolerance_cm]",
+           "Show compression, or set the cross-track tolerance (0 = keep all)",
+           cmd_track_simplify, 0, 1);
@@ -0,0 +1,41 @@
+#ifndef TRACK_SIMPLIFY_H
+#define TRACK_SIMPLIFY_H
+
+#include "track.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Online track simplification in front of the track store.
+ *
+ * Cone (sleeve) method: from the last kept point (the anchor), every later
+ * fix further away than the tolerance narrows the range of directions a
+ * straight segment from the anchor may take while passing within the
+ * tolerance of all fixes seen since. When a fix falls outside that range,
+ * the previous fix is kept and becomes the new anchor. The result keeps
+ * every dropped fix within the tolerance of the stored line.
+ *
+ * Constant time and memory per fix: the state is the anchor, the pending
+ * fix and two direction vectors. Positions are handled as integer
+ * centimetre offsets from the anchor.
+ */
+
+// Default cross-track tolerance, 0 keeps every fix
+#define TRACK_SIMPLIFY_DEFAULT_CM   500
+#define TRACK_SIMPLIFY_MAX_CM       100000
+
+// Keep at least one point per interval so slow or stationary periods
+// still show up in the time index
+#define TRACK_SIMPLIFY_MAX_GAP_S    60
+
+// Feed one fix. Returns true with *out filled when a point must be stored.
+bool track_simplify_push(const struct track_record *in, struct track_record *out);
+
+// Set the tolerance in cm (0 = off). Restarts simplification.
+void track_simplify_set_tolerance(uint32_t tolerance_cm);
+uint32_t track_simplify_get_tolerance(void);
+
+// Fixes fed in and points kept since the last reset
+void track_simplify_get_stats(uint32_t *fixes_in, uint32_t *points_out);
+
+#endif // TRACK_SIMPLIFY_H
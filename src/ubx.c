@@ -0,0 +1,40 @@
+#include "ubx.h"
+#include <string.h>
+
+void ubx_add_checksum(uint8_t *msg, size_t len)
+{
+    uint8_t ck_a = 0, ck_b = 0;
+
+    // Calculate checksum over message (skip sync chars and checksum bytes)
+    for (size_t i = 2; i < len - 2; i++) {
+        ck_a += msg[i];
+        ck_b += ck_a;
+    }
+
+    msg[len - 2] = ck_a;
+    msg[len - 1] = ck_b;
+}
+
+// UBX-CFG-MSG: Configure message rate for a specific NMEA sentence
+// Format: B5 62 06 01 08 00 [CLASS] [ID] [rates for 6 ports] [checksum]
+size_t ubx_build_cfg_msg(uint8_t *buf, uint8_t msg_class, uint8_t msg_id, uint8_t rate)
+{
+    const uint8_t cmd[UBX_CFG_MSG_LEN] = {
+        0xB5, 0x62,     // Header
+        0x06, 0x01,     // Class CFG, ID MSG
+        0x08, 0x00,     // Length (8 bytes)
+        msg_class,      // Message class
+        msg_id,         // Message ID
+        0x00,           // Rate on I2C
+        rate,           // Rate on UART1 (0 = off, 1 = every solution)
+        0x00,           // Rate on UART2
+        0x00,           // Rate on USB
+        0x00,           // Rate on SPI
+        0x00,           // Reserved
+        0x00, 0x00      // Checksum (will be calculated)
+    };
+
+    memcpy(buf, cmd, sizeof(cmd));
+    ubx_add_checksum(buf, sizeof(cmd));
+    return sizeof(cmd);
+}
@@ -0,0 +1,17 @@
+#ifndef UBX_H
+#define UBX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Length of a UBX-CFG-MSG frame including sync and checksum
+#define UBX_CFG_MSG_LEN 16
+
+// Fill the two checksum bytes at the end of a complete UBX frame
+void ubx_add_checksum(uint8_t *msg, size_t len);
+
+// Build a UBX-CFG-MSG frame setting the UART1 rate of one message.
+// buf must hold UBX_CFG_MSG_LEN bytes. Returns the frame length.
+size_t ubx_build_cfg_msg(uint8_t *buf, uint8_t msg_class, uint8_t msg_id, uint8_t rate);
+
+#endif // UBX_H
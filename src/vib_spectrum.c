@@ -0,0 +1,108 @@
+#include "vib_spectrum.h"
+#include <zephyr/toolchain.h>
+#include <zephyr/sys/util.h>
+#include <arm_math.h>
+#include <errno.h>
+#include <math.h>
+
+// One-sided spectrum, bin 0 (DC) to BINS - 1
+#define BINS                    (VIB_WINDOW / 2)
+
+// Mean square from a one-sided power sum with a Hann window, whose
+// squares add up to 3N/8: 2 / (N * 3N/8)
+#define HANN_PARSEVAL           (16.0f / (3.0f * VIB_WINDOW * VIB_WINDOW))
+
+BUILD_ASSERT(VIB_WINDOW == 256, "vib_spectrum_init() sets up a 256 point FFT");
+
+const uint16_t vib_band_edges_hz[VIB_BAND_COUNT + 1] = { VIB_MIN_HZ, 10, 50, 120, 250 };
+
+static arm_rfft_fast_instance_f32 rfft;
+static float32_t hann[VIB_WINDOW];
+static float32_t time_buf[VIB_WINDOW];
+static float32_t freq_buf[VIB_WINDOW];
+static float32_t power[BINS];           // Sum over the axes
+
+int vib_spectrum_init(void)
+{
+    // The length specific init, the generic one references the tables of
+    // every FFT length up to 4096 and keeps them all in flash
+    if (arm_rfft_fast_init_256_f32(&rfft) != ARM_MATH_SUCCESS) {
+        return -EINVAL;
+    }
+
+    // Periodic Hann, the window repeats every VIB_WINDOW samples
+    for (int i = 0; i < VIB_WINDOW; i++) {
+        hann[i] = 0.5f - 0.5f * cosf(2.0f * PI * i / VIB_WINDOW);
+    }
+    return 0;
+}
+
+static uint32_t hz_to_bin(uint32_t hz, uint32_t rate_mhz)
+{
+    return MIN((uint64_t)hz * VIB_WINDOW * 1000 / rate_mhz, BINS);
+}
+
+// RMS in milli-g of the power in bins [from, to)
+static uint16_t band_mg(uint32_t from, uint32_t to, float32_t lsb_to_g)
+{
+    float32_t sum = 0.0f;
+
+    for (uint32_t k = from; k < to; k++) {
+        sum += power[k];
+    }
+    return MIN(sqrtf(sum * HANN_PARSEVAL) * lsb_to_g * 1000.0f, UINT16_MAX);
+}
+
+void vib_spectrum_analyse(const int16_t raw[VIB_AXES][VIB_WINDOW], uint32_t lsb_per_g,
+                          uint32_t rate_mhz, struct vib_result *result)
+{
+    // arm_q15_to_float() divides by 32768
+    float32_t lsb_to_g = 32768.0f / lsb_per_g;
+    uint32_t first = MAX(hz_to_bin(VIB_MIN_HZ, rate_mhz), 1);
+    float32_t sum_sq = 0.0f;
+    float32_t mean, rms, peak_power, delta = 0.0f;
+    uint32_t peak;
+
+    arm_fill_f32(0.0f, power, BINS);
+
+    for (int axis = 0; axis < VIB_AXES; axis++) {
+        arm_q15_to_float(raw[axis], time_buf, VIB_WINDOW);
+        arm_mean_f32(time_buf, VIB_WINDOW, &mean);
+        arm_offset_f32(time_buf, -mean, time_buf, VIB_WINDOW);
+        arm_rms_f32(time_buf, VIB_WINDOW, &rms);
+        sum_sq += rms * rms;
+
+        arm_mult_f32(time_buf, hann, time_buf, VIB_WINDOW);
+        // Uses time_buf as scratch
+        arm_rfft_fast_f32(&rfft, time_buf, freq_buf, 0);
+        // freq_buf holds the real DC and Nyquist terms, then bins 1 up
+        arm_cmplx_mag_squared_f32(&freq_buf[2], time_buf, BINS - 1);
+        arm_add_f32(&power[1], time_buf, &power[1], BINS - 1);
+    }
+
+    arm_max_f32(&power[first], BINS - first, &peak_power, &peak);
+    peak += first;
+
+    // Between bins, from the parabola through the peak and its neighbours
+    if (peak + 1 < BINS) {
+        float32_t a = power[peak - 1], b = power[peak], c = power[peak + 1];
+        float32_t den = a - 2.0f * b + c;
+
+        if (den < 0.0f) {
+            delta = 0.5f * (a - c) / den;
+        }
+    }
+
+    result->peak_chz = peak_power > 0.0f ?
+                       (peak + delta) * rate_mhz / (10.0f * VIB_WINDOW) : 0;
+    result->rms_mg = MIN(sqrtf(sum_sq) * lsb_to_g * 1000.0f, UINT16_MAX);
+
+    for (int band = 0; band < VIB_BAND_COUNT; band++) {
+        uint32_t from = MAX(hz_to_bin(vib_band_edges_hz[band], rate_mhz), first);
+        uint32_t to = band + 1 < VIB_BAND_COUNT ?
+                      hz_to_bin(vib_band_edges_hz[band + 1], rate_mhz) : BINS;
+
+        result->band_mg[band] = band_mg(from, to, lsb_to_g);
+    }
+    result->valid = true;
+}
@@ -0,0 +1,53 @@
+#ifndef VIB_SPECTRUM_H
+#define VIB_SPECTRUM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Vibration spectrum of one window of accelerometer samples, CMSIS-DSP.
+ *
+ * Each axis has its mean (gravity, tilt) removed, a Hann window applied
+ * and a 256 point real FFT. The power spectra of the three axes are added
+ * so that the result does not depend on how the unit is mounted. From
+ * that come the dominant frequency (peak bin, parabolic interpolation),
+ * the RMS per band and the overall RMS of the three axes.
+ *
+ * Fixed memory, all static: 3.5 KB of FFT, window and spectrum buffers in
+ * RAM. In flash, besides the code, the 256 point tables only: 2.4 KB of
+ * twiddle factors and bit reversal indices.
+ * The cost of one window on a Cortex-M4F is about 3 x 15k cycles, most of
+ * it arm_rfft_fast_f32(). The bench times it, "vib" shows it on target.
+ */
+
+// Samples per window and axis, a power of two for the FFT
+#define VIB_WINDOW              256
+
+#define VIB_AXES                3
+
+// Below this the "vibration" is the boat moving
+#define VIB_MIN_HZ              2
+
+#define VIB_BAND_COUNT          4
+
+struct vib_result {
+    uint32_t uptime;            // ms, end of the window
+    uint16_t peak_chz;          // Dominant frequency, 0.01 Hz
+    uint16_t rms_mg;            // All axes, milli-g
+    uint16_t band_mg[VIB_BAND_COUNT];   // RMS per band, milli-g
+    bool valid;
+};
+
+// Band edges in Hz, VIB_BAND_COUNT + 1 of them. The last band runs to the
+// Nyquist frequency.
+extern const uint16_t vib_band_edges_hz[VIB_BAND_COUNT + 1];
+
+int vib_spectrum_init(void);
+
+// Analyse one window. raw is the accelerometer output in LSB, lsb_per_g
+// its scale and rate_mhz the sample rate in mHz that the window was
+// actually taken at. Sets everything in result but uptime.
+void vib_spectrum_analyse(const int16_t raw[VIB_AXES][VIB_WINDOW], uint32_t lsb_per_g,
+                          uint32_t rate_mhz, struct vib_result *result);
+
+#endif // VIB_SPECTRUM_H
@@ -0,0 +1,259 @@
+#include "vibration.h"
+#include "command_parser.h"
+#include "telemetry.h"
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/i2c.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(vibration, LOG_LEVEL_INF);
+
+#define SAMPLE_STACK_SIZE       1024
+// Above the sensor loop's consumers so that the sample spacing holds. It
+// sleeps in the I2C transfer, not a busy wait.
+#define SAMPLE_PRIORITY         2
+#define SAMPLE_PERIOD_MS        (1000 / VIB_SAMPLE_HZ)
+
+#define ANALYSIS_STACK_SIZE     1024
+#define ANALYSIS_PRIORITY       K_LOWEST_APPLICATION_THREAD_PRIO
+
+// MPU6050 registers, behind the sensor driver's back. The driver only
+// sets them up at init.
+#define MPU_REG_CONFIG          0x1A
+#define MPU_REG_ACCEL_CONFIG    0x1C
+#define MPU_REG_ACCEL_XOUT_H    0x3B
+#define MPU_DLPF_MASK           0x07
+#define MPU_DLPF_184HZ          0x01    // Accelerometer 184 Hz, gyro 188 Hz
+#define MPU_AFS_SEL_SHIFT       3
+#define MPU_AFS_SEL_MASK        0x18
+#define MPU_LSB_PER_G_2G        16384
+
+static const struct i2c_dt_spec mpu = I2C_DT_SPEC_GET(DT_NODELABEL(mpu6050));
+
+// Ping-pong: the sampler fills one while the analysis thread has the other
+static int16_t windows[2][VIB_AXES][VIB_WINDOW];
+static uint32_t window_rate_mhz[2];     // Sample rate each was taken at
+static atomic_t busy;                   // Bit per window with the analysis
+static atomic_t ready;                  // Window handed over last
+static atomic_t running;
+static uint32_t lsb_per_g = MPU_LSB_PER_G_2G;
+static uint8_t saved_dlpf;              // The driver's filter, back on "vib off"
+
+static struct vib_result last_result;
+static uint32_t windows_done;
+static uint32_t windows_dropped;
+static uint32_t read_errors;
+static uint32_t last_cycles;            // Analysis of one window
+static uint32_t max_cycles;
+
+static K_MUTEX_DEFINE(vib_mutex);
+static K_SEM_DEFINE(start_sem, 0, 1);
+static K_SEM_DEFINE(window_sem, 0, 1);
+
+int vib_set_enabled(bool enable)
+{
+    uint8_t accel_config, config;
+    int ret;
+
+    if (!enable) {
+        if (!atomic_cas(&running, 1, 0)) {
+            return 0;
+        }
+        // The 50 Hz attitude path runs on with the filter it was set up with
+        ret = i2c_reg_update_byte_dt(&mpu, MPU_REG_CONFIG, MPU_DLPF_MASK, saved_dlpf);
+        return ret != 0 ? -EIO : 0;
+    }
+    if (atomic_get(&running)) {
+        return 0;
+    }
+    if (!i2c_is_ready_dt(&mpu)) {
+        return -ENODEV;
+    }
+
+    // The scale the driver set, and the low pass as anti-aliasing filter
+    ret = i2c_reg_read_byte_dt(&mpu, MPU_REG_ACCEL_CONFIG, &accel_config);
+    if (ret == 0) {
+        ret = i2c_reg_read_byte_dt(&mpu, MPU_REG_CONFIG, &config);
+    }
+    if (ret == 0) {
+        saved_dlpf = config & MPU_DLPF_MASK;
+        ret = i2c_reg_update_byte_dt(&mpu, MPU_REG_CONFIG, MPU_DLPF_MASK, MPU_DLPF_184HZ);
+    }
+    if (ret != 0) {
+        return -ENODEV;
+    }
+    lsb_per_g = MPU_LSB_PER_G_2G >> ((accel_config & MPU_AFS_SEL_MASK) >> MPU_AFS_SEL_SHIFT);
+
+    atomic_set(&running, 1);
+    k_sem_give(&start_sem);
+    return 0;
+}
+
+bool vib_get_result(struct vib_result *dest)
+{
+    k_mutex_lock(&vib_mutex, K_FOREVER);
+    *dest = last_result;
+    k_mutex_unlock(&vib_mutex);
+
+    dest->valid = dest->valid && atomic_get(&running);
+    return dest->valid;
+}
+
+static int read_sample(int16_t window[VIB_AXES][VIB_WINDOW], int n)
+{
+    uint8_t buf[2 * VIB_AXES];
+    int ret;
+
+    ret = i2c_burst_read_dt(&mpu, MPU_REG_ACCEL_XOUT_H, buf, sizeof(buf));
+    if (ret != 0) {
+        return ret;
+    }
+    for (int axis = 0; axis < VIB_AXES; axis++) {
+        window[axis][n] = (int16_t)sys_get_be16(&buf[2 * axis]);
+    }
+    return 0;
+}
+
+static void sample_thread(void)
+{
+    uint32_t first = 0;
+    int64_t next = 0;
+    int fill = 0;
+    int n = 0;
+
+    while (1) {
+        uint32_t now;
+
+        if (!atomic_get(&running)) {
+            k_sem_take(&start_sem, K_FOREVER);
+            next = k_uptime_get();
+            n = 0;
+            continue;
+        }
+
+        next += SAMPLE_PERIOD_MS;
+        k_sleep(K_TIMEOUT_ABS_MS(next));
+
+        now = k_cycle_get_32();
+        if (read_sample(windows[fill], n) != 0) {
+            // Start the window again, a gap would smear the spectrum
+            read_errors++;
+            n = 0;
+            continue;
+        }
+        if (n == 0) {
+            first = now;
+        }
+        if (++n < VIB_WINDOW) {
+            continue;
+        }
+        n = 0;
+
+        // The other window is where the next one goes
+        if (atomic_test_bit(&busy, fill ^ 1)) {
+            windows_dropped++;
+            continue;
+        }
+
+        // From the time the window took, the tick is not exactly 2 ms
+        window_rate_mhz[fill] = (uint64_t)(VIB_WINDOW - 1) * 1000 *
+                                sys_clock_hw_cycles_per_sec() / (now - first);
+        atomic_set_bit(&busy, fill);
+        atomic_set(&ready, fill);
+        k_sem_give(&window_sem);
+        fill ^= 1;
+    }
+}
+
+static void analysis_thread(void)
+{
+    k_thread_runtime_stats_t before, after;
+    struct vib_result result;
+
+    if (vib_spectrum_init() != 0) {
+        LOG_ERR("FFT init failed");
+        return;
+    }
+
+    while (1) {
+        int w;
+
+        k_sem_take(&window_sem, K_FOREVER);
+        w = atomic_get(&ready);
+
+        // Our own execution cycles, not the time other threads took
+        k_thread_runtime_stats_get(k_current_get(), &before);
+        vib_spectrum_analyse(windows[w], lsb_per_g, window_rate_mhz[w], &result);
+        k_thread_runtime_stats_get(k_current_get(), &after);
+        atomic_clear_bit(&busy, w);
+        result.uptime = k_uptime_get_32();
+
+        k_mutex_lock(&vib_mutex, K_FOREVER);
+        last_result = result;
+        windows_done++;
+        last_cycles = after.execution_cycles - before.execution_cycles;
+        max_cycles = MAX(max_cycles, last_cycles);
+        k_mutex_unlock(&vib_mutex);
+
+        telemetry_tick(TELEMETRY_SRC_VIB);
+    }
+}
+
+// Console commands
+static int cmd_vib(int argc, char **argv)
+{
+    struct vib_result result;
+    uint32_t done, cycles, worst;
+    bool enable;
+    int ret;
+
+    if (argc == 1) {
+        if (cmd_parse_on_off(argv[0], &enable) != 0) {
+            return -EINVAL;
+        }
+        ret = vib_set_enabled(enable);
+        if (ret != 0) {
+            printk("Failed to %s vibration sampling: %d\n", enable ? "start" : "stop", ret);
+        }
+        return 0;
+    }
+
+    k_mutex_lock(&vib_mutex, K_FOREVER);
+    done = windows_done;
+    cycles = last_cycles;
+    worst = max_cycles;
+    k_mutex_unlock(&vib_mutex);
+
+    printk("Vibration %s, %u Hz, %u sample windows, +/-%u g\n",
+           atomic_get(&running) ? "on" : "off", VIB_SAMPLE_HZ, VIB_WINDOW,
+           MPU_LSB_PER_G_2G * 2 / lsb_per_g);
+    printk("Windows %u, dropped %u, read errors %u\n", done, windows_dropped, read_errors);
+    printk("Analysis %u cycles (%u us), worst %u\n", cycles, k_cyc_to_us_floor32(cycles),
+           worst);
+
+    if (!vib_get_result(&result)) {
+        return 0;
+    }
+    printk("Peak %u.%02u Hz, RMS %u mg\n", result.peak_chz / 100, result.peak_chz % 100,
+           result.rms_mg);
+    for (int band = 0; band < VIB_BAND_COUNT; band++) {
+        if (band + 1 < VIB_BAND_COUNT) {
+            printk("  %3u-%-3u Hz %5u mg\n", vib_band_edges_hz[band],
+                   vib_band_edges_hz[band + 1], result.band_mg[band]);
+        } else {
+            printk("  %3u+    Hz %5u mg\n", vib_band_edges_hz[band], result.band_mg[band]);
+        }
+    }
+    return 0;
+}
+
+CMD_DEFINE(vib, "vib", "[on|off]", "Vibration sampling on/off, or show the spectrum",
+           cmd_vib, 0, 1);
+
+K_THREAD_DEFINE(vib_sample_id, SAMPLE_STACK_SIZE, sample_thread, NULL, NULL, NULL,
+                SAMPLE_PRIORITY, 0, 0);
+K_THREAD_DEFINE(vib_analysis_id, ANALYSIS_STACK_SIZE, analysis_thread, NULL, NULL, NULL,
+                ANALYSIS_PRIORITY, 0, 0);
@@ -0,0 +1,35 @@
+#ifndef VIBRATION_H
+#define VIBRATION_H
+
+#include "vib_spectrum.h"
+#include <stdbool.h>
+
+/*
+ * Engine and hull vibration from the MPU6050.
+ *
+ * The 50 Hz sensor loop is too slow for engine orders, so while enabled
+ * ("vib on") a sampler thread reads the accelerometer registers directly
+ * at VIB_SAMPLE_HZ into a ping-pong buffer. It fills one window while the
+ * analysis thread, at the lowest priority, runs the FFTs on the other
+ * (vib_spectrum.h). A window that completes while the previous one is
+ * still being analysed is dropped and counted.
+ *
+ * Results go to the "vib" command and the telemetry "vib" channel, about
+ * two windows a second.
+ *
+ * Fixed memory: 3 KB of windows (2 x 3 axes x 256 x int16) here, 3.5 KB
+ * in vib_spectrum.c and two 1 KB stacks. I2C: a 6 byte read every 2 ms,
+ * about 10% of the 400 kHz bus.
+ */
+
+#define VIB_SAMPLE_HZ           500
+
+// Off at boot. Sets up the accelerometer's low pass filter as the
+// anti-aliasing filter and puts the driver's setting back when turned off.
+// Returns -ENODEV without an MPU6050, -EIO if the filter was not restored.
+int vib_set_enabled(bool enable);
+
+// The last window's result, false if there is none or sampling is off
+bool vib_get_result(struct vib_result *dest);
+
+#endif // VIBRATION_H
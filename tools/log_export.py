@@ -0,0 +1,260 @@
+#!/usr/bin/env python3
+"""Download the track store over the console UART ("log export").
+
+Sends "log export <fast>" at the console baud rate, follows the device to
+the export baud rate and receives the COBS frames, acknowledging as it goes
+so that only corrupted frames are sent again. The protocol is described in
+src/log_export.h.
+
+Usage:
+    log_export.py /dev/ttyACM0 track.csv [--baud 115200] [--fast 921600]
+    log_export.py /dev/ttyACM0 track.bin --raw
+
+Requires pyserial.
+"""
+
+import argparse
+import binascii
+import struct
+import sys
+import time
+
+FRAME_DATA = 0x01
+FRAME_END = 0x02
+FRAME_ACK = 0x81
+FRAME_STOP = 0x82
+
+HEADER = struct.Struct("<BI")           # type, sequence
+
+# struct track_record, keep in sync with src/track.h
+RECORD = struct.Struct("<IiiHHHhhBB")
+CSV_HEADER = "time,lat_e7,lon_e7,sog_cms,cog_cdeg,hdg_cdeg,pitch_cdeg,roll_cdeg,flags"
+
+ACK_MASK_BITS = 32
+ANNOUNCE_TIMEOUT = 3.0      # s, for the EXPORT line
+START_RETRY = 0.2           # s, between ACKs until the first frame arrives
+IDLE_TIMEOUT = 5.0          # s without a good frame before giving up
+LINGER = 0.05               # s to wait for a repeated END before switching back
+
+
+def cobs_encode(data):
+    out = bytearray()
+    block = bytearray()
+    for byte in data:
+        if byte == 0:
+            out.append(len(block) + 1)
+            out += block
+            block.clear()
+            continue
+        block.append(byte)
+        if len(block) == 0xFE:
+            out.append(0xFF)
+            out += block
+            block.clear()
+    out.append(len(block) + 1)
+    out += block
+    return bytes(out)
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data) + 1:
+            raise ValueError("bad COBS code")
+        out += data[i + 1:i + code]
+        i += code
+        if code != 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def crc8_ccitt(data, crc=0xFF):
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+def make_frame(kind, seq, payload=b""):
+    body = HEADER.pack(kind, seq) + payload
+    body += struct.pack("<I", binascii.crc32(body))
+    return b"\x00" + cobs_encode(body) + b"\x00"
+
+
+class Receiver:
+    def __init__(self, frames):
+        self.frames = frames        # DATA frames, END is frame 'frames'
+        self.got = {}
+        self.base = 0               # First frame not received yet
+        self.buf = bytearray()
+        self.bad = 0
+        self.duplicates = 0
+        self.bytes = 0
+
+    def done(self):
+        return self.base > self.frames
+
+    def feed(self, data):
+        """Take in raw bytes, return the number of good frames seen."""
+        good = 0
+        self.buf += data
+        while True:
+            end = self.buf.find(b"\x00")
+            if end < 0:
+                return good
+            raw = bytes(self.buf[:end])
+            del self.buf[:end + 1]
+            if raw:
+                if self.decode(raw):
+                    good += 1
+                else:
+                    self.bad += 1
+
+    def decode(self, raw):
+        try:
+            frame = cobs_decode(raw)
+        except ValueError:
+            return False
+        if len(frame) < HEADER.size + 4:
+            return False
+        body, crc = frame[:-4], struct.unpack("<I", frame[-4:])[0]
+        if binascii.crc32(body) != crc:
+            return False
+        kind, seq = HEADER.unpack_from(body)
+        payload = body[HEADER.size:]
+        if kind == FRAME_DATA and seq < self.frames:
+            if len(payload) % RECORD.size:
+                return False
+        elif not (kind == FRAME_END and seq == self.frames):
+            return False
+
+        if seq in self.got or seq < self.base:
+            self.duplicates += 1
+            return True
+        self.got[seq] = payload
+        self.bytes += len(payload)
+        while self.base in self.got:
+            self.base += 1
+        return True
+
+    def ack(self):
+        mask = 0
+        for n in range(ACK_MASK_BITS):
+            if self.base + 1 + n in self.got:
+                mask |= 1 << n
+        return make_frame(FRAME_ACK, self.base, struct.pack("<I", mask))
+
+    def records(self):
+        """Yield (record tuple, crc ok) in store order."""
+        for seq in range(self.frames):
+            payload = self.got[seq]
+            for offset in range(0, len(payload), RECORD.size):
+                raw = payload[offset:offset + RECORD.size]
+                record = RECORD.unpack(raw)
+                yield record, crc8_ccitt(raw[:-1]) == record[-1]
+
+
+def wait_announce(ser):
+    """Read console lines up to "EXPORT <baud> <frames> <records>"."""
+    deadline = time.monotonic() + ANNOUNCE_TIMEOUT
+    while time.monotonic() < deadline:
+        line = ser.readline().decode("ascii", "replace").strip()
+        # The prompt and echo may precede the line
+        start = line.find("EXPORT ")
+        if start >= 0:
+            _, baud, frames, records = line[start:].split()
+            return int(baud), int(frames), int(records)
+        if line.startswith(("Error", "Usage", "Unknown")):
+            sys.exit(f"device: {line}")
+    sys.exit("no response to 'log export'")
+
+
+def receive(ser, rx):
+    start = last_good = last_ack = last_report = time.monotonic()
+    while not rx.done():
+        data = ser.read(4096)
+        now = time.monotonic()
+        if data and rx.feed(data):
+            ser.write(rx.ack())
+            last_good = last_ack = now
+        elif not rx.got and now - last_ack > START_RETRY:
+            # The device waits for this before sending the first frame
+            ser.write(rx.ack())
+            last_ack = now
+        if now - last_good > IDLE_TIMEOUT:
+            raise TimeoutError(f"no frames for {IDLE_TIMEOUT:.0f} s")
+        if now - last_report > 0.5:
+            rate = rx.bytes / max(now - start, 1e-3)
+            print(f"\r{rx.base}/{rx.frames + 1} frames, {rate / 1024:.1f} KiB/s ",
+                  end="", file=sys.stderr)
+            last_report = now
+
+    # Answer a repeated END in case our last ACK was lost
+    deadline = time.monotonic() + LINGER
+    while time.monotonic() < deadline:
+        data = ser.read(4096)
+        if data and rx.feed(data):
+            ser.write(rx.ack())
+    elapsed = time.monotonic() - start
+    print(f"\r{rx.frames + 1} frames, {rx.bytes} bytes in {elapsed:.1f} s "
+          f"({rx.bytes / max(elapsed, 1e-3) / 1024:.1f} KiB/s), "
+          f"{rx.bad} bad, {rx.duplicates} duplicate", file=sys.stderr)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("port", help="console serial port")
+    parser.add_argument("output", help="output file")
+    parser.add_argument("--baud", type=int, default=115200, help="console baud rate")
+    parser.add_argument("--fast", type=int, default=921600, help="export baud rate")
+    parser.add_argument("--raw", action="store_true", help="write raw records, no CSV")
+    args = parser.parse_args()
+
+    import serial
+    ser = serial.Serial(args.port, args.baud, timeout=0.05)
+    ser.reset_input_buffer()
+    ser.write(f"log export {args.fast}\r".encode())
+    baud, frames, records = wait_announce(ser)
+    print(f"Exporting up to {records} records in {frames + 1} frames at {baud} baud",
+          file=sys.stderr)
+
+    ser.baudrate = baud
+    rx = Receiver(frames)
+    try:
+        receive(ser, rx)
+    except (KeyboardInterrupt, TimeoutError) as e:
+        for _ in range(3):
+            ser.write(make_frame(FRAME_STOP, 0))
+        ser.baudrate = args.baud
+        sys.exit(f"\nexport aborted: {e or 'interrupted'}")
+
+    # Device summary line at the console rate
+    ser.baudrate = args.baud
+    deadline = time.monotonic() + 1.0
+    while time.monotonic() < deadline:
+        line = ser.readline().decode("ascii", "replace").strip()
+        if line.startswith(("Exported", "Error")):
+            print(f"device: {line}", file=sys.stderr)
+            break
+
+    torn = 0
+    with open(args.output, "wb" if args.raw else "w") as out:
+        if not args.raw:
+            print(CSV_HEADER, file=out)
+        for record, ok in rx.records():
+            if not ok:
+                torn += 1
+            elif args.raw:
+                out.write(RECORD.pack(*record))
+            else:
+                print(",".join(str(v) for v in record[:-1]), file=out)
+    if torn:
+        print(f"{torn} torn records skipped", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,168 @@
+#!/usr/bin/env python3
+"""Decode the binary telemetry stream from the console UART.
+
+Frames are COBS encoded and 0x00 delimited; each carries
+header | payload | crc16 (CRC-16/CCITT-FALSE, little endian).
+Anything that fails to decode or check (e.g. console text) is skipped.
+
+Usage:
+    telemetry_decode.py /dev/ttyACM0 [--baud 115200] [--csv]
+    telemetry_decode.py capture.bin
+
+Requires pyserial for live ports.
+"""
+
+import argparse
+import binascii
+import os
+import struct
+import sys
+
+HEADER = struct.Struct("<BBI")      # channel, sequence, uptime ms
+
+FLAGS = ("gps", "compass", "acc", "nav", "dr", "vib")
+
+# Payload layouts, keep in sync with src/telemetry.c
+CHANNELS = {
+    0: ("gps", struct.Struct("<BiiIII"),
+        ("flags", "lat", "lon", "sog", "cog", "utc_ms")),
+    1: ("att", struct.Struct("<BIii"),
+        ("flags", "heading", "pitch", "roll")),
+    2: ("fused", struct.Struct("<BiiIIIIii"),
+        ("flags", "lat", "lon", "sog", "cog", "utc_ms", "heading", "pitch", "roll")),
+    3: ("nav", struct.Struct("<BBIIiiI"),
+        ("flags", "mark", "dtw", "btw", "xte", "vmg", "eta")),
+    4: ("fence", struct.Struct("<BBHHHBB"),
+        ("flags", "fences", "inside", "dwelling", "events", "event", "fence")),
+    5: ("dr", struct.Struct("<BiiiiII"),
+        ("flags", "lat", "lon", "ve", "vn", "sigma", "age_ms")),
+    6: ("vib", struct.Struct("<BHHHHHH"),
+        ("flags", "peak_hz", "rms_g", "band0_g", "band1_g", "band2_g", "band3_g")),
+}
+
+# Raw integer units to display units
+SCALE = {
+    "lat": 1e-7, "lon": 1e-7,           # degrees
+    "sog": 1e-3,                        # m/s
+    "cog": 1e-3, "heading": 1e-3,       # degrees
+    "pitch": 1e-3, "roll": 1e-3,        # degrees
+    "dtw": 1e-2, "xte": 1e-2,           # m
+    "btw": 1e-3,                        # degrees
+    "vmg": 1e-3, "ve": 1e-3, "vn": 1e-3,  # m/s
+    "sigma": 1e-2,                      # m
+    "peak_hz": 1e-2,                    # Hz
+    "rms_g": 1e-3, "band0_g": 1e-3, "band1_g": 1e-3,    # g
+    "band2_g": 1e-3, "band3_g": 1e-3,
+}
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data) + 1:
+            raise ValueError("bad COBS code")
+        out += data[i + 1:i + code]
+        i += code
+        if code != 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+class Decoder:
+    def __init__(self):
+        self.buf = bytearray()
+        self.bad = 0
+        self.last_seq = {}
+        self.lost = 0
+
+    def feed(self, data):
+        """Yield (channel name, header dict, field dict) for each good frame."""
+        self.buf += data
+        while True:
+            end = self.buf.find(b"\x00")
+            if end < 0:
+                return
+            raw = bytes(self.buf[:end])
+            del self.buf[:end + 1]
+            if not raw:
+                continue
+            record = self.decode(raw)
+            if record is None:
+                self.bad += 1
+            else:
+                yield record
+
+    def decode(self, raw):
+        try:
+            frame = cobs_decode(raw)
+        except ValueError:
+            return None
+        if len(frame) < HEADER.size + 2:
+            return None
+        body, crc = frame[:-2], struct.unpack("<H", frame[-2:])[0]
+        if binascii.crc_hqx(body, 0xFFFF) != crc:
+            return None
+        channel, seq, uptime = HEADER.unpack_from(body)
+        if channel not in CHANNELS:
+            return None
+        name, layout, fields = CHANNELS[channel]
+        if len(body) - HEADER.size != layout.size:
+            return None
+
+        if channel in self.last_seq:
+            self.lost += (seq - self.last_seq[channel] - 1) & 0xFF
+        self.last_seq[channel] = seq
+
+        values = dict(zip(fields, layout.unpack_from(body, HEADER.size)))
+        return name, {"seq": seq, "uptime_ms": uptime}, values
+
+
+def format_record(name, header, values, csv):
+    out = []
+    for key, value in values.items():
+        if key == "flags":
+            value = "|".join(f for i, f in enumerate(FLAGS) if value & (1 << i)) or "-"
+        elif key in SCALE:
+            value = round(value * SCALE[key], 7)
+        out.append(str(value) if csv else f"{key}={value}")
+    if csv:
+        return ",".join([name, str(header["uptime_ms"])] + out)
+    return f"{header['uptime_ms']:>10} {name:<6} " + " ".join(out)
+
+
+def open_source(path, baud):
+    if os.path.isfile(path):
+        return open(path, "rb", buffering=0)
+    import serial
+    return serial.Serial(path, baud, timeout=0.1)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("source", help="serial port or capture file")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--csv", action="store_true", help="comma separated output")
+    args = parser.parse_args()
+
+    decoder = Decoder()
+    source = open_source(args.source, args.baud)
+    try:
+        while True:
+            data = source.read(4096)
+            if not data:
+                if hasattr(source, "in_waiting"):
+                    continue
+                break
+            for name, header, values in decoder.feed(data):
+                print(format_record(name, header, values, args.csv))
+    except KeyboardInterrupt:
+        pass
+    finally:
+        print(f"# bad frames: {decoder.bad}, lost records: {decoder.lost}", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()